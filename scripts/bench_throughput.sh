@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Throughput stress benchmark on the host simulator.
+# Sweeps feed rate, edge-to-edge gap, block length and belt speed one at a
+# time around a baseline and writes one CSV row per point (mis-sort, merge and
+# reject rates per block). Arguments are forwarded to build_sim.sh, so a
+# config.h override can be measured directly:
+#
+#   scripts/bench_throughput.sh -DDECIDE_MIN_SPACING_MS=500 -DSCHED_CAPACITY=8
+#
+# Environment: BLOCKS (per point, default 500), SEED, OUT (CSV path),
+# RATES / GAPS / LENGTHS / SPEEDS (space-separated sweep values, rates
+# ascending), TOL (mis-sort margin for the max-rate summary, default 0.01).
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+BUILD_DIR="${PROJECT_ROOT}/build/sim"
+
+BLOCKS="${BLOCKS:-500}"
+SEED="${SEED:-1}"
+OUT="${OUT:-${BUILD_DIR}/throughput.csv}"
+RATES="${RATES:-4 6 8 10 12 15 20 25 30 40 50 60}"
+GAPS="${GAPS:-400 300 200 150 100 75 50 25 10}"
+LENGTHS="${LENGTHS:-20:30 30:45 45:55 55:70 70:100}"
+SPEEDS="${SPEEDS:-30 40 55 70 85 100}"
+
+# Baseline the other sweeps hold fixed
+BASE_RATE=10
+BASE_LEN=30:70
+BASE_SPEED=55
+
+SIM="${BUILD_DIR}/bench/conveyor_sim"
+SIM_OUT="${SIM}" "${SCRIPT_DIR}/build_sim.sh" "$@" >/dev/null
+
+mkdir -p "$(dirname "${OUT}")"
+{
+  printf 'sweep,'
+  "${SIM}" --csv-header
+} > "${OUT}"
+
+run() {
+  local sweep="$1"
+  shift
+  printf '%s,' "${sweep}" >> "${OUT}"
+  "${SIM}" --blocks "${BLOCKS}" --seed "${SEED}" --csv "$@" >> "${OUT}"
+}
+
+echo "[bench] ${BLOCKS} blocks per point -> ${OUT}"
+for r in ${RATES}; do
+  run rate --rate "${r}" --len "${BASE_LEN}" --speed "${BASE_SPEED}"
+done
+for g in ${GAPS}; do
+  run gap --gap "${g}" --len "${BASE_LEN}" --speed "${BASE_SPEED}"
+done
+for l in ${LENGTHS}; do
+  run length --rate "${BASE_RATE}" --len "${l}" --speed "${BASE_SPEED}"
+done
+for s in ${SPEEDS}; do
+  run speed --rate "${BASE_RATE}" --len "${BASE_LEN}" --speed "${s}"
+done
+
+# Highest swept feed rate whose mis-sort rate stays within TOL of the slowest
+# rate (the floor set by sensing alone, e.g. lengths near LENGTH_SMALL_MAX_MM)
+awk -F, -v tol="${TOL:-0.01}" '
+  NR == 1 { for (i = 1; i <= NF; i++) { if ($i == "missort_rate") { m = i } } }
+  NR > 1 && $1 == "rate" {
+    if (!seen) { floor = $m; seen = 1 }
+    if ($m <= floor + tol && $2 > best) { best = $2 }
+  }
+  END { printf "[bench] mis-sort floor %.4f; max rate within +%s: %s blocks/min\n", floor, tol, best }' "${OUT}"
@@ -9,7 +9,7 @@ if(-not (Test-Path $BuildDir)) { New-Item -ItemType Directory -Path $BuildDir |
 
 # Find all C sources
 $Sources = Get-ChildItem -Path $SrcDir -Recurse -Filter *.c |
-  Where-Object { $_.Name -notin @('commands.c','calibration.c') } |
+  Where-Object { $_.Name -notin @('calibration.c') } |
   ForEach-Object { $_.FullName }
 if(-not $Sources) { Write-Error 'No C sources found under src/'; exit 1 }
 
@@ -48,6 +48,7 @@ function Find-Tool($name){
 $gcc = Find-Tool 'avr-gcc'
 $size = Find-Tool 'avr-size'
 $objcopy = Find-Tool 'avr-objcopy'
+$nm = Find-Tool 'avr-nm'
 
 if(-not $gcc){ Write-Error "avr-gcc not found. Add to PATH or install Arduino AVR Boards or Microchip avr8-gnu-toolchain."; exit 1 }
 if(-not $size){ Write-Warning "avr-size not found; size report will be skipped." }
@@ -67,6 +68,24 @@ if($LASTEXITCODE -ne 0){ Write-Error "avr-gcc failed ($LASTEXITCODE)"; exit $LAS
 if($LASTEXITCODE -ne 0){ Write-Error "avr-objcopy failed ($LASTEXITCODE)"; exit $LASTEXITCODE }
 
 # Print size
-if($size){ & $size -C --mcu=atmega328p $Elf }
+if($size){
+  & $size -C --mcu=atmega328p $Elf
+  # Static RAM is fixed at link time (.data is copied from flash at startup);
+  # what is left of the 2 KB is all the stack gets
+  $sec = @{ '.data' = 0; '.bss' = 0; '.noinit' = 0 }
+  & $size -A $Elf | ForEach-Object {
+    $p = -split $_
+    if($p.Count -ge 2 -and $sec.ContainsKey($p[0])){ $sec[$p[0]] = [int]$p[1] }
+  }
+  $static = $sec['.data'] + $sec['.bss'] + $sec['.noinit']
+  Write-Host "[build] Static RAM: .data=$($sec['.data']) .bss=$($sec['.bss']) .noinit=$($sec['.noinit']) total=$static of 2048 bytes, $(2048 - $static) left for stack"
+}
+if($nm){
+  Write-Host "[build] Largest static RAM symbols (bytes):"
+  & $nm -S --size-sort -r $Elf | ForEach-Object {
+    $p = -split $_
+    if($p.Count -eq 4 -and $p[2] -cmatch '^[bBdD]$'){ '  {0,6}  {1}' -f [Convert]::ToInt32($p[1], 16), $p[3] }
+  } | Select-Object -First 12 | ForEach-Object { Write-Host $_ }
+}
 
 Write-Host "[build] Output: $Elf`n[build] HEX: $Hex"
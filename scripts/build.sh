@@ -3,6 +3,8 @@ set -euo pipefail
 
 # Build firmware for ATmega328P (Arduino Nano) on macOS/Linux.
 # Robust to spaces in project paths; avoids broken sources.list usage.
+# Extra arguments are passed to the compiler, e.g. -DSENSE_COLOR_DEBUG=0 to
+# compare image size against a config.h override.
 
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
 PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
@@ -19,7 +21,7 @@ SOURCES=()
 while IFS= read -r -d '' f; do
   SOURCES+=("$f")
 done < <(find "${SRC_DIR}" -type f -name '*.c' \
-  ! -name 'commands.c' ! -name 'calibration.c' -print0 | sort -z)
+  ! -name 'calibration.c' -print0 | sort -z)
 if [[ ${#SOURCES[@]} -eq 0 ]]; then
   echo "[build] No C sources found under ${SRC_DIR}" >&2
   exit 1
@@ -59,6 +61,7 @@ find_tool() {
 GCC="$(find_tool avr-gcc || true)"
 OBJCOPY="$(find_tool avr-objcopy || true)"
 SIZE="$(find_tool avr-size || true)"
+NM="$(find_tool avr-nm || true)"
 
 if [[ -z "${GCC}" ]]; then
   echo "[build] ERROR: avr-gcc not found. Install Arduino IDE (AVR Boards) or avr-gcc via Homebrew (osx-cross/avr/avr-gcc), or add to PATH." >&2
@@ -76,6 +79,7 @@ echo "[build] Compiling ${#SOURCES[@]} sources..."
 
 DEFINES=(
   -DF_CPU=16000000UL
+  "$@"
 )
 CFLAGS=(
   -mmcu=atmega328p
@@ -105,6 +109,25 @@ INCLUDES=(
 # Optional size report
 if [[ -n "${SIZE}" ]]; then
   "${SIZE}" -C --mcu=atmega328p "${ELF}"
+  # Static RAM is fixed at link time (.data is copied from flash at startup);
+  # what is left of the 2 KB is all the stack gets
+  read -r DATA BSS NOINIT < <("${SIZE}" -A "${ELF}" | \
+    awk '$1==".data"{d=$2} $1==".bss"{b=$2} $1==".noinit"{n=$2} END{print d+0, b+0, n+0}')
+  STATIC=$((DATA + BSS + NOINIT))
+  echo "[build] Static RAM: .data=${DATA} .bss=${BSS} .noinit=${NOINIT} total=${STATIC} of 2048 bytes, $((2048 - STATIC)) left for stack"
+fi
+if [[ -n "${NM}" ]]; then
+  echo "[build] Largest static RAM symbols (bytes):"
+  n=0
+  while read -r _ size type name; do
+    case "${type}" in
+      b|B|d|D)
+        printf '  %6d  %s\n' "$((16#${size}))" "${name}"
+        n=$((n + 1))
+        [[ ${n} -ge 12 ]] && break
+        ;;
+    esac
+  done < <("${NM}" -S --size-sort -r "${ELF}")
 fi
 
 echo "[build] Output: ${ELF}"
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Turn binary log frames back into the text log format.
+
+Firmware built with -DLOG_FORMAT_DEFAULT=1 (or switched with log_set_format())
+sends event logs as frames (see src/utils/log.c):
+
+    0xA5 <len> <type> <fields...> <crc8>
+
+Text that stays text (boot banners, color/TRACE/instrumentation lines) passes
+through unchanged, so a mixed capture decodes to what a text build prints:
+
+    scripts/log_decode.py capture.bin
+    build/sim/conveyor_sim -v | scripts/log_decode.py | scripts/trace_report.py
+
+Frames with a bad CRC are skipped and counted on stderr.
+"""
+import argparse
+import sys
+
+SYNC = 0xA5
+LENGTH_CLASSES = ("Small", "NotSmall")
+COLORS = ("R", "G", "B", "Other")
+POSITIONS = ("Pos1", "Pos2", "Pos3", "PassThrough")
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class Fields:
+    def __init__(self, payload):
+        self.p = payload
+        self.i = 0
+
+    def byte(self):
+        v = self.p[self.i]
+        self.i += 1
+        return v
+
+    def varint(self):
+        v = shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def text(self):
+        n = self.byte()
+        s = self.p[self.i:self.i + n].decode("ascii", "replace")
+        self.i += n
+        return s
+
+
+def name(table, v):
+    return table[v] if v < len(table) else table[-1]
+
+
+def fmt_classify(f):
+    t, i, color, mm, cls, thr = f.varint(), f.varint(), f.byte(), f.varint(), f.byte(), f.varint()
+    return (f"CLASSIFY t={t} id={i} color={name(COLORS, color)} len_mm={mm} "
+            f"class={name(LENGTH_CLASSES, cls)} thr={thr}")
+
+
+def fmt_count(f):
+    keys = ("total", "diverted", "passed", "fault", "red", "green", "blue", "other")
+    t = f.varint()
+    return f"COUNT t={t} " + " ".join(f"{k}={f.varint()}" for k in keys)
+
+
+# Frame type -> formatter; values match LogFrameType in src/utils/log.h
+FORMATTERS = {
+    1: lambda f: f"DETECT t={f.varint()} id={f.varint()}",
+    2: lambda f: f"CLEAR t={f.varint()} id={f.varint()}",
+    3: fmt_classify,
+    4: lambda f: f"SCHEDULE t={f.varint()} id={f.varint()} pos={name(POSITIONS, f.byte())} at={f.varint()}",
+    5: lambda f: f"ACTUATE t={f.varint()} id={f.varint()} pos={name(POSITIONS, f.byte())} slack_ms={f.varint()}",
+    6: lambda f: f"MISSED t={f.varint()} id={f.varint()} pos={name(POSITIONS, f.byte())} late_ms={f.varint()}",
+    7: lambda f: f"SCHEDULE_REJECT t={f.varint()} id={f.varint()} reason={f.text()}",
+    8: lambda f: f"PASS t={f.varint()}",
+    9: lambda f: f"FAULT t={f.varint()} code={f.text()}",
+    10: fmt_count,
+    11: lambda f: f"UART t={f.varint()} tx_queued={f.varint()} tx_dropped={f.varint()} rx_dropped={f.varint()}",
+    12: lambda f: f"SCHED t={f.varint()} depth={f.varint()} hwm={f.varint()} cap={f.varint()} missed={f.varint()}",
+    13: lambda f: f"LENGTH t={f.varint()} id={f.varint()} len_mm={f.varint()} dwell_ms={f.varint()}",
+}
+
+
+class Decoder:
+    def __init__(self, out):
+        self.out = out
+        self.buf = bytearray()
+        self.frames = 0
+        self.bad = 0
+
+    def feed(self, data, final=False):
+        self.buf += data
+        i = 0
+        n = len(self.buf)
+        while i < n:
+            sync = self.buf.find(SYNC, i)
+            end = n if sync < 0 else sync
+            if end > i:
+                self.out.write(self.buf[i:end].decode("ascii", "replace").replace("\r", ""))
+                i = end
+                continue
+            # Frame at i: wait for all of it unless the stream has ended
+            if i + 2 > n or i + 3 + self.buf[i + 1] > n:
+                if not final:
+                    break
+                self.bad += 1
+                i += 1
+                continue
+            flen = self.buf[i + 1]
+            body = self.buf[i + 1:i + 2 + flen]
+            line = None
+            if flen and crc8(body) == self.buf[i + 2 + flen]:
+                fmt = FORMATTERS.get(body[1])
+                try:
+                    line = fmt(Fields(bytes(body[2:]))) if fmt else None
+                except IndexError:
+                    line = None
+            if line is None:
+                self.bad += 1
+                i += 1  # resync on the next sync byte
+                continue
+            self.out.write(line + "\n")
+            self.frames += 1
+            i += 3 + flen
+        del self.buf[:i]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="?", help="binary capture (default: stdin)")
+    args = ap.parse_args()
+    src = open(args.log, "rb") if args.log else sys.stdin.buffer
+    dec = Decoder(sys.stdout)
+    with src:
+        while True:
+            chunk = src.read1(4096) if hasattr(src, "read1") else src.read(4096)
+            if not chunk:
+                break
+            dec.feed(chunk)
+            sys.stdout.flush()
+    dec.feed(b"", final=True)
+    if dec.bad:
+        print(f"log_decode: {dec.frames} frames, {dec.bad} bad", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
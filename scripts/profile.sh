@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Cycle-accurate profile of build/firmware.elf under simavr.
+# Builds the firmware (scripts/build.sh), dumps its symbol table with avr-nm,
+# builds the simavr harness (sim/profile/) against libsimavr and runs it.
+# Arguments go to the harness, e.g. --ms 30000 --rate 30 --uart; BUILD_FLAGS
+# go to build.sh, e.g. BUILD_FLAGS=-DSENSE_COLOR_DEBUG=0.
+# The report (per-function self cycles, per-call cycles, ISR occupancy,
+# worst-case main-loop period) is also written to build/profile/report.txt.
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+SRC_DIR="${PROJECT_ROOT}/src"
+SIM_DIR="${PROJECT_ROOT}/sim"
+BUILD_DIR="${PROJECT_ROOT}/build"
+PROF_DIR="${BUILD_DIR}/profile"
+
+read -r -a BUILD_ARGS <<< "${BUILD_FLAGS:-}"
+"${SCRIPT_DIR}/build.sh" ${BUILD_ARGS[@]+"${BUILD_ARGS[@]}"}
+ELF="${BUILD_DIR}/firmware.elf"
+
+NM="${AVR_NM:-}"
+if [[ -z "${NM}" ]]; then
+  if command -v avr-nm >/dev/null 2>&1; then
+    NM="$(command -v avr-nm)"
+  elif command -v avr-gcc >/dev/null 2>&1; then
+    NM="$(dirname "$(command -v avr-gcc)")/avr-nm"
+  fi
+fi
+if [[ -z "${NM}" || ! -x "${NM}" ]]; then
+  echo "[profile] ERROR: avr-nm not found (add the AVR toolchain to PATH or set AVR_NM)." >&2
+  exit 1
+fi
+
+CC="${CC:-cc}"
+if pkg-config --exists simavr 2>/dev/null; then
+  read -r -a SIMAVR_CFLAGS <<< "$(pkg-config --cflags simavr)"
+  read -r -a SIMAVR_LIBS <<< "$(pkg-config --libs simavr)"
+else
+  SIMAVR_CFLAGS=(-I/usr/include/simavr -I/usr/local/include/simavr)
+  SIMAVR_LIBS=(-lsimavr -lelf)
+fi
+
+mkdir -p "${PROF_DIR}"
+"${NM}" -S -n "${ELF}" > "${PROF_DIR}/symbols.txt"
+
+echo "[profile] Building simavr harness..."
+"${CC}" -std=gnu11 -O2 -Wall -Wextra \
+  "${SIMAVR_CFLAGS[@]}" -I"${SIM_DIR}" -I"${SRC_DIR}" -I"${SRC_DIR}/platform" \
+  "${SIM_DIR}/profile/avr_profile.c" "${SIM_DIR}/devices.c" \
+  "${SIMAVR_LIBS[@]}" -o "${PROF_DIR}/avr_profile"
+
+echo "[profile] Running ${ELF}..."
+"${PROF_DIR}/avr_profile" "${ELF}" "${PROF_DIR}/symbols.txt" "$@" | tee "${PROF_DIR}/report.txt"
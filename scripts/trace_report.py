@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Summarize per-block TRACE lines from a captured serial log.
+
+Build the firmware (or the simulator) with -DTRACE_ENABLE=1, capture the UART
+output, then run:
+
+    scripts/trace_report.py capture.log
+    build/sim/conveyor_sim -v | scripts/trace_report.py
+
+Each TRACE line carries millis() timestamps for one block (see
+src/utils/trace.c). The report gives min/percentiles/max for each pipeline
+stage and for lateness against the scheduled due time.
+"""
+import argparse
+import sys
+
+# (label, end field, start field): interval = end - start in ms
+STAGES = [
+    ("dwell (enter->exit)", "exit", "enter"),
+    ("classify (exit->cls)", "cls", "exit"),
+    ("schedule lead (cls->due)", "due", "cls"),
+    ("lateness (due->fire)", "fire", "due"),
+    ("detect->fire", "fire", "enter"),
+    ("hold (fire->center)", "center", "fire"),
+]
+PERCENTILES = (50, 90, 99)
+
+
+def parse(lines):
+    records = []
+    lost = 0
+    for line in lines:
+        start = line.find("TRACE ")
+        if start < 0:
+            continue
+        rec = {}
+        for tok in line[start + 6:].split():
+            key, sep, val = tok.partition("=")
+            if sep and val.isdigit():
+                rec[key] = int(val)
+        if "id" not in rec:
+            continue
+        lost += rec.pop("lost", 0)
+        records.append(rec)
+    return records, lost
+
+
+def delta_ms(end, start):
+    # millis() is a wrapping 32-bit counter
+    d = (end - start) & 0xFFFFFFFF
+    return d - (1 << 32) if d >= (1 << 31) else d
+
+
+def percentile(sorted_vals, p):
+    # nearest-rank
+    k = max(0, min(len(sorted_vals) - 1, -(-p * len(sorted_vals) // 100) - 1))
+    return sorted_vals[k]
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("log", nargs="?", help="serial capture (default: stdin)")
+    args = ap.parse_args()
+    if args.log:
+        with open(args.log, errors="replace") as f:
+            records, lost = parse(f)
+    else:
+        records, lost = parse(sys.stdin)
+
+    fired = [r for r in records if "fire" in r]
+    print(f"blocks traced={len(records)} fired={len(fired)} "
+          f"no-center={sum(1 for r in fired if 'center' not in r)} lost={lost}")
+    if not records:
+        return 1
+
+    hdr = f"{'stage (ms)':<26}{'n':>7}{'min':>8}" + "".join(f"{'p%d' % p:>8}" for p in PERCENTILES) + f"{'max':>8}"
+    print(hdr)
+    for label, end, start in STAGES:
+        vals = sorted(delta_ms(r[end], r[start]) for r in records if end in r and start in r)
+        if not vals:
+            continue
+        row = f"{label:<26}{len(vals):>7}{vals[0]:>8}"
+        row += "".join(f"{percentile(vals, p):>8}" for p in PERCENTILES)
+        row += f"{vals[-1]:>8}"
+        print(row)
+
+    late = [delta_ms(r["fire"], r["due"]) for r in fired if "due" in r]
+    if late:
+        print(f"fired after due: {sum(1 for v in late if v > 0)}/{len(late)}, "
+              f">10 ms late: {sum(1 for v in late if v > 10)}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
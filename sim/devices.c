@@ -0,0 +1,159 @@
+/*
+ * Simulated I2C sensors
+ * ---------------------
+ * Register-level models of the two sensors so the real vl6180.c and
+ * apds9960.c drivers run unchanged on top of the fake TWI:
+ * - VL6180 (0x29): 16-bit register index with auto-increment. Continuous
+ *   ranging every (INTERMEASUREMENT_PERIOD+1)*10 ms; each sample is checked
+ *   against THRESH_LOW/THRESH_HIGH for the mode in INTERRUPT_CONFIG_GPIO[2:0].
+ *   A hit latches the interrupt and pulls GPIO1 low (INT0 falling edge) until
+ *   SYSTEM__INTERRUPT_CLEAR is written. RESULT__RANGE_VAL holds the last sample.
+ * - APDS9960 (0x39): 8-bit register index with auto-increment. ID reads 0xAB;
+ *   the CDATAL..BDATAH burst returns what the world puts under the sensor once
+ *   PON|AEN are set. Integration lag is not modelled.
+ */
+#include <string.h>
+#include "sim.h"
+#include "platform/config.h"
+#include "drivers/vl6180.h"
+
+#define VL_REGS              0x300
+#define VL_INT_CONFIG        0x014
+#define VL_INT_CLEAR         0x015
+#define VL_FRESH_OUT_OF_RESET 0x016
+#define VL_RANGE_START       0x018
+#define VL_THRESH_HIGH       0x019
+#define VL_THRESH_LOW        0x01A
+#define VL_INTERMEASUREMENT  0x01B
+#define VL_INT_STATUS        0x04F
+#define VL_RANGE_VAL         0x062
+
+#define APDS_ENABLE          0x80
+#define APDS_ID              0x92
+#define APDS_CDATAL          0x94
+#define APDS_BDATAH          0x9B
+
+static uint8_t s_vl_regs[VL_REGS];
+static bool s_vl_ranging = false;
+static bool s_vl_latched = false;
+static uint64_t s_vl_next_us = UINT64_MAX;
+
+static uint8_t s_apds_regs[256];
+
+void sim_dev_reset(void) {
+    memset(s_vl_regs, 0, sizeof(s_vl_regs));
+    s_vl_regs[VL_FRESH_OUT_OF_RESET] = 1;
+    s_vl_regs[VL_INTERMEASUREMENT] = 0xFF;
+    s_vl_ranging = false;
+    s_vl_latched = false;
+    s_vl_next_us = UINT64_MAX;
+    memset(s_apds_regs, 0, sizeof(s_apds_regs));
+    s_apds_regs[APDS_ID] = 0xAB;
+}
+
+static uint32_t vl_period_us(void) {
+    return ((uint32_t)s_vl_regs[VL_INTERMEASUREMENT] + 1U) * 10000U;
+}
+
+static void vl_write(uint16_t reg, uint8_t v) {
+    if (reg >= VL_REGS) {
+        return;
+    }
+    s_vl_regs[reg] = v;
+    switch (reg) {
+        case VL_INT_CLEAR:
+            if (v & 0x01) {
+                s_vl_latched = false; // GPIO1 released
+                s_vl_regs[VL_INT_STATUS] = 0;
+            }
+            break;
+        case VL_RANGE_START:
+            if (v & 0x01) {
+                // bit1 selects continuous mode; first sample one period out
+                s_vl_ranging = (v & 0x02) != 0;
+                s_vl_next_us = sim_now_us() + vl_period_us();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool vl_xfer(const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len) {
+    if (tx_len < 2) {
+        return tx_len == 0 && rx_len == 0; // address-only probe
+    }
+    uint16_t reg = (uint16_t)((uint16_t)tx[0] << 8 | tx[1]);
+    for (uint8_t i = 2; i < tx_len; i++) {
+        vl_write(reg++, tx[i]);
+    }
+    for (uint8_t i = 0; i < rx_len; i++, reg++) {
+        rx[i] = (reg < VL_REGS) ? s_vl_regs[reg] : 0;
+    }
+    return true;
+}
+
+uint64_t sim_vl6180_next_meas_us(void) {
+    return s_vl_next_us;
+}
+
+void sim_vl6180_measure(void) {
+    uint8_t range = sim_world_range_mm();
+    s_vl_regs[VL_RANGE_VAL] = range;
+    s_vl_next_us = s_vl_ranging ? s_vl_next_us + vl_period_us() : UINT64_MAX;
+    uint8_t mode = (uint8_t)(s_vl_regs[VL_INT_CONFIG] & 0x07);
+    bool hit = false;
+    switch (mode) {
+        case VL6180_INT_LOW: hit = range < s_vl_regs[VL_THRESH_LOW]; break;
+        case VL6180_INT_HIGH: hit = range > s_vl_regs[VL_THRESH_HIGH]; break;
+        case VL6180_INT_OUT_OF_WINDOW:
+            hit = range < s_vl_regs[VL_THRESH_LOW] || range > s_vl_regs[VL_THRESH_HIGH];
+            break;
+        case 4: hit = true; break; // new sample ready
+        default: break;
+    }
+    if (!hit || s_vl_latched) {
+        return;
+    }
+    s_vl_latched = true;
+    s_vl_regs[VL_INT_STATUS] = mode;
+    if (mode == VL6180_INT_LOW) {
+        sim_world_note_detect();
+    }
+    sim_int0_edge();
+}
+
+bool sim_vl6180_gpio1_high(void) {
+    return !s_vl_latched;
+}
+
+static bool apds_xfer(const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len) {
+    if (tx_len == 0) {
+        return rx_len == 0;
+    }
+    uint8_t reg = tx[0];
+    for (uint8_t i = 1; i < tx_len; i++) {
+        s_apds_regs[reg++] = tx[i];
+    }
+    if (rx_len && reg >= APDS_CDATAL && reg <= APDS_BDATAH &&
+        (s_apds_regs[APDS_ENABLE] & 0x03) == 0x03) {
+        uint16_t ch[4];
+        sim_world_rgbc(&ch[1], &ch[2], &ch[3], &ch[0]); // register order C,R,G,B
+        for (uint8_t i = 0; i < 4; i++) {
+            s_apds_regs[APDS_CDATAL + 2 * i] = (uint8_t)(ch[i] & 0xFF);
+            s_apds_regs[APDS_CDATAL + 2 * i + 1] = (uint8_t)(ch[i] >> 8);
+        }
+    }
+    for (uint8_t i = 0; i < rx_len; i++) {
+        rx[i] = s_apds_regs[reg++];
+    }
+    return true;
+}
+
+bool sim_dev_xfer(uint8_t addr, const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len) {
+    switch (addr) {
+        case VL6180_I2C_ADDR: return vl_xfer(tx, tx_len, rx, rx_len);
+        case APDS9960_I2C_ADDR: return apds_xfer(tx, tx_len, rx, rx_len);
+        default: return false;
+    }
+}
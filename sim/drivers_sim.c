@@ -0,0 +1,147 @@
+/*
+ * Simulated drivers and interrupt wiring
+ * --------------------------------------
+ * Host replacements for drivers/servo.c and app/interrupts.c, implementing
+ * the same headers, plus the timer hardware under the real drivers/tb6600.c:
+ * - TB6600: the driver runs unchanged against the register stand-ins in
+ *   sim/include/avr/io.h. Its TIMER0_COMPB ramp ISR is called every 1 ms
+ *   (half a period after the millis() tick) while it has OCIE0B set, and STEP
+ *   pulses are integrated from the OC1A toggle rate that Timer1 is programmed
+ *   for, so the belt in world.c moves by the true geometry
+ *   (MM_PER_ROLLER_REV_X1000 / PULSES_PER_REV) per pulse.
+ * - Servo: records the commanded width per channel; the world treats any
+ *   width away from center as the diverter arm being out. Frame timing and
+ *   arm travel are not modelled.
+ * - INT0: sim_int0_edge() plays the ISR (flag + micros() edge time).
+ */
+#include <avr/io.h>
+#include "sim.h"
+#include "platform/config.h"
+#include "hal/timers.h"
+#include "drivers/servo.h"
+#include "app/interrupts.h"
+
+#define SERVO_CENTER_US 1500U
+
+// --- tb6600 ---------------------------------------------------------------
+// drivers/tb6600.c itself is linked; this models the timers it programs.
+
+#if !TB6600_HW_STEP
+#error "The simulator models the OC1A hardware toggle (TB6600_HW_STEP 1) only."
+#endif
+
+void TIMER0_COMPB_vect(void);
+
+static double s_pulses = 0.0;
+
+uint64_t sim_tb6600_next_tick_us(void) {
+    if (!(TIMSK0 & (1<<OCIE0B))) {
+        return UINT64_MAX;
+    }
+    // COMPB matches half a millis() period after COMPA (OCR0B = OCR0A / 2)
+    uint64_t now = sim_now_us();
+    return ((now + 500U) / 1000U) * 1000U + 500U;
+}
+
+void sim_tb6600_tick(void) {
+    TIMER0_COMPB_vect();
+}
+
+// Timer1 clock divider selected by the CS1x bits, or 0 while stopped
+static uint32_t timer1_prescaler(void) {
+    switch (TCCR1B & ((1<<CS12)|(1<<CS11)|(1<<CS10))) {
+    case (1<<CS10): return 1U;
+    case (1<<CS11): return 8U;
+    case (1<<CS11)|(1<<CS10): return 64U;
+    case (1<<CS12): return 256U;
+    case (1<<CS12)|(1<<CS10): return 1024U;
+    default: return 0U;
+    }
+}
+
+void sim_tb6600_advance(uint32_t dt_us) {
+    uint32_t presc = timer1_prescaler();
+    if (presc == 0U || !(TCCR1A & (1<<COM1A0))) {
+        return;
+    }
+    // OC1A toggles on every compare match: one STEP pulse per two periods
+    double hz = (double)F_CPU / (double)presc / (2.0 * ((double)OCR1A + 1.0));
+    s_pulses += hz * (double)dt_us / 1e6;
+}
+
+double sim_tb6600_pulses(void) {
+    return s_pulses;
+}
+
+// --- servo ----------------------------------------------------------------
+
+static uint16_t s_servo_us[3];
+static uint32_t s_servo_fires[3];
+
+void servo_init(void) {
+    for (uint8_t i = 0; i < 3; i++) {
+        s_servo_us[i] = SERVO_CENTER_US;
+    }
+}
+
+void servo_set_pulse_us(uint8_t idx, uint16_t us) {
+    if (idx >= 3) {
+        return;
+    }
+    if (us < SERVO_MIN_US) { us = SERVO_MIN_US; }
+    if (us > SERVO_MAX_US) { us = SERVO_MAX_US; }
+    if (s_servo_us[idx] == SERVO_CENTER_US && us != SERVO_CENTER_US) {
+        s_servo_fires[idx]++;
+    }
+    s_servo_us[idx] = us;
+}
+
+uint16_t sim_servo_pulse_us(uint8_t ch) {
+    return s_servo_us[ch];
+}
+
+uint32_t sim_servo_fire_count(uint8_t ch) {
+    return s_servo_fires[ch];
+}
+
+// --- interrupts -----------------------------------------------------------
+
+static bool s_vl6180_flag = false;
+static uint32_t s_vl6180_edge_us = 0;
+
+void sim_drivers_reset(void) {
+    TIMSK0 = 0;
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TIMSK1 = 0;
+    TCNT1 = 0;
+    OCR1A = 0;
+    s_pulses = 0.0;
+    for (uint8_t i = 0; i < 3; i++) {
+        s_servo_us[i] = SERVO_CENTER_US;
+        s_servo_fires[i] = 0;
+    }
+    s_vl6180_flag = false;
+    s_vl6180_edge_us = 0;
+}
+
+void sim_int0_edge(void) {
+    s_vl6180_edge_us = micros();
+    s_vl6180_flag = true;
+}
+
+void interrupts_init(void) { }
+
+bool vl6180_event(void) {
+    bool f = s_vl6180_flag;
+    s_vl6180_flag = false;
+    return f;
+}
+
+uint32_t vl6180_event_time_us(void) {
+    return s_vl6180_edge_us;
+}
+
+uint8_t vl6180_int_pin_level(void) {
+    return sim_vl6180_gpio1_high() ? 1 : 0;
+}
@@ -0,0 +1,424 @@
+/*
+ * Simulated HAL
+ * -------------
+ * Host replacements for hal/timers.c, hal/uart.c, hal/twi.c and hal/gpio.c,
+ * implementing the same headers:
+ * - millis()/micros() read the simulated clock. The AVR registers declared by
+ *   sim/include/avr/io.h are defined here.
+ * - UART output is split into lines for the world model; binary log frames
+ *   (LOG_FORMAT_BINARY) are passed on whole instead.
+ *   The TX ring is modelled by occupancy only: it drains at UART_BAUD/10
+ *   bytes per second and overflowing writes are counted as dropped, like the
+ *   firmware ring. The world still sees every line that was written, so its
+ *   statistics do not depend on TX headroom; -v echoes only the bytes the
+ *   ring accepted, i.e. what the target would send. A uart_line_begin()/
+ *   uart_line_end() line is held back from the echo until it is committed,
+ *   and taken back out of the ring whole if any part of it was dropped.
+ *   Before sei() output is polled like the firmware's: it costs simulated
+ *   time instead of ring space.
+ * - TWI transactions queue in FIFO order and complete after their bus time
+ *   (9 bit times per byte at the device's clock, taken from the firmware's own
+ *   hal/twi_speed.c); each completes against the register models in
+ *   devices.c. Blocking calls advance simulated time until their transaction
+ *   is done, so boot-time and fallback I2C costs show up.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "platform/config.h"
+#include "platform/pins.h"
+#include "hal/timers.h"
+#include "hal/uart.h"
+#include "hal/twi.h"
+#include "hal/twi_speed.h"
+#include "hal/gpio.h"
+#include "utils/log.h"
+
+volatile uint8_t SREG = 0;
+volatile uint8_t TCNT0 = 0, OCR0A = 0, OCR0B = 0, TIMSK0 = 0;
+volatile uint8_t TCCR1A = 0, TCCR1B = 0, TIMSK1 = 0;
+volatile uint16_t TCNT1 = 0, OCR1A = 0;
+volatile uint8_t PINB = 0;
+
+// --- timers ---------------------------------------------------------------
+
+void timers_init(void) {
+    // 1 kHz TOP, read by tb6600_init() to place the COMPB ramp tick
+    OCR0A = (uint8_t)((F_CPU / 64UL) / 1000UL - 1UL);
+}
+
+uint32_t millis(void) {
+    return (uint32_t)(sim_now_us() / 1000U);
+}
+
+uint32_t micros(void) {
+    return (uint32_t)sim_now_us();
+}
+
+// --- uart -----------------------------------------------------------------
+
+static char s_line[256];
+static uint16_t s_line_len = 0;
+static uint8_t s_frame[2U + 255U + 1U]; // sync, len, payload, crc
+static uint16_t s_frame_len = 0;        // 0 = not inside a frame
+static double s_tx_level = 0.0; // bytes waiting in the modelled ring
+static uint64_t s_tx_level_us = 0;
+static uint32_t s_tx_queued = 0;
+static uint32_t s_tx_dropped = 0;
+static bool s_in_line = false;
+static bool s_line_failed = false;
+static uint8_t s_line_echo[UART_TX_BUFFER_SIZE]; // accepted bytes of the open line
+static uint16_t s_line_echo_len = 0;
+static bool s_irq_enabled = false;
+static uint8_t s_rx_buf[UART_RX_BUFFER_SIZE];
+static uint16_t s_rx_head = 0;
+static uint16_t s_rx_count = 0;
+static uint32_t s_rx_dropped = 0;
+bool g_sim_uart_echo = false;
+
+void sim_sei(void) {
+    s_irq_enabled = true;
+}
+
+// Polled transmission before sei(): the caller waits out the wire time.
+static void tx_polled(uint32_t bytes) {
+    s_tx_queued += bytes;
+    sim_advance_us((uint32_t)((uint64_t)bytes * 10U * 1000000U / UART_BAUD));
+    s_tx_level_us = sim_now_us();
+}
+
+static uint16_t tx_free(void) {
+    uint64_t now = sim_now_us();
+    s_tx_level -= (double)(now - s_tx_level_us) * (UART_BAUD / 10.0) / 1e6;
+    if (s_tx_level < 0.0) { s_tx_level = 0.0; }
+    s_tx_level_us = now;
+    double free_bytes = (double)(UART_TX_BUFFER_SIZE - 1) - s_tx_level;
+    return (free_bytes > 0.0) ? (uint16_t)free_bytes : 0U;
+}
+
+// Output the ring accepted (or polled out before sei())
+static void echo_bytes(const void* p, size_t n) {
+    if (g_sim_uart_echo) {
+        fwrite(p, 1, n, stdout);
+    }
+}
+
+// The ring took n bytes; an open line's bytes are echoed when it commits
+static void tx_accept(const void* p, uint16_t n) {
+    s_tx_level += (double)n;
+    s_tx_queued += n;
+    if (!s_in_line) {
+        echo_bytes(p, n);
+        return;
+    }
+    memcpy(&s_line_echo[s_line_echo_len], p, n);
+    s_line_echo_len = (uint16_t)(s_line_echo_len + n);
+}
+
+// n bytes did not fit; the rest of an open line is dropped with them
+static void tx_drop(uint32_t n) {
+    s_tx_dropped += n;
+    if (s_in_line) {
+        s_line_failed = true;
+    }
+}
+
+static bool line_failed(void) {
+    return s_in_line && s_line_failed;
+}
+
+// Every byte written, accepted or not, for the world model
+static void line_byte(uint8_t b) {
+    if (s_frame_len || b == LOG_FRAME_SYNC) {
+        s_frame[s_frame_len++] = b;
+        if (s_frame_len > 2U && s_frame_len == 3U + s_frame[1]) {
+            sim_world_uart_frame(s_frame, s_frame_len);
+            s_frame_len = 0;
+        }
+        return;
+    }
+    if (b == '\r') {
+        return;
+    }
+    if (b == '\n') {
+        s_line[s_line_len] = '\0';
+        sim_world_uart_line(s_line);
+        s_line_len = 0;
+        return;
+    }
+    if (s_line_len < sizeof(s_line) - 1U) {
+        s_line[s_line_len++] = (char)b;
+    }
+}
+
+void uart_init(uint32_t baud) {
+    (void)baud;
+    s_line_len = 0;
+    s_frame_len = 0;
+    s_tx_level = 0.0;
+    s_tx_level_us = sim_now_us();
+    s_tx_queued = 0;
+    s_tx_dropped = 0;
+    s_in_line = false;
+    s_rx_head = 0;
+    s_rx_count = 0;
+    s_rx_dropped = 0;
+}
+
+bool uart_write_byte(uint8_t b) {
+    line_byte(b);
+    if (!s_irq_enabled) {
+        echo_bytes(&b, 1);
+        tx_polled(1);
+        return true;
+    }
+    if (line_failed() || tx_free() == 0) {
+        tx_drop(1);
+        return false;
+    }
+    tx_accept(&b, 1);
+    return true;
+}
+
+int uart_write(const char* s) {
+    size_t len = strlen(s);
+    for (size_t i = 0; i < len; i++) {
+        line_byte((uint8_t)s[i]);
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (!s_irq_enabled) {
+        echo_bytes(s, len);
+        tx_polled((uint32_t)len);
+        return (int)len;
+    }
+    if (line_failed() || len > tx_free()) {
+        tx_drop((uint32_t)len);
+        return 0;
+    }
+    tx_accept(s, (uint16_t)len);
+    return (int)len;
+}
+
+int uart_write_P(const char* s) {
+    return uart_write(s); // one address space on the host
+}
+
+uint8_t uart_write_bytes(const uint8_t* p, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+        line_byte(p[i]);
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (!s_irq_enabled) {
+        echo_bytes(p, n);
+        tx_polled(n);
+        return n;
+    }
+    if (line_failed() || n > tx_free()) {
+        tx_drop(n);
+        return 0;
+    }
+    tx_accept(p, n);
+    return n;
+}
+
+void uart_line_begin(void) {
+    s_in_line = true;
+    s_line_failed = false;
+    s_line_echo_len = 0;
+}
+
+bool uart_line_end(void) {
+    if (!s_in_line) {
+        return true;
+    }
+    s_in_line = false;
+    if (s_line_failed) {
+        s_tx_level -= (double)s_line_echo_len;
+        if (s_tx_level < 0.0) { s_tx_level = 0.0; }
+        s_tx_queued -= s_line_echo_len;
+        s_tx_dropped += s_line_echo_len;
+        return false;
+    }
+    echo_bytes(s_line_echo, s_line_echo_len);
+    return true;
+}
+
+uint8_t uart_tx_free(void) {
+    return s_irq_enabled ? (uint8_t)tx_free() : (uint8_t)(UART_TX_BUFFER_SIZE - 1);
+}
+
+uint32_t uart_tx_queued(void) {
+    return s_tx_queued;
+}
+
+uint32_t uart_tx_dropped(void) {
+    return s_tx_dropped;
+}
+
+void sim_uart_rx(const char* s) {
+    for (; *s; s++) {
+        if (s_rx_count == UART_RX_BUFFER_SIZE) {
+            s_rx_dropped++;
+            continue;
+        }
+        s_rx_buf[(s_rx_head + s_rx_count) % UART_RX_BUFFER_SIZE] = (uint8_t)*s;
+        s_rx_count++;
+    }
+}
+
+bool uart_read_byte(uint8_t* b) {
+    if (s_rx_count == 0) {
+        return false;
+    }
+    *b = s_rx_buf[s_rx_head];
+    s_rx_head = (uint16_t)((s_rx_head + 1U) % UART_RX_BUFFER_SIZE);
+    s_rx_count--;
+    return true;
+}
+
+uint32_t uart_rx_dropped(void) {
+    return s_rx_dropped;
+}
+
+// --- twi ------------------------------------------------------------------
+
+static TwiXfer* s_queue[TWI_QUEUE_LEN];
+static uint8_t s_q_head = 0;
+static uint8_t s_q_count = 0;
+static uint64_t s_done_us = UINT64_MAX; // completion time of s_queue[s_q_head]
+
+static uint32_t bus_us(const TwiXfer* x) {
+    // SLA+data bytes, a second SLA for the read phase, 9 bit times each
+    uint32_t bytes = 1U + x->tx_len + (x->rx_len ? 1U + x->rx_len : 0U);
+    uint32_t hz = twi_get_device_speed_hz(x->addr);
+    return (uint32_t)((bytes * 9ULL * 1000000ULL + hz - 1U) / hz);
+}
+
+static void start_head(void) {
+    if (s_q_count == 0) {
+        s_done_us = UINT64_MAX;
+        return;
+    }
+    TwiXfer* x = s_queue[s_q_head];
+    x->state = TWI_XFER_BUSY;
+    s_done_us = sim_now_us() + bus_us(x);
+}
+
+static void twi_reset(void) {
+    s_q_head = 0;
+    s_q_count = 0;
+    s_done_us = UINT64_MAX;
+    twi_speed_reset();
+}
+
+void sim_hal_reset(void) {
+    twi_reset();
+    s_line_len = 0;
+    s_irq_enabled = false;
+}
+
+uint64_t sim_twi_next_done_us(void) {
+    return s_done_us;
+}
+
+void sim_twi_complete(void) {
+    if (s_q_count == 0) {
+        return;
+    }
+    TwiXfer* x = s_queue[s_q_head];
+    s_q_head = (uint8_t)((s_q_head + 1U) % TWI_QUEUE_LEN);
+    s_q_count--;
+    bool ok = sim_dev_xfer(x->addr, x->tx, x->tx_len, x->rx, x->rx_len);
+    x->state = ok ? TWI_XFER_DONE : TWI_XFER_ERROR;
+    start_head();
+    if (x->done) { x->done(x); }
+}
+
+void twi_init(void) {
+    twi_reset();
+}
+
+bool twi_probe(uint8_t addr7) {
+    return twi_write_read(addr7, 0, 0, 0, 0);
+}
+
+bool twi_submit(TwiXfer* x) {
+    if (!x || x->state == TWI_XFER_QUEUED || x->state == TWI_XFER_BUSY) {
+        return false;
+    }
+    if (s_q_count >= TWI_QUEUE_LEN) {
+        return false;
+    }
+    x->state = TWI_XFER_QUEUED;
+    s_queue[(uint8_t)((s_q_head + s_q_count) % TWI_QUEUE_LEN)] = x;
+    s_q_count++;
+    if (s_q_count == 1) {
+        start_head();
+    }
+    return true;
+}
+
+bool twi_busy(void) {
+    return s_q_count != 0;
+}
+
+void twi_abort(void) {
+    while (s_q_count) {
+        TwiXfer* x = s_queue[s_q_head];
+        s_q_head = (uint8_t)((s_q_head + 1U) % TWI_QUEUE_LEN);
+        s_q_count--;
+        x->state = TWI_XFER_ERROR;
+        if (x->done) { x->done(x); }
+    }
+    s_done_us = UINT64_MAX;
+}
+
+bool twi_transfer(TwiXfer* x) {
+    while (s_q_count >= TWI_QUEUE_LEN) { // wait for a free slot
+        sim_advance_us((uint32_t)(s_done_us - sim_now_us()));
+    }
+    if (!twi_submit(x)) {
+        return false;
+    }
+    while (x->state == TWI_XFER_QUEUED || x->state == TWI_XFER_BUSY) {
+        sim_advance_us((uint32_t)(s_done_us - sim_now_us()));
+    }
+    return x->state == TWI_XFER_DONE;
+}
+
+bool twi_write_read(uint8_t addr7, const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len) {
+    TwiXfer x = { addr7, tx, tx_len, rx, rx_len, 0, TWI_XFER_IDLE };
+    return twi_transfer(&x);
+}
+
+// Polled byte-level helpers are bring-up only; no firmware module uses them.
+uint8_t twi_start(uint8_t addr) { (void)addr; return 0; }
+void twi_stop(void) { }
+uint8_t twi_write(uint8_t data) { (void)data; return 0; }
+uint8_t twi_read_ack(void) { return 0; }
+uint8_t twi_read_nack(void) { return 0; }
+
+// --- gpio -----------------------------------------------------------------
+
+static uint8_t s_pin_level[PIN_A5 + 1];
+
+void gpio_pin_mode(GpioPin pin, GpioMode mode) {
+    if (mode == GPIO_INPUT_PULLUP) {
+        s_pin_level[pin] = GPIO_HIGH;
+    }
+}
+
+void gpio_write(GpioPin pin, GpioLevel level) {
+    s_pin_level[pin] = (uint8_t)level;
+}
+
+GpioLevel gpio_read(GpioPin pin) {
+    if (pin == GPIO_PIN_VL6180_INT) {
+        return sim_vl6180_gpio1_high() ? GPIO_HIGH : GPIO_LOW;
+    }
+    return (GpioLevel)s_pin_level[pin];
+}
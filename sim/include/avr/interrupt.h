@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for <avr/interrupt.h> (simulator build only). Interrupts
+ * are modelled by the world stepper calling the fake ISR hooks directly.
+ */
+#pragma once
+
+void sim_sei(void);
+
+#define sei() sim_sei()
+#define cli() ((void)0)
+#define ISR(vector) void vector(void)
@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for <avr/io.h> (simulator build only): the registers that
+ * drivers/tb6600.c and the SREG save/restore idiom touch, as plain variables
+ * defined in hal_sim.c. drivers_sim.c plays the timers behind them. The other
+ * register-level modules (hal/, servo, interrupts) are replaced by the fakes
+ * in sim/.
+ */
+#pragma once
+#include <stdint.h>
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCNT0, OCR0A, OCR0B, TIMSK0;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t PINB;
+
+#define SREG_I 7
+#define OCIE0B 2
+#define OCIE1A 1
+#define COM1A0 6
+#define WGM12 3
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define PB1 1
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for <util/delay.h> (simulator build only). Busy-wait delays
+ * advance simulated time instead of spinning.
+ */
+#pragma once
+#include <stdint.h>
+
+void sim_advance_us(uint32_t us);
+
+static inline void _delay_ms(double ms) { sim_advance_us((uint32_t)(ms * 1000.0)); }
+static inline void _delay_us(double us) { sim_advance_us((uint32_t)us); }
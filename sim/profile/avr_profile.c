@@ -0,0 +1,514 @@
+/*
+ * Cycle-accurate firmware profiler (simavr)
+ * -----------------------------------------
+ * Runs build/firmware.elf on simavr's ATmega328P core and attributes every
+ * executed cycle to the function containing the PC:
+ * - Sensors: the VL6180/APDS9960 register models from sim/devices.c answer
+ *   on simavr's TWI bus; VL6180 GPIO1 drives the INT0 pin (PD2). Blocks
+ *   cover the sensor on a fixed schedule (--blocks/--rate/--dwell) or as
+ *   listed in a --script file ("<enter_ms> <dwell_ms> <R|G|B|O>" per line).
+ * - Self cycles: per function, from an address map built from the symbol
+ *   list (avr-nm -S -n output, see scripts/profile.sh).
+ * - Per call: sense_poll, decide_tick, actuate_tick, app_loop and every
+ *   log_* function are timed from call to return (by stack pointer), with
+ *   interrupt time removed; tail-called entries are not seen.
+ * - ISRs: __vector_N entries are counted and timed; occupancy is their share
+ *   of all cycles.
+ * - Main loop: period between consecutive sense_poll() calls.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "avr_ioport.h"
+#include "avr_twi.h"
+#include "avr_uart.h"
+#include "sim.h"
+
+#define PROF_F_CPU        16000000UL
+#define PROF_FLASH_WORDS  (32768U / 2U)
+#define PROF_MAX_SYMS     1024U
+#define PROF_MAX_FRAMES   32U
+#define PROF_VECTOR_BYTES (26U * 4U) // ATmega328P vector table
+#define PROF_MAX_BLOCKS   4096U
+
+typedef struct {
+    char name[48];
+    uint32_t addr;       // byte address
+    uint32_t size;
+    uint64_t self;       // cycles spent with PC inside
+    uint32_t calls;      // timed entries (tracked functions and ISRs)
+    uint64_t incl_total;
+    uint64_t incl_max;
+    int8_t vector;       // >= 0 for __vector_N
+    bool tracked;
+} ProfSym;
+
+typedef struct {
+    int16_t sym;
+    uint16_t sp;         // SP right after entry (return address pushed)
+    uint64_t start;
+    uint64_t isr_start;  // g_isr_cycles at entry
+} ProfFrame;
+
+typedef struct {
+    uint32_t enter_ms;
+    uint32_t dwell_ms;
+    Color color;
+} ProfBlock;
+
+static avr_t* g_avr;
+static ProfSym g_syms[PROF_MAX_SYMS];
+static uint16_t g_nsyms = 0;
+static int16_t g_pc_sym[PROF_FLASH_WORDS];
+static ProfFrame g_frames[PROF_MAX_FRAMES];
+static uint8_t g_nframes = 0;
+static uint8_t g_isr_depth = 0;
+static uint64_t g_isr_cycles = 0;
+
+static int16_t g_loop_sym = -1;
+static uint64_t g_loop_last = 0;
+static uint64_t g_loop_max = 0;
+static uint64_t g_loop_total = 0;
+static uint32_t g_loop_count = 0;
+
+static ProfBlock g_blocks[PROF_MAX_BLOCKS];
+static uint32_t g_nblocks = 0;
+static avr_irq_t* g_int0_pin;
+static bool g_int0_low = false;
+static bool g_echo_uart = false;
+
+static const char* k_vector_names[26] = {
+    "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+    "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT",
+    "TIMER1_COMPA", "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA",
+    "TIMER0_COMPB", "TIMER0_OVF", "SPI_STC", "USART_RX", "USART_UDRE",
+    "USART_TX", "ADC", "EE_READY", "ANALOG_COMP", "TWI", "SPM_READY",
+};
+
+// --- world callbacks for sim/devices.c -------------------------------------
+
+uint64_t sim_now_us(void) {
+    return g_avr->cycle / (PROF_F_CPU / 1000000UL);
+}
+
+static const ProfBlock* block_now(void) {
+    uint32_t now_ms = (uint32_t)(sim_now_us() / 1000U);
+    for (uint32_t i = 0; i < g_nblocks; i++) {
+        if (now_ms < g_blocks[i].enter_ms) {
+            break;
+        }
+        if (now_ms < g_blocks[i].enter_ms + g_blocks[i].dwell_ms) {
+            return &g_blocks[i];
+        }
+    }
+    return 0;
+}
+
+uint8_t sim_world_range_mm(void) {
+    return block_now() ? 30U : 150U;
+}
+
+void sim_world_rgbc(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c) {
+    static const uint16_t rgb[5][3] = {
+        { 600, 200, 180 }, { 200, 500, 250 }, { 180, 250, 520 }, { 350, 330, 310 }, { 90, 90, 90 },
+    };
+    const ProfBlock* blk = block_now();
+    const uint16_t* p = rgb[blk ? (int)blk->color : 4];
+    *r = p[0];
+    *g = p[1];
+    *b = p[2];
+    *c = (uint16_t)(p[0] + p[1] + p[2]);
+}
+
+void sim_world_note_detect(void) { }
+
+void sim_int0_edge(void) {
+    g_int0_low = true;
+    avr_raise_irq(g_int0_pin, 0);
+}
+
+// GPIO1 is released by an interrupt-clear write over TWI
+static void sync_int0_pin(void) {
+    if (g_int0_low && sim_vl6180_gpio1_high()) {
+        g_int0_low = false;
+        avr_raise_irq(g_int0_pin, 1);
+    }
+}
+
+// --- TWI stand-in: byte-level simavr messages -> sim_dev_xfer() ------------
+
+typedef struct {
+    avr_irq_t* irq;
+    uint8_t addr7;       // selected device, 0 if none
+    bool reading;
+    bool executed;       // transaction already applied to the model
+    uint8_t tx[16];
+    uint8_t tx_len;
+    uint8_t rx[16];
+    uint8_t rx_pos;
+} TwiStandIn;
+
+static TwiStandIn g_twi;
+
+static bool is_ours(uint8_t addr7) {
+    return addr7 == 0x29 || addr7 == 0x39; // VL6180, APDS9960
+}
+
+static void twi_apply_write(void) {
+    if (g_twi.addr7 && !g_twi.executed) {
+        sim_dev_xfer(g_twi.addr7, g_twi.tx, g_twi.tx_len, 0, 0);
+        g_twi.executed = true;
+        sync_int0_pin();
+    }
+}
+
+static void twi_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    (void)irq;
+    (void)param;
+    avr_twi_msg_irq_t v;
+    v.u.v = value;
+    if (v.u.twi.msg & TWI_COND_STOP) {
+        if (!g_twi.reading) {
+            twi_apply_write();
+        }
+        g_twi.addr7 = 0;
+    }
+    if (v.u.twi.msg & TWI_COND_START) {
+        uint8_t addr7 = (uint8_t)(v.u.twi.addr >> 1);
+        bool read = (v.u.twi.addr & 1U) != 0;
+        if (!read || addr7 != g_twi.addr7) {
+            // New transaction (a repeated START for reading keeps the index)
+            g_twi.tx_len = 0;
+            g_twi.executed = false;
+        }
+        g_twi.addr7 = is_ours(addr7) ? addr7 : 0;
+        g_twi.reading = read;
+        g_twi.rx_pos = 0;
+        if (g_twi.addr7) {
+            avr_raise_irq(g_twi.irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, v.u.twi.addr, 1));
+        }
+    }
+    if (!g_twi.addr7) {
+        return;
+    }
+    if (v.u.twi.msg & TWI_COND_WRITE) {
+        if (g_twi.tx_len < sizeof(g_twi.tx)) {
+            g_twi.tx[g_twi.tx_len++] = v.u.twi.data;
+        }
+        avr_raise_irq(g_twi.irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_ACK, v.u.twi.addr, 1));
+    }
+    if (v.u.twi.msg & TWI_COND_READ) {
+        if (g_twi.rx_pos == 0) {
+            sim_dev_xfer(g_twi.addr7, g_twi.tx, g_twi.tx_len, g_twi.rx, sizeof(g_twi.rx));
+            g_twi.executed = true;
+        }
+        uint8_t data = g_twi.rx[g_twi.rx_pos % sizeof(g_twi.rx)];
+        g_twi.rx_pos++;
+        avr_raise_irq(g_twi.irq + TWI_IRQ_INPUT, avr_twi_irq_msg(TWI_COND_READ, v.u.twi.addr, data));
+    }
+}
+
+static void twi_attach(avr_t* avr) {
+    static const char* names[2] = { "twi.in", "twi.out" };
+    memset(&g_twi, 0, sizeof(g_twi));
+    g_twi.irq = avr_alloc_irq(&avr->irq_pool, 0, 2, names);
+    avr_irq_register_notify(g_twi.irq + TWI_IRQ_OUTPUT, twi_hook, 0);
+    avr_connect_irq(g_twi.irq + TWI_IRQ_INPUT, avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT));
+    avr_connect_irq(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT), g_twi.irq + TWI_IRQ_OUTPUT);
+}
+
+static void uart_hook(struct avr_irq_t* irq, uint32_t value, void* param) {
+    (void)irq;
+    (void)param;
+    if (g_echo_uart) {
+        fputc((int)(value & 0xFF), stderr);
+    }
+}
+
+// --- symbols and cycle accounting ------------------------------------------
+
+static bool is_tracked(const char* name) {
+    return strcmp(name, "sense_poll") == 0 || strcmp(name, "decide_tick") == 0 ||
+           strcmp(name, "actuate_tick") == 0 || strcmp(name, "app_loop") == 0 ||
+           strncmp(name, "log_", 4) == 0;
+}
+
+// avr-nm -S -n lines: "<addr> <size> <type> <name>" (text symbols only)
+static void load_symbols(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    for (uint32_t i = 0; i < PROF_FLASH_WORDS; i++) {
+        g_pc_sym[i] = -1;
+    }
+    while (fgets(line, sizeof(line), f) && g_nsyms < PROF_MAX_SYMS) {
+        unsigned addr = 0, size = 0;
+        char type = 0;
+        char name[128];
+        if (sscanf(line, "%x %x %c %127s", &addr, &size, &type, name) != 4) {
+            continue;
+        }
+        if ((type != 'T' && type != 't' && type != 'W') || size == 0 || addr >= 32768U) {
+            continue;
+        }
+        ProfSym* s = &g_syms[g_nsyms];
+        memset(s, 0, sizeof(*s));
+        size_t n = strlen(name);
+        if (n >= sizeof(s->name)) { n = sizeof(s->name) - 1U; } // long names are truncated
+        memcpy(s->name, name, n);
+        s->name[n] = '\0';
+        s->addr = addr;
+        s->size = size;
+        s->vector = -1;
+        int vec = -1;
+        if (sscanf(name, "__vector_%d", &vec) == 1 && vec >= 0 && vec < 26) {
+            s->vector = (int8_t)vec;
+            snprintf(s->name, sizeof(s->name), "ISR %s", k_vector_names[vec]);
+        }
+        s->tracked = is_tracked(name);
+        if (strcmp(name, "sense_poll") == 0) {
+            g_loop_sym = (int16_t)g_nsyms;
+        }
+        for (uint32_t a = addr; a < addr + size && a < 32768U; a += 2U) {
+            g_pc_sym[a / 2U] = (int16_t)g_nsyms;
+        }
+        g_nsyms++;
+    }
+    fclose(f);
+}
+
+static uint16_t read_sp(void) {
+    return (uint16_t)(g_avr->data[R_SPL] | ((uint16_t)g_avr->data[R_SPH] << 8));
+}
+
+static void frame_pop(uint64_t now) {
+    ProfFrame* fr = &g_frames[--g_nframes];
+    ProfSym* s = &g_syms[fr->sym];
+    uint64_t incl = now - fr->start;
+    if (s->vector >= 0) {
+        g_isr_depth--;
+    } else {
+        incl -= g_isr_cycles - fr->isr_start; // interrupts that hit the call
+    }
+    s->calls++;
+    s->incl_total += incl;
+    if (incl > s->incl_max) {
+        s->incl_max = incl;
+    }
+}
+
+// Account the instruction just executed (prev_pc, prev_sp -> current state).
+static void profile_step(uint32_t prev_pc, uint16_t prev_sp, uint64_t prev_cycle) {
+    uint64_t now = g_avr->cycle;
+    uint64_t dt = now - prev_cycle;
+    int16_t prev_sym = g_pc_sym[(prev_pc / 2U) % PROF_FLASH_WORDS];
+    if (prev_sym >= 0) {
+        g_syms[prev_sym].self += dt;
+    }
+    if (g_isr_depth) {
+        g_isr_cycles += dt;
+    }
+    uint16_t sp = read_sp();
+    while (g_nframes && sp > g_frames[g_nframes - 1U].sp) {
+        frame_pop(now);
+    }
+    uint32_t pc = g_avr->pc;
+    int16_t sym = g_pc_sym[(pc / 2U) % PROF_FLASH_WORDS];
+    if (sym < 0 || pc != g_syms[sym].addr) {
+        return;
+    }
+    ProfSym* s = &g_syms[sym];
+    bool via_call = (uint16_t)(prev_sp - sp) == 2U;
+    bool via_vector = s->vector >= 0 && prev_pc < PROF_VECTOR_BYTES;
+    if (sym == g_loop_sym && via_call) {
+        if (g_loop_last) {
+            uint64_t period = now - g_loop_last;
+            g_loop_total += period;
+            g_loop_count++;
+            if (period > g_loop_max) { g_loop_max = period; }
+        }
+        g_loop_last = now;
+    }
+    if (!((s->tracked && via_call) || via_vector) || g_nframes >= PROF_MAX_FRAMES) {
+        return;
+    }
+    ProfFrame* fr = &g_frames[g_nframes++];
+    fr->sym = sym;
+    fr->sp = sp;
+    fr->start = now;
+    fr->isr_start = g_isr_cycles;
+    if (via_vector) {
+        g_isr_depth++;
+    }
+}
+
+// --- scenario --------------------------------------------------------------
+
+static void make_blocks(uint32_t n, uint32_t rate_bpm, uint32_t dwell_ms) {
+    static const Color colors[4] = { COLOR_RED, COLOR_GREEN, COLOR_BLUE, COLOR_OTHER };
+    uint32_t pitch_ms = rate_bpm ? 60000U / rate_bpm : 6000U;
+    for (uint32_t i = 0; i < n && i < PROF_MAX_BLOCKS; i++) {
+        g_blocks[i].enter_ms = 3000U + i * pitch_ms; // after servo mute and belt ramp
+        g_blocks[i].dwell_ms = dwell_ms;
+        g_blocks[i].color = colors[i % 4U];
+        g_nblocks = i + 1U;
+    }
+}
+
+static void load_script(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), f) && g_nblocks < PROF_MAX_BLOCKS) {
+        unsigned enter = 0, dwell = 0;
+        char c = 0;
+        if (line[0] == '#' || sscanf(line, "%u %u %c", &enter, &dwell, &c) != 3) {
+            continue;
+        }
+        ProfBlock* b = &g_blocks[g_nblocks++];
+        b->enter_ms = enter;
+        b->dwell_ms = dwell;
+        b->color = (c == 'R') ? COLOR_RED : (c == 'G') ? COLOR_GREEN : (c == 'B') ? COLOR_BLUE : COLOR_OTHER;
+    }
+    fclose(f);
+}
+
+// --- report ----------------------------------------------------------------
+
+static int by_self_desc(const void* a, const void* b) {
+    const ProfSym* x = (const ProfSym*)a;
+    const ProfSym* y = (const ProfSym*)b;
+    return (x->self < y->self) ? 1 : (x->self > y->self) ? -1 : 0;
+}
+
+static double cyc_to_us(uint64_t c) {
+    return (double)c * 1e6 / (double)PROF_F_CPU;
+}
+
+static void report(uint64_t total, uint32_t top) {
+    qsort(g_syms, g_nsyms, sizeof(ProfSym), by_self_desc);
+    printf("PROFILE cycles=%llu sim_ms=%.1f isr_occupancy=%.2f%%\n",
+           (unsigned long long)total, cyc_to_us(total) / 1000.0,
+           total ? 100.0 * (double)g_isr_cycles / (double)total : 0.0);
+    printf("LOOP iterations=%u avg_us=%.1f max_us=%.1f (sense_poll to sense_poll)\n",
+           g_loop_count, g_loop_count ? cyc_to_us(g_loop_total) / g_loop_count : 0.0,
+           cyc_to_us(g_loop_max));
+
+    printf("\n%-28s %12s %7s\n", "SELF", "cycles", "%");
+    for (uint32_t i = 0; i < g_nsyms && i < top; i++) {
+        if (!g_syms[i].self) {
+            break;
+        }
+        printf("%-28s %12llu %6.2f%%\n", g_syms[i].name, (unsigned long long)g_syms[i].self,
+               100.0 * (double)g_syms[i].self / (double)total);
+    }
+
+    printf("\n%-28s %8s %10s %10s\n", "PER CALL (ISRs excluded)", "calls", "avg_cyc", "max_cyc");
+    for (uint32_t i = 0; i < g_nsyms; i++) {
+        const ProfSym* s = &g_syms[i];
+        if (s->tracked && s->calls) {
+            printf("%-28s %8u %10llu %10llu\n", s->name, s->calls,
+                   (unsigned long long)(s->incl_total / s->calls), (unsigned long long)s->incl_max);
+        }
+    }
+
+    printf("\n%-28s %8s %10s %10s %8s\n", "ISR", "count", "avg_cyc", "max_cyc", "occup");
+    for (uint32_t i = 0; i < g_nsyms; i++) {
+        const ProfSym* s = &g_syms[i];
+        if (s->vector >= 0 && s->calls) {
+            printf("%-28s %8u %10llu %10llu %7.2f%%\n", s->name, s->calls,
+                   (unsigned long long)(s->incl_total / s->calls), (unsigned long long)s->incl_max,
+                   100.0 * (double)s->incl_total / (double)total);
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: avr_profile firmware.elf symbols.txt [options]\n"
+        "  --ms N          simulated run time (default 20000)\n"
+        "  --blocks N      scripted blocks (default 8)\n"
+        "  --rate BPM      block rate (default 20)\n"
+        "  --dwell MS      time each block covers the sensor (default 800)\n"
+        "  --script FILE   block schedule: <enter_ms> <dwell_ms> <R|G|B|O> per line\n"
+        "  --top N         functions in the self-cycle table (default 40)\n"
+        "  --uart          echo firmware UART output to stderr\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage();
+    }
+    uint32_t run_ms = 20000U, n_blocks = 8U, rate = 20U, dwell = 800U, top = 40U;
+    const char* script = 0;
+    for (int i = 3; i < argc; i++) {
+        const char* a = argv[i];
+        bool has_val = i + 1 < argc;
+        if (strcmp(a, "--ms") == 0 && has_val) { run_ms = (uint32_t)strtoul(argv[++i], 0, 10); }
+        else if (strcmp(a, "--blocks") == 0 && has_val) { n_blocks = (uint32_t)strtoul(argv[++i], 0, 10); }
+        else if (strcmp(a, "--rate") == 0 && has_val) { rate = (uint32_t)strtoul(argv[++i], 0, 10); }
+        else if (strcmp(a, "--dwell") == 0 && has_val) { dwell = (uint32_t)strtoul(argv[++i], 0, 10); }
+        else if (strcmp(a, "--script") == 0 && has_val) { script = argv[++i]; }
+        else if (strcmp(a, "--top") == 0 && has_val) { top = (uint32_t)strtoul(argv[++i], 0, 10); }
+        else if (strcmp(a, "--uart") == 0) { g_echo_uart = true; }
+        else { usage(); }
+    }
+    if (script) {
+        load_script(script);
+    } else {
+        make_blocks(n_blocks, rate, dwell);
+    }
+    load_symbols(argv[2]);
+
+    elf_firmware_t fw;
+    memset(&fw, 0, sizeof(fw));
+    if (elf_read_firmware(argv[1], &fw) != 0) {
+        fprintf(stderr, "avr_profile: cannot read %s\n", argv[1]);
+        return 1;
+    }
+    snprintf(fw.mmcu, sizeof(fw.mmcu), "%s", "atmega328p");
+    fw.frequency = PROF_F_CPU;
+    g_avr = avr_make_mcu_by_name(fw.mmcu);
+    if (!g_avr) {
+        fprintf(stderr, "avr_profile: simavr has no atmega328p core\n");
+        return 1;
+    }
+    avr_init(g_avr);
+    avr_load_firmware(g_avr, &fw);
+    g_avr->frequency = PROF_F_CPU;
+
+    sim_dev_reset();
+    twi_attach(g_avr);
+    g_int0_pin = avr_io_getirq(g_avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+    avr_raise_irq(g_int0_pin, 1); // GPIO1 idles high (open drain + pull-up)
+    avr_irq_register_notify(avr_io_getirq(g_avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+                            uart_hook, 0);
+
+    uint64_t end = (uint64_t)run_ms * (PROF_F_CPU / 1000UL);
+    while (g_avr->cycle < end) {
+        uint32_t pc = g_avr->pc;
+        uint16_t sp = read_sp();
+        uint64_t cyc = g_avr->cycle;
+        int state = avr_run(g_avr);
+        if (state == cpu_Done || state == cpu_Crashed) {
+            fprintf(stderr, "avr_profile: CPU stopped (state %d) at pc=0x%04x\n", state, (unsigned)g_avr->pc);
+            break;
+        }
+        profile_step(pc, sp, cyc);
+        if (sim_now_us() >= sim_vl6180_next_meas_us()) {
+            sim_vl6180_measure();
+        }
+    }
+    report(g_avr->cycle, top);
+    return 0;
+}
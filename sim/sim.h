@@ -0,0 +1,131 @@
+/*
+ * Host conveyor simulator: shared interfaces between the world model and
+ * the fake HAL/driver back ends. The firmware modules never include this;
+ * they see only the regular hal/ and drivers/ headers.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "drivers/apds9960.h"
+
+#define SIM_MAX_CMDS 8
+
+/** Scenario parameters (see sim_main.c for the command-line switches). */
+typedef struct {
+    uint32_t blocks;          /**< Number of blocks to feed. */
+    uint16_t belt_mm_per_s;   /**< Belt speed requested from tb6600_set_speed(). */
+    uint16_t rate_bpm;        /**< Feed rate in blocks/min (0: use gap_mm). */
+    uint16_t gap_mm;          /**< Edge-to-edge gap when rate_bpm is 0. */
+    uint16_t len_min_mm;      /**< Block length range (uniform). */
+    uint16_t len_max_mm;
+    uint8_t jitter_pct;       /**< Random +/- spread of the block pitch. */
+    uint8_t tof_block_mm;     /**< ToF range while a block covers the sensor. */
+    uint8_t tof_empty_mm;     /**< ToF range to the far side of the belt. */
+    uint8_t tof_noise_mm;     /**< Uniform +/- range noise per measurement. */
+    uint8_t color_noise_pct;  /**< Uniform +/- noise on each RGBC channel. */
+    uint16_t loop_us;         /**< Simulated duration of one app_loop() pass. */
+    uint32_t seed;
+    bool verbose;             /**< Echo firmware UART output to stdout. */
+    uint8_t n_cmds;           /**< Serial commands to type, in time order. */
+    uint32_t cmd_at_ms[SIM_MAX_CMDS];
+    const char* cmd[SIM_MAX_CMDS];
+} SimConfig;
+
+/** End-of-run metrics. */
+typedef struct {
+    uint32_t blocks;
+    uint32_t correct;         /**< Ended in the bin decide_route() picks for its true color/length. */
+    uint32_t missorted;       /**< Ended anywhere else. */
+    uint32_t merged;          /**< Never started a sense session of its own. */
+    uint32_t sessions;        /**< Sense sessions started (LOW-threshold interrupts). */
+    uint32_t fires;           /**< Diverter actuations. */
+    uint32_t spurious_fires;  /**< Actuations that diverted nothing. */
+    uint32_t reject_queue_full;
+    uint32_t reject_throughput;
+    uint32_t reject_other;
+    uint32_t missed;          /**< Actuations the firmware dropped as too late (MISSED). */
+    uint32_t faults;          /**< Ambiguous results counted by the firmware. */
+    uint32_t uart_dropped;
+    double sim_s;             /**< Simulated time from first block to last outcome. */
+} SimResult;
+
+// --- world.c -------------------------------------------------------------
+
+/** Current simulated time (us since reset). */
+uint64_t sim_now_us(void);
+
+/** Advance the world (belt, sensors, bus) by us microseconds. */
+void sim_advance_us(uint32_t us);
+
+/** ToF range seen at the sensor right now (noise included). */
+uint8_t sim_world_range_mm(void);
+
+/** RGBC the color sensor sees right now (block under the sensor or the belt). */
+void sim_world_rgbc(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c);
+
+/** The ToF raised its LOW-threshold interrupt: credit the covering block. */
+void sim_world_note_detect(void);
+
+/** A full line of firmware UART output (without CR/LF). */
+void sim_world_uart_line(const char* line);
+
+/** A whole binary log frame (LOG_FORMAT_BINARY), sync byte through CRC. */
+void sim_world_uart_frame(const uint8_t* frame, uint16_t len);
+
+/** Run one scenario through app_setup()/app_loop(). */
+void sim_run(const SimConfig* cfg, SimResult* out);
+
+// --- devices.c: register-level sensor models behind the fake TWI ---------
+
+void sim_dev_reset(void);
+
+/** Execute one write-then-read transaction. @return false on address NACK. */
+bool sim_dev_xfer(uint8_t addr, const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len);
+
+/** Time of the next VL6180 measurement, or UINT64_MAX while not ranging. */
+uint64_t sim_vl6180_next_meas_us(void);
+
+/** Take the measurement due now; may latch the interrupt and pull GPIO1 low. */
+void sim_vl6180_measure(void);
+
+/** GPIO1 level (open drain, active low). */
+bool sim_vl6180_gpio1_high(void);
+
+// --- hal_sim.c -----------------------------------------------------------
+
+/** Echo firmware UART output to stdout. */
+extern bool g_sim_uart_echo;
+
+void sim_hal_reset(void);
+
+/** Deliver bytes to the firmware's UART RX buffer, as if typed at once. */
+void sim_uart_rx(const char* s);
+
+/** Completion time of the transaction on the bus, or UINT64_MAX when idle. */
+uint64_t sim_twi_next_done_us(void);
+
+/** Complete the transaction whose bus time has elapsed. */
+void sim_twi_complete(void);
+
+// --- drivers_sim.c -------------------------------------------------------
+
+void sim_drivers_reset(void);
+
+/** Next 1 kHz ramp tick while the belt accelerates, or UINT64_MAX. */
+uint64_t sim_tb6600_next_tick_us(void);
+void sim_tb6600_tick(void);
+
+/** Integrate STEP pulses over dt at the rate Timer1 is toggling OC1A. */
+void sim_tb6600_advance(uint32_t dt_us);
+
+/** Belt travel since reset in STEP pulses (fractional). */
+double sim_tb6600_pulses(void);
+
+/** Pulse width currently commanded on a servo channel (us). */
+uint16_t sim_servo_pulse_us(uint8_t ch);
+
+/** Number of times a channel has left center since reset. */
+uint32_t sim_servo_fire_count(uint8_t ch);
+
+/** INT0 falling edge from VL6180 GPIO1; runs the fake INT0 ISR. */
+void sim_int0_edge(void);
@@ -0,0 +1,174 @@
+/*
+ * Host conveyor simulator: command line
+ * -------------------------------------
+ * Runs one scenario through the real sense/decide/actuate code and the main
+ * loop (app_setup()/app_loop()) on simulated hardware, then prints sort
+ * accuracy and throughput. Build with scripts/build_sim.sh.
+ *
+ *   conveyor_sim [--blocks N] [--rate BPM | --gap MM] [--len MIN:MAX]
+ *                [--speed MM_S] [--jitter PCT] [--tof-noise MM]
+ *                [--color-noise PCT] [--loop-us US] [--seed N] [-v]
+ *                [--cmd MS:LINE]... [--csv | --csv-header]
+ *
+ * --csv prints one row (scenario, compiled-in limits, rates per block) for
+ * scripts/bench_throughput.sh; --csv-header prints the matching header.
+ * --cmd types LINE into the firmware's UART at MS (millis()); repeat it, in
+ * time order, for a tuning session, e.g. --cmd "5000:set bpm 30" -v.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "platform/config.h"
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: conveyor_sim [options]\n"
+        "  --blocks N          blocks to feed (default 1000)\n"
+        "  --rate BPM          feed rate in blocks/min (default 10)\n"
+        "  --gap MM            fixed edge-to-edge gap instead of --rate\n"
+        "  --len MIN:MAX       block length range in mm (default 30:70)\n"
+        "  --speed MM_S        belt speed (default BELT_MM_PER_S)\n"
+        "  --jitter PCT        +/- random spread of the block pitch (default 10)\n"
+        "  --tof-noise MM      +/- ToF range noise (default 2)\n"
+        "  --color-noise PCT   +/- RGBC noise (default 5)\n"
+        "  --loop-us US        simulated main-loop period (default 1000)\n"
+        "  --seed N            RNG seed (default 1)\n"
+        "  -v                  echo firmware UART output\n"
+        "  --cmd MS:LINE       send a serial command at MS (repeatable)\n"
+        "  --csv               print one CSV row instead of the summary\n"
+        "  --csv-header        print the CSV header and exit\n");
+    exit(2);
+}
+
+static unsigned long arg_num(int argc, char** argv, int* i) {
+    if (*i + 1 >= argc) {
+        usage();
+    }
+    char* end = 0;
+    unsigned long v = strtoul(argv[++*i], &end, 10);
+    if (!end || *end != '\0') {
+        usage();
+    }
+    return v;
+}
+
+static const char* k_csv_header =
+    "rate_bpm,gap_mm,len_min_mm,len_max_mm,speed_mm_s,"
+    "spacing_pos1_ms,spacing_pos2_ms,spacing_pos3_ms,max_bpm,sched_capacity,"
+    "advance_ms,release_ms,hold_max_ms,session_timeout_ms,"
+    "blocks,correct,missort_rate,merge_rate,reject_queue_full_rate,"
+    "reject_throughput_rate,spurious_fire_rate,fault_rate,throughput_bpm,missed_rate\n";
+
+static double per_block(uint32_t n, uint32_t blocks) {
+    return blocks ? (double)n / (double)blocks : 0.0;
+}
+
+static void print_csv(const SimConfig* cfg, const SimResult* r) {
+    printf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.4f\n",
+           cfg->rate_bpm, cfg->gap_mm, cfg->len_min_mm, cfg->len_max_mm, cfg->belt_mm_per_s,
+           (unsigned)DECIDE_MIN_SPACING_POS1_MS, (unsigned)DECIDE_MIN_SPACING_POS2_MS,
+           (unsigned)DECIDE_MIN_SPACING_POS3_MS, (unsigned)DECIDE_MAX_BLOCKS_PER_MIN,
+           (unsigned)SCHED_CAPACITY, (unsigned)ACTUATION_ADVANCE_MS, (unsigned)SERVO_RELEASE_MS,
+           (unsigned)SERVO_HOLD_MAX_MS, (unsigned)VL6180_SESSION_TIMEOUT_MS,
+           r->blocks, r->correct,
+           per_block(r->missorted, r->blocks), per_block(r->merged, r->blocks),
+           per_block(r->reject_queue_full, r->blocks), per_block(r->reject_throughput, r->blocks),
+           per_block(r->spurious_fires, r->blocks), per_block(r->faults, r->blocks),
+           (r->sim_s > 0.0) ? 60.0 * r->blocks / r->sim_s : 0.0,
+           per_block(r->missed, r->blocks));
+}
+
+int main(int argc, char** argv) {
+    SimConfig cfg = {
+        .blocks = 1000,
+        .belt_mm_per_s = BELT_MM_PER_S,
+        .rate_bpm = 10,
+        .gap_mm = 0,
+        .len_min_mm = 30,
+        .len_max_mm = 70,
+        .jitter_pct = 10,
+        .tof_block_mm = 30,
+        .tof_empty_mm = 150,
+        .tof_noise_mm = 2,
+        .color_noise_pct = 5,
+        .loop_us = 1000,
+        .seed = 1,
+        .verbose = false,
+    };
+    bool csv = false;
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (strcmp(a, "--blocks") == 0) {
+            cfg.blocks = (uint32_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--rate") == 0) {
+            cfg.rate_bpm = (uint16_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--gap") == 0) {
+            cfg.gap_mm = (uint16_t)arg_num(argc, argv, &i);
+            cfg.rate_bpm = 0;
+        } else if (strcmp(a, "--len") == 0) {
+            unsigned lo = 0, hi = 0;
+            if (i + 1 >= argc || sscanf(argv[++i], "%u:%u", &lo, &hi) != 2 || lo > hi) {
+                usage();
+            }
+            cfg.len_min_mm = (uint16_t)lo;
+            cfg.len_max_mm = (uint16_t)hi;
+        } else if (strcmp(a, "--speed") == 0) {
+            cfg.belt_mm_per_s = (uint16_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--jitter") == 0) {
+            cfg.jitter_pct = (uint8_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--tof-noise") == 0) {
+            cfg.tof_noise_mm = (uint8_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--color-noise") == 0) {
+            cfg.color_noise_pct = (uint8_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--loop-us") == 0) {
+            cfg.loop_us = (uint16_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--seed") == 0) {
+            cfg.seed = (uint32_t)arg_num(argc, argv, &i);
+        } else if (strcmp(a, "--cmd") == 0) {
+            char* end = 0;
+            unsigned long at = (i + 1 < argc) ? strtoul(argv[i + 1], &end, 10) : 0;
+            if (!end || *end != ':' || cfg.n_cmds == SIM_MAX_CMDS ||
+                (cfg.n_cmds && at < cfg.cmd_at_ms[cfg.n_cmds - 1U])) {
+                usage();
+            }
+            i++;
+            cfg.cmd_at_ms[cfg.n_cmds] = (uint32_t)at;
+            cfg.cmd[cfg.n_cmds++] = end + 1;
+        } else if (strcmp(a, "-v") == 0) {
+            cfg.verbose = true;
+        } else if (strcmp(a, "--csv") == 0) {
+            csv = true;
+        } else if (strcmp(a, "--csv-header") == 0) {
+            fputs(k_csv_header, stdout);
+            return 0;
+        } else {
+            usage();
+        }
+    }
+    if (cfg.belt_mm_per_s == 0 || cfg.loop_us == 0 || (cfg.rate_bpm == 0 && cfg.gap_mm == 0 && cfg.len_min_mm == 0)) {
+        usage();
+    }
+
+    SimResult r;
+    clock_t t0 = clock();
+    sim_run(&cfg, &r);
+    double wall_s = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    if (csv) {
+        print_csv(&cfg, &r);
+        return 0;
+    }
+
+    double pct = r.blocks ? 100.0 * r.correct / r.blocks : 0.0;
+    double bpm = (r.sim_s > 0.0) ? 60.0 * r.blocks / r.sim_s : 0.0;
+    printf("SIM blocks=%u correct=%u missorted=%u accuracy=%.2f%%\n",
+           r.blocks, r.correct, r.missorted, pct);
+    printf("SIM merged=%u sessions=%u fires=%u spurious=%u faults=%u\n",
+           r.merged, r.sessions, r.fires, r.spurious_fires, r.faults);
+    printf("SIM reject queue-full=%u throughput=%u other=%u missed=%u uart_dropped=%u\n",
+           r.reject_queue_full, r.reject_throughput, r.reject_other, r.missed, r.uart_dropped);
+    printf("SIM sim_time=%.1fs throughput=%.2f blocks/min wall=%.3fs (%.0f blocks/s)\n",
+           r.sim_s, bpm, wall_s, (wall_s > 0.0) ? r.blocks / wall_s : 0.0);
+    return 0;
+}
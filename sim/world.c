@@ -0,0 +1,368 @@
+/*
+ * Simulated conveyor world
+ * ------------------------
+ * Owns simulated time and the physical scene the firmware sorts:
+ * - The belt position is the STEP pulse count from the fake TB6600 times the
+ *   true pulse length (MM_PER_ROLLER_REV_X1000 / PULSES_PER_REV), so the
+ *   firmware's quantized MM_PER_PULSE_X1000 shows up as a real error.
+ * - Blocks are laid out in belt coordinates: block i reaches the sensor when
+ *   the belt has moved lead_mm, and covers it for len_mm. The ToF and color
+ *   sensors sit at the same point.
+ * - A diverter takes a block when its servo is off center at any time while
+ *   the block overlaps the diverter line (SERVO_Dn_MM past the sensor); the
+ *   first diverter wins. Blocks that clear diverter 3 are passed through.
+ * - sim_advance_us() steps from event to event (VL6180 samples, TWI
+ *   completions, ramp ticks) so interrupts fire at their exact times no matter
+ *   how coarse the main-loop step is.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "platform/config.h"
+#include "app/decide.h"
+#include "app/actuate.h"
+#include "hal/uart.h"
+#include "utils/log.h"
+#include "drivers/tb6600.h"
+#include "main.h"
+
+#define SERVO_CENTER_US 1500U
+
+typedef struct {
+    double lead_mm;          // belt travel when the leading edge reaches the sensor
+    uint16_t len_mm;
+    Color color;
+    TargetPosition expected;
+    TargetPosition outcome;
+    bool resolved;
+    bool detected;
+} SimBlock;
+
+static const SimConfig* s_cfg;
+static uint64_t s_now_us = 0;
+static uint32_t s_rng = 1;
+
+static SimBlock* s_blocks = 0;
+static uint32_t s_n_blocks = 0;
+static uint32_t s_sensor_idx = 0;  // first block not yet fully past the sensor
+static uint32_t s_eval_idx = 0;    // first block without an outcome
+static uint32_t s_resolved = 0;
+static double s_belt_mm = 0.0;
+
+static uint32_t s_sessions = 0;
+static uint32_t s_useful_fires = 0;
+static uint32_t s_fire_seen[3];    // fire count at which a channel last diverted
+static uint32_t s_rej_queue_full = 0;
+static uint32_t s_rej_throughput = 0;
+static uint32_t s_rej_other = 0;
+static uint32_t s_missed = 0;
+
+static const uint16_t s_div_mm[3] = { SERVO_D1_MM, SERVO_D2_MM, SERVO_D3_MM };
+
+// Typical RGB readings over the belt and for each block color (clear = sum)
+static const uint16_t s_rgb[5][3] = {
+    { 600, 200, 180 }, // COLOR_RED
+    { 200, 500, 250 }, // COLOR_GREEN
+    { 180, 250, 520 }, // COLOR_BLUE
+    { 350, 330, 310 }, // COLOR_OTHER
+    {  90,  90,  90 }, // empty belt
+};
+
+static uint32_t rng_next(void) {
+    // xorshift32: fast and reproducible across hosts
+    uint32_t x = s_rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s_rng = x;
+    return x;
+}
+
+// Uniform integer in [-spread, +spread]
+static int32_t rng_spread(uint32_t spread) {
+    if (spread == 0) {
+        return 0;
+    }
+    return (int32_t)(rng_next() % (2U * spread + 1U)) - (int32_t)spread;
+}
+
+static double belt_mm_now(void) {
+    return sim_tb6600_pulses() * ((double)MM_PER_ROLLER_REV_X1000 / 1000.0) / (double)PULSES_PER_REV;
+}
+
+static const SimBlock* block_at_sensor(void) {
+    if (s_sensor_idx < s_n_blocks && s_blocks[s_sensor_idx].lead_mm <= s_belt_mm) {
+        return &s_blocks[s_sensor_idx];
+    }
+    return 0;
+}
+
+uint64_t sim_now_us(void) {
+    return s_now_us;
+}
+
+uint8_t sim_world_range_mm(void) {
+    int32_t r = block_at_sensor() ? s_cfg->tof_block_mm : s_cfg->tof_empty_mm;
+    r += rng_spread(s_cfg->tof_noise_mm);
+    if (r < 0) { r = 0; }
+    if (r > 255) { r = 255; }
+    return (uint8_t)r;
+}
+
+void sim_world_rgbc(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c) {
+    const SimBlock* blk = block_at_sensor();
+    const uint16_t* p = s_rgb[blk ? (int)blk->color : 4];
+    uint16_t ch[3];
+    for (uint8_t i = 0; i < 3; i++) {
+        int32_t v = (int32_t)p[i] + (int32_t)p[i] * rng_spread(s_cfg->color_noise_pct) / 100;
+        ch[i] = (uint16_t)((v < 0) ? 0 : v);
+    }
+    *r = ch[0];
+    *g = ch[1];
+    *b = ch[2];
+    *c = (uint16_t)(ch[0] + ch[1] + ch[2]);
+}
+
+void sim_world_note_detect(void) {
+    s_sessions++;
+    if (s_sensor_idx < s_n_blocks && s_blocks[s_sensor_idx].lead_mm <= s_belt_mm) {
+        s_blocks[s_sensor_idx].detected = true;
+    }
+}
+
+static void count_reject(const char* reason, uint8_t len) {
+    if (len == 10 && strncmp(reason, "queue-full", 10) == 0) {
+        s_rej_queue_full++;
+    } else if (len == 10 && strncmp(reason, "throughput", 10) == 0) {
+        s_rej_throughput++;
+    } else {
+        s_rej_other++;
+    }
+}
+
+void sim_world_uart_line(const char* line) {
+    if (strncmp(line, "MISSED ", 7) == 0) {
+        s_missed++;
+        return;
+    }
+    if (strncmp(line, "SCHEDULE_REJECT", 15) != 0) {
+        return;
+    }
+    const char* reason = strstr(line, "reason=");
+    if (reason) {
+        count_reject(reason + 7, (uint8_t)strcspn(reason + 7, " "));
+    } else {
+        s_rej_other++;
+    }
+}
+
+void sim_world_uart_frame(const uint8_t* frame, uint16_t len) {
+    if (len < 4) {
+        return;
+    }
+    if (frame[2] == LOG_FRAME_MISSED) {
+        s_missed++;
+    } else if (frame[2] == LOG_FRAME_SCHEDULE_REJECT) {
+        // Skip the t and id varints to the reason string
+        uint16_t i = 3;
+        for (uint8_t v = 0; v < 2 && i < len; v++) {
+            while (i < len && (frame[i] & 0x80U)) {
+                i++;
+            }
+            i++;
+        }
+        if (i < len && (uint16_t)(i + 1U + frame[i]) < len) {
+            count_reject((const char*)&frame[i + 1U], frame[i]);
+        }
+    }
+}
+
+static void resolve(SimBlock* blk, TargetPosition outcome) {
+    blk->outcome = outcome;
+    blk->resolved = true;
+    s_resolved++;
+}
+
+// Belt moved from b0 to s_belt_mm with servo states unchanged: settle blocks
+// that overlapped an open diverter or cleared the last one.
+static void evaluate_diverters(double b0) {
+    double b1 = s_belt_mm;
+    bool open[3];
+    for (uint8_t d = 0; d < 3; d++) {
+        open[d] = sim_servo_pulse_us(d) != SERVO_CENTER_US;
+    }
+    for (uint32_t i = s_eval_idx; i < s_n_blocks; i++) {
+        SimBlock* blk = &s_blocks[i];
+        if (blk->lead_mm + s_div_mm[0] > b1) {
+            break; // this and later blocks have not reached diverter 1
+        }
+        if (blk->resolved) {
+            continue;
+        }
+        for (uint8_t d = 0; d < 3 && !blk->resolved; d++) {
+            double from = blk->lead_mm + s_div_mm[d];
+            double to = from + blk->len_mm;
+            if (open[d] && from <= b1 && to > b0) {
+                resolve(blk, (TargetPosition)(POS1 + d));
+                uint32_t f = sim_servo_fire_count(d);
+                if (s_fire_seen[d] != f) {
+                    s_fire_seen[d] = f;
+                    s_useful_fires++;
+                }
+            }
+        }
+        if (!blk->resolved && blk->lead_mm + blk->len_mm + s_div_mm[2] < b1) {
+            resolve(blk, PASS_THROUGH);
+        }
+    }
+    while (s_eval_idx < s_n_blocks && s_blocks[s_eval_idx].resolved) {
+        s_eval_idx++;
+    }
+}
+
+static void move_to(uint64_t t_us) {
+    if (t_us <= s_now_us) {
+        return;
+    }
+    double b0 = s_belt_mm;
+    sim_tb6600_advance((uint32_t)(t_us - s_now_us));
+    s_now_us = t_us;
+    s_belt_mm = belt_mm_now();
+    while (s_sensor_idx < s_n_blocks &&
+           s_blocks[s_sensor_idx].lead_mm + s_blocks[s_sensor_idx].len_mm <= s_belt_mm) {
+        s_sensor_idx++;
+    }
+    evaluate_diverters(b0);
+}
+
+void sim_advance_us(uint32_t us) {
+    uint64_t end = s_now_us + us;
+    for (;;) {
+        uint64_t t_meas = sim_vl6180_next_meas_us();
+        uint64_t t_twi = sim_twi_next_done_us();
+        uint64_t t_ramp = sim_tb6600_next_tick_us();
+        uint64_t t = end;
+        if (t_meas < t) { t = t_meas; }
+        if (t_twi < t) { t = t_twi; }
+        if (t_ramp < t) { t = t_ramp; }
+        move_to(t);
+        if (t == t_ramp) {
+            sim_tb6600_tick();
+        } else if (t == t_twi) {
+            sim_twi_complete();
+        } else if (t == t_meas) {
+            sim_vl6180_measure();
+        } else {
+            break; // reached end with no event pending at it
+        }
+    }
+}
+
+static TargetPosition expected_route(const SimBlock* blk) {
+    LengthClass cls = (blk->len_mm < LENGTH_SMALL_MAX_MM) ? LEN_SMALL : LEN_NOT_SMALL;
+    return decide_route(blk->color, cls);
+}
+
+static void lay_out_blocks(const SimConfig* cfg) {
+    s_n_blocks = cfg->blocks;
+    s_blocks = calloc(s_n_blocks ? s_n_blocks : 1U, sizeof(SimBlock));
+    if (!s_blocks) {
+        fprintf(stderr, "sim: out of memory\n");
+        exit(1);
+    }
+    // First block arrives once the belt is well past its ramp
+    double lead = (double)cfg->belt_mm_per_s + 100.0;
+    uint16_t span = (uint16_t)(cfg->len_max_mm - cfg->len_min_mm);
+    for (uint32_t i = 0; i < s_n_blocks; i++) {
+        SimBlock* blk = &s_blocks[i];
+        blk->lead_mm = lead;
+        blk->len_mm = (uint16_t)(cfg->len_min_mm + (span ? rng_next() % (span + 1U) : 0U));
+        blk->color = (Color)(rng_next() % 4U);
+        blk->expected = expected_route(blk);
+        double pitch = cfg->rate_bpm
+            ? (double)cfg->belt_mm_per_s * 60.0 / (double)cfg->rate_bpm
+            : (double)blk->len_mm + (double)cfg->gap_mm;
+        pitch += pitch * (double)rng_spread(cfg->jitter_pct) / 100.0;
+        if (pitch < blk->len_mm) {
+            pitch = blk->len_mm; // blocks may touch but never overlap
+        }
+        lead += pitch;
+    }
+}
+
+void sim_run(const SimConfig* cfg, SimResult* out) {
+    s_cfg = cfg;
+    s_rng = cfg->seed ? cfg->seed : 1U;
+    s_now_us = 0;
+    s_belt_mm = 0.0;
+    s_sensor_idx = 0;
+    s_eval_idx = 0;
+    s_resolved = 0;
+    s_sessions = 0;
+    s_useful_fires = 0;
+    memset(s_fire_seen, 0, sizeof(s_fire_seen));
+    s_rej_queue_full = 0;
+    s_rej_throughput = 0;
+    s_rej_other = 0;
+    s_missed = 0;
+    g_sim_uart_echo = cfg->verbose;
+    sim_hal_reset();
+    sim_drivers_reset();
+    sim_dev_reset();
+    lay_out_blocks(cfg);
+
+    app_setup();
+    // Runtime speed change, as an operator would make it: the driver
+    // quantizes, Decide follows the achieved target (app_loop tracks the ramp)
+    tb6600_set_speed(cfg->belt_mm_per_s);
+    decide_set_belt_mm_per_s(tb6600_get_target_speed_mm_per_s());
+
+    // Give up if the belt stalls: allow twice the nominal time to clear diverter 3
+    double last_mm = s_n_blocks ? s_blocks[s_n_blocks - 1U].lead_mm + cfg->len_max_mm : 0.0;
+    double limit_s = 2.0 * (last_mm + SERVO_D3_MM) / (double)(cfg->belt_mm_per_s ? cfg->belt_mm_per_s : 1U) + 10.0;
+    uint64_t limit_us = (uint64_t)(limit_s * 1e6);
+    uint64_t first_us = 0;
+    uint8_t next_cmd = 0;
+    while (s_resolved < s_n_blocks && s_now_us < limit_us) {
+        sim_advance_us(cfg->loop_us);
+        while (next_cmd < cfg->n_cmds && s_now_us >= (uint64_t)cfg->cmd_at_ms[next_cmd] * 1000U) {
+            sim_uart_rx(cfg->cmd[next_cmd++]);
+            sim_uart_rx("\r\n");
+        }
+        app_loop();
+        if (!first_us && s_n_blocks && s_belt_mm >= s_blocks[0].lead_mm) {
+            first_us = s_now_us;
+        }
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->blocks = s_n_blocks;
+    for (uint32_t i = 0; i < s_n_blocks; i++) {
+        const SimBlock* blk = &s_blocks[i];
+        if (blk->resolved && blk->outcome == blk->expected) {
+            out->correct++;
+        } else {
+            out->missorted++;
+        }
+        if (!blk->detected) {
+            out->merged++;
+        }
+    }
+    out->sessions = s_sessions;
+    for (uint8_t d = 0; d < 3; d++) {
+        out->fires += sim_servo_fire_count(d);
+    }
+    out->spurious_fires = out->fires - s_useful_fires;
+    out->reject_queue_full = s_rej_queue_full;
+    out->reject_throughput = s_rej_throughput;
+    out->reject_other = s_rej_other;
+    out->missed = s_missed;
+    out->faults = counters_get()->fault;
+    out->uart_dropped = uart_tx_dropped();
+    out->sim_s = (double)(s_now_us - first_us) / 1e6;
+
+    free(s_blocks);
+    s_blocks = 0;
+    s_n_blocks = 0;
+}
@@ -3,7 +3,8 @@
  * -----------------------------------------------------
  * Responsibilities:
  * - Convert a TargetPosition into a servo channel and set its pulse to a
- *   diverter position for a short dwell, then auto-center it.
+ *   diverter position for a hold time (per block from decide, or the fixed
+ *   SERVO_DWELL_MS), then auto-center it.
  * - Keep simple counters of total/diverted/passed/fault for periodic logging.
  * - Manage illumination and presence LEDs at startup.
  * Notes:
@@ -16,11 +17,15 @@
 #include "hal/timers.h"
 #include "drivers/servo.h"
 #include "hal/gpio.h"
+#include "utils/time_util.h"
+#include "utils/trace.h"
 #include "app/actuate.h"
 
 static struct { uint32_t total, diverted, passed, fault, red, green, blue, other; } s_counters = {0,0,0,0,0,0,0,0};
-// Auto-centering dwell timers per channel (0..2). 0 means idle/centered.
+// Auto-centering dwell deadlines per channel (0..2); bit i of s_dwell_armed
+// set means channel i is diverted (any timestamp, including 0, is valid).
 static uint32_t s_dwell_until_ms[3] = {0,0,0};
+static uint8_t s_dwell_armed = 0;
 
 void actuate_init(void) {
     // Initialize presence LED and turn on illumination LEDs via HAL
@@ -34,11 +39,16 @@ void actuate_init(void) {
 }
 
 void actuate_fire(TargetPosition pos) {
+    actuate_fire_for(pos, SERVO_DWELL_MS);
+}
+
+void actuate_fire_for(TargetPosition pos, uint16_t hold_ms) {
     uint8_t idx = (pos == POS1) ? 0 : (pos == POS2) ? 1 : (pos == POS3) ? 2 : 0;
     servo_set_pulse_us(idx, 1700);
     // Arm auto-centering for this channel
     uint32_t now = millis();
-    s_dwell_until_ms[idx] = now + SERVO_DWELL_MS;
+    s_dwell_until_ms[idx] = now + hold_ms;
+    s_dwell_armed |= (uint8_t)(1U << idx);
 }
 
 void actuate_stop_all(void) {
@@ -46,6 +56,7 @@ void actuate_stop_all(void) {
     servo_set_pulse_us(1,1500);
     servo_set_pulse_us(2,1500);
     s_dwell_until_ms[0] = s_dwell_until_ms[1] = s_dwell_until_ms[2] = 0;
+    s_dwell_armed = 0;
 }
 
 // Counters API
@@ -84,10 +95,11 @@ void counters_inc_other(void){ s_counters.other++; }
 // Auto-centering tick: return channels to center when dwell expires
 void actuate_tick(uint32_t now_ms) {
     for (uint8_t i = 0; i < 3; i++) {
-        uint32_t until = s_dwell_until_ms[i];
-        if (until && (now_ms >= until)) {
+        if ((s_dwell_armed & (1U << i)) && time_reached(now_ms, s_dwell_until_ms[i])) {
             servo_set_pulse_us(i, 1500);
             s_dwell_until_ms[i] = 0;
+            s_dwell_armed &= (uint8_t)~(1U << i);
+            trace_center((TargetPosition)i, now_ms); // channel i is POS1 + i
         }
     }
 }
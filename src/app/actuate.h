@@ -11,11 +11,18 @@
 void actuate_init(void);
 
 /** Command a single actuation to the given target position.
- * Non-blocking; arms auto-centering dwell.
+ * Non-blocking; arms auto-centering after the fixed SERVO_DWELL_MS.
  * @param pos Target diverter position to actuate.
  */
 void actuate_fire(TargetPosition pos);
 
+/** Command an actuation held for a per-block interval.
+ * Non-blocking; firing a diverter that is still deflected restarts its hold.
+ * @param pos     Target diverter position to actuate.
+ * @param hold_ms Time to keep the diverter deflected before auto-centering.
+ */
+void actuate_fire_for(TargetPosition pos, uint16_t hold_ms);
+
 /** Immediately stop all actuators and return servos to center. */
 void actuate_stop_all(void);
 
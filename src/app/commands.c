@@ -0,0 +1,319 @@
+/*
+ * Serial commands
+ * ---------------
+ * One command per line (terminated by CR, LF or CRLF), words separated by
+ * spaces, numbers in decimal or 0x hex:
+ *   get <param>                 -> OK <param>=<value>
+ *   set <param> <value>         -> OK <param>=<value now in effect>
+ *   set spacing <ms> [1|2|3]    one diverter, or all three when omitted
+ *   stats                       -> UART, SCHED and COUNT lines, as printed
+ *                                  every COUNT_LOG_MIN_INTERVAL_MS (printed
+ *                                  by the main loop, see
+ *                                  commands_take_stats_request())
+ *   help
+ * Params:
+ *   speed    belt target speed for the stepper (mm/s, quantized by tb6600;
+ *            0 stops). The belt ramps there and the main loop keeps Decide's
+ *            belt speed in step with it.
+ *   belt     belt speed Decide and Sense assume (mm/s), to trim length and
+ *            timing math against the real belt; the next speed change or
+ *            ramp overwrites it.
+ *   spacing  per-diverter minimum spacing (ms, 0 = off); get prints Pos1..Pos3.
+ *   bpm      throughput limit (blocks/min, 0 = off).
+ *   logmask  log categories (LOG_CAT_* bits, limited to LOG_CATEGORIES_MAX).
+ *   logfmt   0 = text lines, 1 = binary frames.
+ * Anything else gets "ERR <reason>". There is no echo; use local echo in the
+ * terminal.
+ * A reply is formatted into a buffer and sent once the TX ring has room for
+ * all of it, so it is not dropped behind a block's log burst. Until it is out
+ * no further input is read; received bytes wait in the RX ring.
+ * commands_poll() takes at most CMD_BYTES_PER_POLL bytes from the RX buffer
+ * and returns right after a completed line, so a main-loop pass runs at most
+ * one command. A line longer than CMD_LINE_MAX - 1 is discarded whole.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include "platform/config.h"
+#include "platform/progmem.h"
+#include "hal/uart.h"
+#include "drivers/tb6600.h"
+#include "app/decide.h"
+#include "utils/log.h"
+#include "utils/fmt.h"
+#include "commands.h"
+
+#define CMD_MAX_WORDS 4U
+
+static char s_line[CMD_LINE_MAX];
+static uint8_t s_len = 0;
+static bool s_overflow = false; // current line exceeded CMD_LINE_MAX - 1
+static char s_reply[CMD_REPLY_MAX];
+static uint8_t s_reply_len = 0;   // formatted reply waiting to be sent, 0 = none
+static const char* s_reply_P = 0; // flash reply waiting to be sent (help), or NULL
+static bool s_stats_requested = false;
+
+void commands_init(void) {
+    s_len = 0;
+    s_overflow = false;
+    s_reply_len = 0;
+    s_reply_P = 0;
+    s_stats_requested = false;
+}
+
+static void reply_str(const char* s) {
+    while (*s && s_reply_len < (uint8_t)(CMD_REPLY_MAX - 1U)) {
+        s_reply[s_reply_len++] = *s++;
+    }
+    s_reply[s_reply_len] = '\0';
+}
+
+// s is a flash string (PSTR)
+static void reply_P(const char* s) {
+    uint8_t ch;
+    while (s_reply_len < (uint8_t)(CMD_REPLY_MAX - 1U) && (ch = pgm_read_byte(s++)) != 0) {
+        s_reply[s_reply_len++] = (char)ch;
+    }
+    s_reply[s_reply_len] = '\0';
+}
+
+static void reply_u32(uint32_t v) {
+    char b[FMT_U32_LEN];
+    fmt_u32(b, v);
+    reply_str(b);
+}
+
+// key is a flash string (PSTR)
+static void reply_value(const char* key, uint32_t v) {
+    reply_P(PSTR("OK "));
+    reply_P(key);
+    reply_P(PSTR("="));
+    reply_u32(v);
+    reply_P(PSTR("\r\n"));
+}
+
+// reason is a flash string (PSTR)
+static void reply_err(const char* reason) {
+    reply_P(PSTR("ERR "));
+    reply_P(reason);
+    reply_P(PSTR("\r\n"));
+}
+
+// Send the queued reply once the TX ring has room for it.
+// @return true when nothing is left to send
+static bool reply_flush(void) {
+    if (!s_reply_len && !s_reply_P) {
+        return true;
+    }
+    uint8_t len = s_reply_P ? (uint8_t)strlen_P(s_reply_P) : s_reply_len;
+    if (uart_tx_free() < len) {
+        return false;
+    }
+    if (s_reply_P) {
+        uart_write_P(s_reply_P);
+    } else {
+        uart_write(s_reply);
+    }
+    s_reply_len = 0;
+    s_reply_P = 0;
+    return true;
+}
+
+// Decimal or 0x-prefixed hex, no sign, up to 0xFFFF
+static bool parse_u16(const char* s, uint16_t* out) {
+    uint8_t base = 10U;
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16U;
+        s += 2;
+    }
+    if (*s == '\0') {
+        return false;
+    }
+    uint32_t v = 0;
+    for (; *s; s++) {
+        uint8_t c = (uint8_t)*s;
+        uint8_t lc = (uint8_t)(c | 0x20U);
+        uint8_t d;
+        if (c >= '0' && c <= '9') {
+            d = (uint8_t)(c - '0');
+        } else if (base == 16U && lc >= 'a' && lc <= 'f') {
+            d = (uint8_t)(lc - 'a' + 10U);
+        } else {
+            return false;
+        }
+        v = v * base + d;
+        if (v > 0xFFFFUL) {
+            return false;
+        }
+    }
+    *out = (uint16_t)v;
+    return true;
+}
+
+static void reply_spacing(void) {
+    reply_P(PSTR("OK spacing="));
+    reply_u32(decide_get_position_min_spacing_ms(POS1));
+    reply_P(PSTR(","));
+    reply_u32(decide_get_position_min_spacing_ms(POS2));
+    reply_P(PSTR(","));
+    reply_u32(decide_get_position_min_spacing_ms(POS3));
+    reply_P(PSTR("\r\n"));
+}
+
+static void cmd_get(const char* param) {
+    if (strcmp_P(param, PSTR("speed")) == 0) {
+        reply_value(PSTR("speed"), tb6600_get_target_speed_mm_per_s());
+    } else if (strcmp_P(param, PSTR("belt")) == 0) {
+        reply_value(PSTR("belt"), decide_get_belt_mm_per_s());
+    } else if (strcmp_P(param, PSTR("spacing")) == 0) {
+        reply_spacing();
+    } else if (strcmp_P(param, PSTR("bpm")) == 0) {
+        reply_value(PSTR("bpm"), decide_get_max_blocks_per_min());
+    } else if (strcmp_P(param, PSTR("logmask")) == 0) {
+        reply_value(PSTR("logmask"), log_get_mask());
+    } else if (strcmp_P(param, PSTR("logfmt")) == 0) {
+        reply_value(PSTR("logfmt"), (uint32_t)log_get_format());
+    } else {
+        reply_err(PSTR("unknown param"));
+    }
+}
+
+// pos_word is the optional diverter number for "set spacing", else NULL
+static void cmd_set(const char* param, const char* value, const char* pos_word) {
+    uint16_t v;
+    if (!parse_u16(value, &v)) {
+        reply_err(PSTR("bad value"));
+        return;
+    }
+    bool is_spacing = strcmp_P(param, PSTR("spacing")) == 0;
+    if (pos_word && !is_spacing) {
+        reply_err(PSTR("usage"));
+        return;
+    }
+    if (strcmp_P(param, PSTR("speed")) == 0) {
+        if (v > CMD_BELT_MAX_MM_PER_S) {
+            reply_err(PSTR("out of range"));
+            return;
+        }
+        tb6600_set_speed(v);
+        cmd_get(param);
+    } else if (strcmp_P(param, PSTR("belt")) == 0) {
+        if (v == 0 || v > CMD_BELT_MAX_MM_PER_S) {
+            reply_err(PSTR("out of range"));
+            return;
+        }
+        decide_set_belt_mm_per_s(v);
+        cmd_get(param);
+    } else if (is_spacing) {
+        if (pos_word) {
+            uint16_t n;
+            if (!parse_u16(pos_word, &n) || n < 1U || n > 3U) {
+                reply_err(PSTR("bad position"));
+                return;
+            }
+            decide_set_position_min_spacing_ms((TargetPosition)(POS1 + (n - 1U)), v);
+        } else {
+            decide_set_min_spacing_ms(v);
+        }
+        reply_spacing();
+    } else if (strcmp_P(param, PSTR("bpm")) == 0) {
+        if (v > 0xFFU) {
+            reply_err(PSTR("out of range"));
+            return;
+        }
+        decide_set_max_blocks_per_min((uint8_t)v);
+        cmd_get(param);
+    } else if (strcmp_P(param, PSTR("logmask")) == 0) {
+        if (v > 0xFFU) {
+            reply_err(PSTR("out of range"));
+            return;
+        }
+        log_set_mask((uint8_t)v);
+        cmd_get(param);
+    } else if (strcmp_P(param, PSTR("logfmt")) == 0) {
+        if (v > (uint16_t)LOG_FORMAT_BINARY) {
+            reply_err(PSTR("out of range"));
+            return;
+        }
+        log_set_format((LogFormat)v);
+        cmd_get(param);
+    } else {
+        reply_err(PSTR("unknown param"));
+    }
+}
+
+static void run_line(char* line) {
+    char* w[CMD_MAX_WORDS];
+    uint8_t n = 0;
+    char* p = line;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (n == CMD_MAX_WORDS) {
+            reply_err(PSTR("usage"));
+            return;
+        }
+        w[n++] = p;
+        while (*p && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        if (*p) {
+            *p++ = '\0';
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+    if (n == 1 && strcmp_P(w[0], PSTR("stats")) == 0) {
+        s_stats_requested = true;
+    } else if (n == 1 && strcmp_P(w[0], PSTR("help")) == 0) {
+        s_reply_P = PSTR("OK get|set speed|belt|spacing|bpm|logmask|logfmt, set spacing <ms> [1-3], stats\r\n");
+    } else if (n == 2 && strcmp_P(w[0], PSTR("get")) == 0) {
+        cmd_get(w[1]);
+    } else if (n >= 3 && strcmp_P(w[0], PSTR("set")) == 0) {
+        cmd_set(w[1], w[2], (n == 4) ? w[3] : 0);
+    } else {
+        reply_err(PSTR("unknown command"));
+    }
+}
+
+void commands_poll(void) {
+    if (!reply_flush()) {
+        return;
+    }
+    uint8_t b;
+    for (uint8_t i = 0; i < CMD_BYTES_PER_POLL && uart_read_byte(&b); i++) {
+        if (b == '\r' || b == '\n') {
+            bool overflow = s_overflow;
+            uint8_t len = s_len;
+            s_line[len] = '\0';
+            s_len = 0;
+            s_overflow = false;
+            if (overflow) {
+                reply_err(PSTR("line too long"));
+                reply_flush();
+                return;
+            }
+            if (len) {
+                run_line(s_line);
+                reply_flush();
+                return;
+            }
+            continue; // blank line or the LF of a CRLF
+        }
+        if (s_len < (uint8_t)(CMD_LINE_MAX - 1U)) {
+            s_line[s_len++] = (char)b;
+        } else {
+            s_overflow = true;
+        }
+    }
+}
+
+bool commands_take_stats_request(void) {
+    bool requested = s_stats_requested;
+    s_stats_requested = false;
+    return requested;
+}
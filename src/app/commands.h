@@ -0,0 +1,21 @@
+/*
+ * Commands module: line-based serial commands for tuning the running line
+ * (belt speed, spacing and throughput guardrails, log mask/format) and for
+ * dumping statistics. Reads the UART RX buffer a few bytes per call.
+ */
+#pragma once
+#include <stdbool.h>
+
+/** Discard any partial command line. */
+void commands_init(void);
+
+/** Consume at most CMD_BYTES_PER_POLL received bytes and run at most one
+ * completed command line. A reply is sent once the TX ring has room for it; no
+ * input is read while one is waiting. Never blocks; call every main-loop pass.
+ */
+void commands_poll(void);
+
+/** Whether a "stats" command ran since the last call (clears the request).
+ * The main loop prints the stats lines, even with LOG_CAT_COUNT masked off.
+ */
+bool commands_take_stats_request(void);
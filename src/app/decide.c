@@ -3,54 +3,111 @@
  * -------------------------------------
  * Responsibilities:
  * - Route a classified item (color + length class) to a target diverter position.
- * - Compute when that diverter should fire based on the belt speed and distance
- *   from the sensor to each diverter (SERVO_Dx_MM), with an optional global
- *   ACTUATION_ADVANCE_MS to fire slightly earlier if needed.
- * - Maintain a tiny queue of future actuations. We allow out-of-order scheduling
- *   but enforce minimum spacing at fire time to protect mechanics.
+ * - Compute when that diverter should open based on the belt speed and distance
+ *   from the sensor to each diverter (SERVO_Dx_MM): ACTUATION_ADVANCE_MS ahead
+ *   of the block's leading edge, and held until its trailing edge has passed
+ *   (plus SERVO_RELEASE_MS), so the gate-open interval follows the block's length.
+ * - Maintain a queue of future actuations, kept sorted by due point so the
+ *   earliest one is always at the head. We allow out-of-order scheduling (a
+ *   later block for a nearer diverter is inserted ahead) but enforce minimum
+ *   spacing at fire time to protect mechanics: a diverter that has recentered
+ *   rests for its spacing interval before it opens again (one still open is
+ *   just held longer). Spacing is per diverter: the servos are independent, so
+ *   a Pos1 firing does not hold back Pos3.
  * - Provide a runtime-adjustable belt speed so length math follows real motion.
  * How it works at a glance:
  * - decide_route: small+color -> POS1/2/3; others pass-through.
  * - decide_schedule: compute due time from detect timestamp and belt speed; enqueue.
- * - decide_tick: at each loop, if any item is due and spacing allows, fire it.
+ * - decide_schedule_at_position: key the actuation on a target belt position in
+ *   STEP pulses (tb6600 position counter) instead, so mm/s quantization and speed
+ *   changes while the block is in flight do not shift the firing point.
+ * - Each item carries a lateness window: how far past its due point it may
+ *   still fire and divert the block (see late_window()). Items past their
+ *   window are dropped as MISSED instead of firing at a block that has gone by.
+ * - decide_tick: at each loop, fire the earliest due item whose diverter is out
+ *   of its spacing interval. The walk stops at the first item not yet due, so
+ *   an idle tick only checks the head (insertion pays the O(n) shift instead).
  */
 #include "app/decide.h"
 #include "platform/config.h"
+#include "platform/progmem.h"
 #include "app/actuate.h"
+#include "drivers/tb6600.h"
 #include "utils/log.h"
+#include "utils/time_util.h"
+#include "utils/instr.h"
+#include "utils/trace.h"
 
-// Inlined scheduler state and config (ring buffer)
+#if SCHED_CAPACITY < 1 || SCHED_CAPACITY > 255
+#error "SCHED_CAPACITY must be 1..255"
+#endif
+
+// Inlined scheduler state and config (ring buffer sorted by due point)
 typedef struct {
-    uint32_t t_due_ms;
-    TargetPosition pos;
-    uint8_t active;
+    uint32_t t_due_ms;      // due time (estimate only for position-keyed items)
+    uint32_t due_pulses;    // belt position to fire at (position-keyed items)
+    uint8_t pos;            // TargetPosition
+    uint8_t by_position;    // 1 = fire on belt position, 0 = fire on t_due_ms
     uint16_t event_id; // correlates to the originating detection
+    uint16_t window;        // lateness allowed past the due point (pulses or ms, like the due point)
+    uint16_t span;          // due point to the trailing edge reaching the diverter (same units)
+    uint16_t rate_hz;       // step rate when scheduled: converts pulses to ms for logs (position-keyed)
 } ScheduleItem;
 
 static ScheduleItem s_schedule_queue[SCHED_CAPACITY];
-static uint32_t s_last_act_ms = 0;
+static uint8_t s_sched_head = 0;  // earliest item
+static uint8_t s_sched_count = 0;
+static uint8_t s_sched_high_water = 0;
+// Per-diverter spacing (index = TargetPosition POS1..POS3)
+#define DECIDE_CHANNELS 3
+static uint32_t s_close_ms[DECIDE_CHANNELS] = {0, 0, 0}; // when the last gate-open interval ends
+static uint8_t s_have_close = 0; // bit i: s_close_ms[i] valid (0 is a real timestamp after the wrap)
+static uint16_t s_min_spacing_ms[DECIDE_CHANNELS] = {0, 0, 0};
 static uint32_t s_last_due_ms = 0;
-static uint16_t s_min_spacing_ms = 0;
+static uint32_t s_missed = 0;
 static uint8_t s_max_blocks_per_min = 0; // 0 = disabled
 static uint8_t s_blocks_in_window = 0;
 static uint32_t s_window_start_ms = 0;
+static uint8_t s_have_window = 0; // s_window_start_ms valid (0 is a real timestamp after the wrap)
 static uint16_t s_belt_mm_per_s = BELT_MM_PER_S; // runtime adjustable
 
 void decide_init(void) {
-    for (uint8_t i = 0; i < SCHED_CAPACITY; i++) {
-        s_schedule_queue[i].active = 0;
+    s_sched_head = 0;
+    s_sched_count = 0;
+    s_sched_high_water = 0;
+    for (uint8_t i = 0; i < DECIDE_CHANNELS; i++) {
+        s_close_ms[i] = 0;
     }
-    s_last_act_ms = 0;
+    s_have_close = 0;
+    s_have_window = 0;
+    s_blocks_in_window = 0;
     s_last_due_ms = 0;
+    s_missed = 0;
 }
 void decide_set_min_spacing_ms(uint16_t ms) {
-    s_min_spacing_ms = ms;
+    for (uint8_t i = 0; i < DECIDE_CHANNELS; i++) {
+        s_min_spacing_ms[i] = ms;
+    }
+}
+
+void decide_set_position_min_spacing_ms(TargetPosition pos, uint16_t ms) {
+    if ((uint8_t)pos < DECIDE_CHANNELS) {
+        s_min_spacing_ms[pos] = ms;
+    }
+}
+
+uint16_t decide_get_position_min_spacing_ms(TargetPosition pos) {
+    return ((uint8_t)pos < DECIDE_CHANNELS) ? s_min_spacing_ms[pos] : 0;
 }
 
 void decide_set_max_blocks_per_min(uint8_t bpm) {
     s_max_blocks_per_min = bpm;
 }
 
+uint8_t decide_get_max_blocks_per_min(void) {
+    return s_max_blocks_per_min;
+}
+
 void decide_set_belt_mm_per_s(uint16_t v) {
     if (v > 0) {
         s_belt_mm_per_s = v;
@@ -80,88 +137,272 @@ static uint16_t distance_for_position(TargetPosition p) {
     return 0;
 }
 
-static int8_t find_free_slot(void) {
-    for (uint8_t i = 0; i < SCHED_CAPACITY; i++) {
-        if (!s_schedule_queue[i].active) { 
-            return (int8_t)i; 
+// Ring slot of the k-th item from the head
+static inline uint8_t sched_slot(uint8_t k) {
+    return (uint8_t)((s_sched_head + k) % SCHED_CAPACITY);
+}
+
+// Queue order. Position-keyed items compare by belt position; time-keyed
+// items (and mixed pairs) by due time, which is the estimate for
+// position-keyed items.
+static bool due_before(const ScheduleItem* a, const ScheduleItem* b) {
+    if (a->by_position && b->by_position) {
+        return (int32_t)(a->due_pulses - b->due_pulses) < 0;
+    }
+    return time_before(a->t_due_ms, b->t_due_ms);
+}
+
+// Sorted insert: shift later items one slot towards the tail. Items with the
+// same due point keep their scheduling order. Caller checks for space.
+static void sched_insert(const ScheduleItem* it) {
+    uint8_t k = s_sched_count;
+    while (k > 0 && due_before(it, &s_schedule_queue[sched_slot((uint8_t)(k - 1U))])) {
+        s_schedule_queue[sched_slot(k)] = s_schedule_queue[sched_slot((uint8_t)(k - 1U))];
+        k--;
+    }
+    s_schedule_queue[sched_slot(k)] = *it;
+    s_sched_count++;
+    if (s_sched_count > s_sched_high_water) {
+        s_sched_high_water = s_sched_count;
+    }
+}
+
+// Belt travel in STEP pulses, using the full-precision roller geometry
+// (MM_PER_PULSE_X1000 alone truncates ~31.4 to 31, a 1.3% error).
+static uint32_t pulses_for_mm(uint16_t mm) {
+    return ((uint32_t)mm * PULSES_PER_REV * 1000UL) / MM_PER_ROLLER_REV_X1000;
+}
+
+static inline uint16_t clamp_u16(uint32_t v) {
+    return (v > 0xFFFFUL) ? 0xFFFFU : (uint16_t)v;
+}
+
+// Lateness window past the due point, in the item's units (ms or pulses).
+// The block's trailing edge reaches the diverter `span` after the due point
+// (its length plus the actuation advance). A late firing still diverts the
+// block while DECIDE_MISS_OVERLAP_PCT of its length is upstream of the gate,
+// so that part of the block comes off the span. The result never drops below
+// DECIDE_MISS_MIN_WINDOW_MS (main-loop jitter).
+// per_s: belt speed in the same units per second (mm/s for ms, Hz for pulses).
+static uint16_t late_window(uint32_t span, uint32_t overlap, uint32_t per_s, bool in_ms) {
+    uint32_t min_window = in_ms ? DECIDE_MISS_MIN_WINDOW_MS
+                                : (per_s * DECIDE_MISS_MIN_WINDOW_MS) / 1000UL;
+    uint32_t w = (span > overlap) ? (span - overlap) : 0;
+    if (w < min_window) { w = min_window; }
+    return clamp_u16(w);
+}
+
+// Shared tail of both schedule variants: throughput guardrail, then enqueue.
+static bool enqueue(TargetPosition pos, uint32_t due, uint32_t due_pulses, uint8_t by_position,
+                    uint16_t window, uint16_t span, uint16_t rate_hz, uint32_t detect_ms, uint16_t evt_id) {
+    // throughput guardrail within sliding 60s window
+    if (s_max_blocks_per_min) {
+        if (!s_have_window || time_elapsed_ms(detect_ms, s_window_start_ms) >= 60000U) {
+            s_window_start_ms = detect_ms;
+            s_have_window = 1;
+            s_blocks_in_window = 0;
         }
+        if (s_blocks_in_window >= s_max_blocks_per_min) { log_schedule_reject(detect_ms, evt_id, PSTR("throughput")); return false; }
+        // s_blocks_in_window++; BUG increments before checking queue free slot
     }
-    return -1;
+
+    if (s_sched_count >= SCHED_CAPACITY) { 
+        log_schedule_reject(detect_ms, evt_id, PSTR("queue-full")); 
+        return false; 
+    }
+    ScheduleItem it;
+    it.pos = (uint8_t)pos;
+    it.t_due_ms = due;
+    it.due_pulses = due_pulses;
+    it.by_position = by_position;
+    it.event_id = evt_id;
+    it.window = window;
+    it.span = span;
+    it.rate_hz = rate_hz;
+    sched_insert(&it);
+    s_last_due_ms = due;
+    s_blocks_in_window++; // Moved here since can fail in the if case above.
+    log_schedule(detect_ms, pos, due, evt_id);
+    trace_due(evt_id, due);
+    return true;
 }
 
-bool decide_schedule(TargetPosition pos, uint32_t detect_ms, uint16_t evt_id) {
+bool decide_schedule(TargetPosition pos, uint32_t detect_ms, LengthInfo len, uint16_t evt_id) {
     if (pos == PASS_THROUGH) { 
-        log_schedule_reject(detect_ms, evt_id, "pass-through"); 
+        log_schedule_reject(detect_ms, evt_id, PSTR("pass-through")); 
         return false; 
     }
 
     uint16_t d = distance_for_position(pos);
     if (d == 0 || s_belt_mm_per_s == 0) { 
-        log_schedule_reject(detect_ms, evt_id, "invalid-config"); 
+        log_schedule_reject(detect_ms, evt_id, PSTR("invalid-config")); 
         return false; 
     }
 
+    // detect_ms is the trailing edge; the leading edge passed the sensor
+    // dwell_ms earlier. Open the gate ACTUATION_ADVANCE_MS ahead of it,
+    // clamped to detection time (cannot schedule before detection).
     uint32_t delay_ms = ((uint32_t)d * 1000U) / s_belt_mm_per_s;
-    uint32_t due = detect_ms + delay_ms;
-    // Apply global actuation advance (ms), clamped to detection time
-    if (ACTUATION_ADVANCE_MS > 0) {
-        if (delay_ms > ACTUATION_ADVANCE_MS) {
-            due -= ACTUATION_ADVANCE_MS;
-        } else {
-            due = detect_ms; // cannot schedule before detection
+    uint32_t lead_ms = len.dwell_ms + ACTUATION_ADVANCE_MS;
+    uint32_t due = detect_ms + ((delay_ms > lead_ms) ? (delay_ms - lead_ms) : 0);
+    // Removed schedule-time spacing guard. We allow out-of-order scheduling.
+    // Spacing is enforced per diverter at fire time in decide_tick() using s_close_ms[].
+    uint32_t span = detect_ms + delay_ms - due;
+    uint32_t overlap_ms = (len.dwell_ms * DECIDE_MISS_OVERLAP_PCT) / 100U;
+    uint16_t window = late_window(span, overlap_ms, s_belt_mm_per_s, true);
+    return enqueue(pos, due, 0, 0, window, clamp_u16(span), 0, detect_ms, evt_id);
+}
+
+bool decide_schedule_at_position(TargetPosition pos, uint32_t detect_pulses, uint32_t detect_ms, LengthInfo len, uint16_t evt_id) {
+    if (pos == PASS_THROUGH) {
+        log_schedule_reject(detect_ms, evt_id, PSTR("pass-through"));
+        return false;
+    }
+
+    uint16_t d = distance_for_position(pos);
+    uint16_t rate = tb6600_get_step_rate_hz();
+    if (d == 0 || rate == 0) {
+        log_schedule_reject(detect_ms, evt_id, PSTR("invalid-config"));
+        return false;
+    }
+
+    uint32_t full = pulses_for_mm(d);
+    // Open ahead of the leading edge: the block length in pulses plus
+    // ACTUATION_ADVANCE_MS, a time converted at the current step rate
+    uint32_t len_pulses = pulses_for_mm(len.length_mm);
+    uint32_t lead = len_pulses + ((uint32_t)rate * ACTUATION_ADVANCE_MS) / 1000UL;
+    uint32_t travel = (full > lead) ? (full - lead) : 0; // cannot fire before detection
+    uint32_t due_pulses = detect_pulses + travel;
+    // Due-time estimate for logging and ordering only
+    uint32_t due = detect_ms + (travel * 1000UL) / rate;
+    uint32_t overlap = (len_pulses * DECIDE_MISS_OVERLAP_PCT) / 100U;
+    uint16_t window = late_window(full - travel, overlap, rate, false);
+    return enqueue(pos, due, due_pulses, 1, window, clamp_u16(full - travel), rate, detect_ms, evt_id);
+}
+
+// Diverter at pos may fire: it is still open (firing again only extends the
+// hold), or it has rested for its spacing interval since it recentered.
+static bool spacing_ok(uint8_t pos, uint32_t now_ms) {
+    uint8_t bit = (uint8_t)(1U << pos);
+    return !s_min_spacing_ms[pos] || !(s_have_close & bit) ||
+           time_before(now_ms, s_close_ms[pos]) ||
+           time_reached(now_ms, s_close_ms[pos] + s_min_spacing_ms[pos]);
+}
+
+// Drop the k-th item from the head, closing the gap towards the head.
+static void sched_remove(uint8_t k) {
+    if (k == 0) {
+        s_sched_head = sched_slot(1);
+    } else {
+        for (uint8_t j = k; (uint8_t)(j + 1U) < s_sched_count; j++) {
+            s_schedule_queue[sched_slot(j)] = s_schedule_queue[sched_slot((uint8_t)(j + 1U))];
         }
     }
-    // Removed schedule-time spacing guard. We allow out-of-order scheduling.
-    // Spacing is enforced at fire time in decide_tick() using s_last_act_ms.
+    s_sched_count--;
+}
 
-    // throughput guardrail within sliding 60s window
-    if (s_max_blocks_per_min) {
-        if (s_window_start_ms == 0 || (detect_ms - s_window_start_ms) >= 60000U) { s_window_start_ms = detect_ms; s_blocks_in_window = 0; }
-        if (s_blocks_in_window >= s_max_blocks_per_min) { log_schedule_reject(detect_ms, evt_id, "throughput"); return false; }
-        // s_blocks_in_window++; BUG increments before checking queue free slot
+// Item units (ms, or pulses at the rate it was scheduled with) to ms for logs.
+static uint32_t item_ms(const ScheduleItem* it, uint32_t v) {
+    if (!it->by_position) {
+        return v;
     }
+    if (v > 0xFFFFUL) { v = 0xFFFFUL; } // keeps the product in range
+    return it->rate_hz ? (v * 1000UL) / it->rate_hz : 0;
+}
 
-    int8_t idx = find_free_slot();
-    if (idx < 0) { 
-        log_schedule_reject(detect_ms, evt_id, "queue-full"); 
-        return false; 
+// Gate-open time for an item firing `late` past its due point: until the
+// trailing edge has passed the diverter, plus SERVO_RELEASE_MS. Position-keyed
+// items convert at the current step rate (rate_hz); a stopped belt holds the
+// gate for SERVO_HOLD_MAX_MS.
+static uint16_t hold_ms(const ScheduleItem* it, uint32_t late, uint16_t rate_hz) {
+    uint32_t left = (it->span > late) ? (it->span - late) : 0; // <= 0xFFFF
+    uint32_t ms;
+    if (!it->by_position) {
+        ms = left;
+    } else if (rate_hz) {
+        ms = (left * 1000UL) / rate_hz;
+    } else {
+        return SERVO_HOLD_MAX_MS;
     }
-    s_schedule_queue[idx].pos = pos;
-    s_schedule_queue[idx].t_due_ms = due;
-    s_schedule_queue[idx].active = 1;
-    s_schedule_queue[idx].event_id = evt_id;
-    s_last_due_ms = due;
-    s_blocks_in_window++; // Moved here since can fail in the if case above.
-    log_schedule(detect_ms, pos, due, evt_id);
-    return true;
+    ms += SERVO_RELEASE_MS;
+    return (ms > SERVO_HOLD_MAX_MS) ? SERVO_HOLD_MAX_MS : (uint16_t)ms;
 }
 
 void decide_tick(uint32_t now_ms) {
-    // Enforce min spacing between actual firings
-    if (s_min_spacing_ms && s_last_act_ms && (now_ms < (s_last_act_ms + s_min_spacing_ms))) { 
-        return; 
-    }
-    // Find earliest due item ready to fire
-    int8_t best_i = -1;
-    uint32_t best_due = 0xFFFFFFFFUL;
-    for (uint8_t i = 0; i < SCHED_CAPACITY; i++) {
-        if (s_schedule_queue[i].active && s_schedule_queue[i].t_due_ms <= now_ms) {
-            if (s_schedule_queue[i].t_due_ms < best_due) { 
-                best_due = s_schedule_queue[i].t_due_ms; 
-                best_i = i; 
+    // Earliest due item whose diverter is out of its spacing interval. The
+    // queue is sorted, so the first item not yet due ends the walk; due items
+    // past their lateness window are dropped on the way.
+    uint32_t belt_pulses = 0;
+    uint8_t have_belt = 0; // read the belt position at most once, and only if needed
+    int16_t pick = -1;
+    uint32_t pick_late = 0;
+    uint8_t k = 0;
+    while (k < s_sched_count) {
+        const ScheduleItem* c = &s_schedule_queue[sched_slot(k)];
+        int32_t late; // past the due point, in the item's units
+        if (c->by_position) {
+            if (!have_belt) {
+                belt_pulses = tb6600_get_position_pulses();
+                have_belt = 1;
             }
+            late = (int32_t)(belt_pulses - c->due_pulses);
+        } else {
+            late = (int32_t)(now_ms - c->t_due_ms);
+        }
+        if (late < 0) {
+            break;
+        }
+        if ((uint32_t)late > c->window) {
+            // The block has gone by: firing now would divert nothing (or the next block)
+            s_missed++;
+            log_missed(now_ms, (TargetPosition)c->pos, c->event_id, item_ms(c, (uint32_t)late));
+            trace_close(c->event_id);
+            sched_remove(k);
+            continue;
         }
+        if (spacing_ok(c->pos, now_ms)) {
+            pick = k;
+            pick_late = (uint32_t)late;
+            break;
+        }
+        k++;
     }
-
-    // No due item found
-    if (best_i < 0) { // BUG! Was >
+    if (pick < 0) {
         return; 
     }
 
-    actuate_fire(s_schedule_queue[best_i].pos);
-    log_actuate(now_ms, s_schedule_queue[best_i].pos, s_schedule_queue[best_i].event_id);
-    s_schedule_queue[best_i].active = 0;
-    s_last_act_ms = now_ms;
+    ScheduleItem it = s_schedule_queue[sched_slot((uint8_t)pick)];
+    sched_remove((uint8_t)pick);
+    uint16_t rate = it.by_position ? tb6600_get_step_rate_hz() : 0;
+    uint16_t hold = hold_ms(&it, pick_late, rate);
+    actuate_fire_for((TargetPosition)it.pos, hold);
+#if INSTR_ENABLE
+    if (it.by_position) {
+        // Overshoot in pulses at the current step rate (capped to keep the product in range)
+        uint32_t over = pick_late;
+        if (over > 4000UL) { over = 4000UL; }
+        instr_actuation_late_us(rate ? (over * 1000000UL) / rate : 0);
+    } else {
+        instr_actuation_late_us(pick_late * 1000UL);
+    }
+#endif
+    // Slack: how much of the lateness window was left
+    log_actuate(now_ms, (TargetPosition)it.pos, it.event_id, item_ms(&it, it.window - pick_late));
+    trace_fire(it.event_id, (TargetPosition)it.pos, now_ms);
+    s_close_ms[it.pos] = now_ms + hold;
+    s_have_close |= (uint8_t)(1U << it.pos);
+}
+
+uint32_t decide_missed_count(void) {
+    return s_missed;
+}
+
+uint8_t decide_queue_depth(void) {
+    return s_sched_count;
+}
+
+uint8_t decide_queue_high_water(void) {
+    return s_sched_high_water;
 }
 
 uint32_t decide_last_due_ms(void) {
@@ -11,12 +11,24 @@ typedef enum { POS1, POS2, POS3, PASS_THROUGH } TargetPosition;
 
 void decide_init(void);
 
-/** Set minimum spacing between actuations (ms). 0 disables the guardrail. */
+/** Set the minimum spacing between actuations of the same diverter (ms) for
+ * all diverters. 0 disables the guardrail. Different diverters never hold
+ * each other back.
+ */
 void decide_set_min_spacing_ms(uint16_t ms);
 
+/** Set the minimum spacing for one diverter (POS1..POS3; others are ignored). */
+void decide_set_position_min_spacing_ms(TargetPosition pos, uint16_t ms);
+
+/** Minimum spacing of one diverter (ms), 0 if disabled or not a diverter. */
+uint16_t decide_get_position_min_spacing_ms(TargetPosition pos);
+
 /** Set maximum blocks per minute allowed. 0 disables throughput limiting. */
 void decide_set_max_blocks_per_min(uint8_t bpm);
 
+/** Maximum blocks per minute allowed, 0 if throughput limiting is disabled. */
+uint8_t decide_get_max_blocks_per_min(void);
+
 /** Set belt speed in mm/s (runtime override of default). Must be > 0. */
 void decide_set_belt_mm_per_s(uint16_t v);
 
@@ -30,12 +42,38 @@ TargetPosition decide_route(Color color, LengthClass cls);
 // Schedule an actuation for a given target position; evt_id correlates to the detection
 /** Schedule a future actuation for the selected position.
  * Applies spacing/throughput guardrails; logs accept/reject.
+ * @param detect_ms Time the block's trailing edge left the sensor.
+ * @param len       Measured block length; sets how late the actuation may
+ *                  still fire before it is dropped as MISSED.
  * @return true if accepted, false if rejected.
  */
-bool decide_schedule(TargetPosition pos, uint32_t detect_ms, uint16_t evt_id);
+bool decide_schedule(TargetPosition pos, uint32_t detect_ms, LengthInfo len, uint16_t evt_id);
 
-/** Service the scheduler and trigger any due actuations. */
+/** Schedule a future actuation keyed on belt position instead of time.
+ * The target is detect_pulses plus the diverter distance converted to STEP
+ * pulses (less ACTUATION_ADVANCE_MS at the current step rate); decide_tick()
+ * fires it once tb6600_get_position_pulses() reaches the target, so speed
+ * changes while the block is in flight do not shift the firing point.
+ * @param detect_pulses Belt position (pulses) at the detection timestamp.
+ * @param detect_ms     Detection timestamp (logging, throughput window).
+ * @param len           Measured block length (lateness window, as above).
+ * @return true if accepted, false if rejected.
+ */
+bool decide_schedule_at_position(TargetPosition pos, uint32_t detect_pulses, uint32_t detect_ms, LengthInfo len, uint16_t evt_id);
+
+/** Service the scheduler and trigger any due actuations. Items that are
+ * past their lateness window are dropped with a MISSED log instead.
+ */
 void decide_tick(uint32_t now_ms);
+
+/** Actuations dropped as MISSED since decide_init(). */
+uint32_t decide_missed_count(void);
+
+/** Actuations currently queued. */
+uint8_t decide_queue_depth(void);
+
+/** Most actuations queued at once since decide_init(); use it to size SCHED_CAPACITY. */
+uint8_t decide_queue_high_water(void);
 // Optional accessor for last scheduled actuation time (ms), 0 if none
 /** Last scheduled actuation due time (ms), or 0 if none. */
 uint32_t decide_last_due_ms(void);
@@ -4,16 +4,21 @@
  * - Hooks the VL6180 GPIO1 pin (active-low) to INT0 (D2) and latches a flag in
  *   the ISR for the sense module to consume.
  * - Also sets up a presence LED GPIO.
- * - Keep this lightweight: the ISR only flips a flag; real work happens in sense.c.
+ * - Keep this lightweight: the ISR only flips a flag and timestamps the edge
+ *   with micros(), so sense.c can use the true edge time rather than the time
+ *   it next polled; real work happens in sense.c.
  */
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdbool.h>
 #include "platform/pins.h"
 #include "hal/gpio.h"
+#include "hal/timers.h"
+#include "utils/instr.h"
 #include "app/interrupts.h"
 
 static volatile uint8_t s_vl6180_flag = 0;
+static volatile uint32_t s_vl6180_edge_us = 0; // micros() at the latest edge
 
 void interrupts_init(void) {
     // INT0 on D2 for VL6180 - FALLING edge (GPIO1 active-low)
@@ -24,7 +29,10 @@ void interrupts_init(void) {
 }
 
 ISR(INT0_vect) {
+    INSTR_ISR_BEGIN();
+    s_vl6180_edge_us = micros();
     s_vl6180_flag = 1;
+    INSTR_ISR_END(INSTR_ISR_INT0);
 }
 
 bool vl6180_event(void) {
@@ -33,6 +41,15 @@ bool vl6180_event(void) {
     return f != 0;
 }
 
+uint32_t vl6180_event_time_us(void) {
+    uint32_t t;
+    uint8_t s = SREG;
+    cli();
+    t = s_vl6180_edge_us;
+    SREG = s;
+    return t;
+}
+
 uint8_t vl6180_int_pin_level(void) {
     // Read INT pin level via HAL
     return (gpio_read(GPIO_PIN_VL6180_INT) == GPIO_HIGH) ? 1 : 0;
@@ -14,6 +14,9 @@ void interrupts_init(void);
  */
 bool vl6180_event(void);
 
+/** micros() timestamp captured in the INT0 ISR for the latest VL6180 edge. */
+uint32_t vl6180_event_time_us(void);
+
 /** Read the current electrical level on the INT0 pin (D2).
  * @return 0 if low, 1 if high.
  */
@@ -2,72 +2,146 @@
  * Sense module: detect + measure + classify
  * -----------------------------------------
  * Responsibilities:
- * - Run the VL6180 ToF in single-shot mode at a steady cadence and detect when
- *   a block is present (HIGH-LOW interrupt) and when it has left (quiet timeout).
+ * - Run the VL6180 ToF in continuous mode and detect when a block is present
+ *   (LOW-threshold interrupt) and when it has left (HIGH-threshold interrupt,
+ *   threshold + hysteresis). Each edge flips the sensor to the other mode, so
+ *   a result is ready about one measurement period after the block leaves.
  * - Track a "session" from detect to clear and compute length from dwell time
- *   and the current belt speed.
+ *   and the current belt speed. Event times are the INT0 edge times captured
+ *   in the ISR (micros()), back-dated into the millis() timebase, so poll
+ *   latency does not enter length or schedule calculations.
  * - Sample the APDS-9960 color sensor during the session and average the samples
- *   for a robust color classification at the end of the session.
+ *   for a robust color classification at the end of the session. Samples are
+ *   read asynchronously: one poll starts the burst read, a later poll collects it.
+ * Pipeline:
+ * - Sessions live in SENSE_SLOTS slots: one collecting (block at the sensor)
+ *   and the ones that ended and are finalizing. A slot finalizes once the
+ *   color read it started has landed, so the next block can start collecting
+ *   in another slot right away instead of waiting for (or merging into) the
+ *   previous one.
+ * - Finished results go to a FIFO of SENSE_RESULT_QUEUE_LEN entries; each
+ *   sense_poll() hands out the oldest one.
  * Key timing knobs:
- * - VL6180_MEAS_PERIOD_MS: interval between single shots.
- * - VL6180_QUIET_TIMEOUT_MS: how long without new events before ending a session.
+ * - VL6180_MEAS_PERIOD_MS: interval between measurements (and color samples).
+ * - VL6180_SESSION_TIMEOUT_MS: fallback if the exit interrupt is lost; such a
+ *   result is flagged ambiguous since its length is unknown.
  * Outputs:
  * - SenseResult with DetectEvent timestamps, LengthInfo, color, and ambiguous flag.
+ * - With SENSE_COLOR_DEBUG and the debug log category on, one record per
+ *   result, printed later by sense_debug_tick() when the UART has room
+ *   (formatting stays off the path from block exit to scheduling):
+ *     color: n=<samples> r=... g=... b=... c=... class=<Color> amb=0|1 [lost=N]
+ *   lost counts records overwritten before they could be printed.
  */
 #include <stdint.h>
 #include <stdbool.h>
-#include <stdio.h>
 
 //#include <avr/io.h>
 #include "platform/config.h"
 #include "platform/pins.h"
-//#include "utils/log.h"
+#include "platform/progmem.h"
+#include "utils/log.h"
 #include "app/sense.h"
 #include "hal/timers.h"
 #include "hal/gpio.h"
+#include "utils/time_util.h"
+#include "utils/fmt.h"
 #include "app/interrupts.h"
 #include "app/decide.h"
 #include "drivers/apds9960.h"
 #include "drivers/vl6180.h"
 #include "hal/uart.h"
 
+#if SENSE_SLOTS < 2 || SENSE_RESULT_QUEUE_LEN < 1
+#error "SENSE_SLOTS must be >= 2 and SENSE_RESULT_QUEUE_LEN >= 1"
+#endif
+
+enum { SLOT_FREE = 0, SLOT_COLLECTING, SLOT_FINALIZING };
+
+// One session: detection times and the APDS9960 samples accumulated for
+// robust color classification
+typedef struct {
+    DetectEvent ev;
+    uint32_t r_sum, g_sum, b_sum, c_sum;
+    uint16_t n;           // samples accumulated
+    uint8_t state;
+    uint8_t timed_out;    // ended on the fallback timeout (length unknown)
+    uint8_t late_read;    // a read was started after the session ended
+    uint8_t seq;          // end order, to finalize oldest first
+} SenseSlot;
+
 // Session tracking
 static uint8_t s_session_active = 0; // 0=idle,1=session active (object close)
-static DetectEvent s_current_event;
+static SenseSlot s_slots[SENSE_SLOTS];
+static uint8_t s_cur = 0;            // collecting slot (or the one that collected last)
+static uint8_t s_end_seq = 0;
 static uint32_t s_last_interrupt_ms = 0;
 static uint32_t s_last_color_sample_ms = 0; // reused as color-sample cadence
 static uint16_t s_above_count = 0; // consecutive samples >= threshold
-// Accumulate APDS9960 samples while session active for robust color classification
-static uint32_t s_col_r_sum = 0, s_col_g_sum = 0, s_col_b_sum = 0, s_col_c_sum = 0;
-static uint16_t s_color_sample_count = 0;
+static uint8_t s_color_read_pending = 0; // async APDS read in flight on the TWI engine
+static uint8_t s_read_owner = 0;         // slot the in-flight read belongs to
+// Finished results, oldest at s_res_head
+static SenseResult s_results[SENSE_RESULT_QUEUE_LEN];
+static uint8_t s_res_head = 0;
+static uint8_t s_res_count = 0;
+
+#if SENSE_COLOR_DEBUG
+// What finalize knew about the color, kept raw until the UART has room
+typedef struct {
+    uint16_t n;
+    uint16_t r, g, b, c;
+    uint8_t cls;
+    uint8_t amb;
+} ColorDebugRec;
+
+static ColorDebugRec s_dbg[SENSE_COLOR_DEBUG_LEN];
+static uint8_t s_dbg_head = 0;
+static uint8_t s_dbg_count = 0;
+static uint16_t s_dbg_lost = 0;
+#endif
 
+static void reset_pipeline(void) {
+    for (uint8_t i = 0; i < SENSE_SLOTS; i++) {
+        s_slots[i].state = SLOT_FREE;
+    }
+    s_res_head = 0;
+    s_res_count = 0;
+#if SENSE_COLOR_DEBUG
+    s_dbg_head = 0;
+    s_dbg_count = 0;
+    s_dbg_lost = 0;
+#endif
+}
 
 void sense_init(void) {
     s_session_active = 0;
-    s_current_event.present = 0;
+    reset_pipeline();
+    s_cur = 0;
+    s_slots[s_cur].ev.present = 0;
     s_last_interrupt_ms = 0;
     s_last_color_sample_ms = 0;
     s_above_count = 0;
-    s_col_r_sum = 0;
-    s_col_g_sum = 0;
-    s_col_b_sum = 0;
-    s_col_c_sum = 0;
-    s_color_sample_count = 0;
-    uart_write("sense: vl6180_init\r\n");
+    s_slots[s_cur].r_sum = 0;
+    s_slots[s_cur].g_sum = 0;
+    s_slots[s_cur].b_sum = 0;
+    s_slots[s_cur].c_sum = 0;
+    s_slots[s_cur].n = 0;
+    s_color_read_pending = 0;
+    uart_write_P(PSTR("sense: vl6180_init\r\n"));
     vl6180_init();
-    uart_write("sense: vl6180_config\r\n");
-    // Configure high-threshold at 6 cm (threshold) as requested; hysteresis not used in this mode
+    uart_write_P(PSTR("sense: vl6180_config\r\n"));
+    // Arrival below 6 cm (LOW), departure above 6 cm + hysteresis (HIGH)
     vl6180_config_threshold_mm(TOF_THRESHOLD_MM, TOF_HYST_MM);
-    uart_write("sense: apds9960_init\r\n");
+    uart_write_P(PSTR("sense: apds9960_init\r\n"));
     apds9960_init();
-    uart_write("sense: done\r\n");
+    uart_write_P(PSTR("sense: done\r\n"));
     // Start continuous ranging; interrupts signal events. Use s_last_color_sample_ms to cadence APDS sampling
     // while a session is active (no VL6180 polling in the main loop).
     s_last_color_sample_ms = millis();
 }
 
 static void compute_length(uint32_t t_enter, uint32_t t_exit, LengthInfo* out) {
-    uint32_t dwell = (t_exit >= t_enter) ? (t_exit - t_enter) : 0;
+    uint32_t dwell = time_before(t_exit, t_enter) ? 0 : time_elapsed_ms(t_exit, t_enter);
     out->dwell_ms = dwell;
     // Use runtime belt speed from decide module (set at boot from TB6600 step rate)
     uint16_t belt = decide_get_belt_mm_per_s();
@@ -83,11 +157,22 @@ static void compute_length(uint32_t t_enter, uint32_t t_exit, LengthInfo* out) {
 
 // --- Internal helpers to keep sense_poll small and readable ---
 static inline void reset_color_accum(void) {
-    s_col_r_sum = 0;
-    s_col_g_sum = 0;
-    s_col_b_sum = 0;
-    s_col_c_sum = 0;
-    s_color_sample_count = 0;
+    SenseSlot* sl = &s_slots[s_cur];
+    sl->r_sum = 0;
+    sl->g_sum = 0;
+    sl->b_sum = 0;
+    sl->c_sum = 0;
+    sl->n = 0;
+}
+
+static inline void add_color_sample(SenseSlot* sl, uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
+    sl->r_sum += r;
+    sl->g_sum += g;
+    sl->b_sum += b;
+    sl->c_sum += c;
+    if (sl->n < 0xFFFF) {
+        sl->n++;
+    }
 }
 
 static inline void accumulate_color_sample(void) {
@@ -96,66 +181,102 @@ static inline void accumulate_color_sample(void) {
     uint16_t raw_b;
     uint16_t raw_clear;
     if (apds9960_read_rgbc(&raw_r, &raw_g, &raw_b, &raw_clear)) {
-        s_col_r_sum += raw_r;
-        s_col_g_sum += raw_g;
-        s_col_b_sum += raw_b;
-        s_col_c_sum += raw_clear;
-        if (s_color_sample_count < 0xFFFF) {
-            s_color_sample_count++;
+        add_color_sample(&s_slots[s_cur], raw_r, raw_g, raw_b, raw_clear);
+    }
+}
+
+// Non-blocking counterpart: pick up a read started on an earlier poll. The
+// sample belongs to the session that started it, even if that one has ended.
+static inline void collect_color_sample(uint32_t now_ms) {
+    uint16_t raw_r;
+    uint16_t raw_g;
+    uint16_t raw_b;
+    uint16_t raw_clear;
+    int8_t st = apds9960_read_rgbc_result(&raw_r, &raw_g, &raw_b, &raw_clear);
+    if (st == 0) {
+        // Still on the bus; give up if it has been stuck for too long
+        if (time_elapsed_ms(now_ms, s_last_color_sample_ms) > TWI_ASYNC_TIMEOUT_MS) {
+            apds9960_read_rgbc_cancel();
+            s_color_read_pending = 0;
         }
+        return;
+    }
+    s_color_read_pending = 0;
+    if (st > 0) {
+        add_color_sample(&s_slots[s_read_owner], raw_r, raw_g, raw_b, raw_clear);
     }
 }
 
 static inline void start_session(uint32_t now_ms) {
     s_session_active = 1;
-    s_current_event.present = 1;
-    s_current_event.t_enter_ms = now_ms;
+    s_slots[s_cur].state = SLOT_COLLECTING;
+    s_slots[s_cur].timed_out = 0;
+    s_slots[s_cur].late_read = 0;
+    s_slots[s_cur].ev.present = 1;
+    s_slots[s_cur].ev.t_enter_ms = now_ms;
     s_above_count = 0;
     reset_color_accum();
     // Light presence LED while object is present at ToF
     gpio_write(GPIO_PIN_PRESENCE_LED, GPIO_HIGH);
 }
 
+// Collecting session ends; its slot goes on to finalize.
 static inline void end_session(uint32_t end_ms) {
     s_session_active = 0;
-    s_current_event.present = 0;
-    s_current_event.t_exit_ms = end_ms;
+    s_slots[s_cur].state = SLOT_FINALIZING;
+    s_slots[s_cur].seq = s_end_seq++;
+    s_slots[s_cur].ev.present = 0;
+    s_slots[s_cur].ev.t_exit_ms = end_ms;
     s_above_count = 0;
     gpio_write(GPIO_PIN_PRESENCE_LED, GPIO_LOW); // BUG?, MISSING LED OFF
 }
 
-// In low-threshold interrupt mode, VL6180 asserts GPIO1 when range < LOW threshold.
-// We use quiet-timeout to end the session once events stop arriving.
+// Convert the ISR-captured edge time to the millis() timebase by subtracting
+// how long ago it happened; this removes main-loop latency from timestamps.
+static inline uint32_t event_time_ms(uint32_t now_ms) {
+    uint32_t edge_us = vl6180_event_time_us();
+    uint32_t lag_us = time_elapsed_us(micros(), edge_us);
+    if (lag_us > 0x7FFFFFFFUL) {
+        return now_ms; // edge stamped after now was read
+    }
+    return now_ms - lag_us / 1000UL;
+}
 
-static inline bool session_should_end(uint32_t now_ms) {
-    if (!s_session_active) { 
-        return false; 
+// Switch the VL6180 to the next event we wait for and clear the latched
+// interrupt in one queued write. If the queue is full fall back to the
+// blocking write, which waits for a free slot, so the re-arm is not lost.
+static inline void arm_sensor(Vl6180IntMode mode) {
+    if (!vl6180_set_interrupt_mode_async(mode)) {
+        vl6180_set_interrupt_mode(mode);
     }
-    // End session when no new INT events have occurred for the quiet timeout.
-    // Avoid ending merely due to long above-threshold sequences.
-    bool quiet_timeout = (now_ms - s_last_interrupt_ms) > VL6180_QUIET_TIMEOUT_MS;
-    return quiet_timeout;
 }
 
-static inline void finalize_result(SenseResult* out) {
-    if (!out) {
-        return;
+// While a block is present the sensor is in HIGH mode and stays silent, so a
+// session that sees no interrupt for this long has lost its exit event.
+static inline bool session_should_end(uint32_t now_ms) {
+    if (!s_session_active) {
+        return false;
     }
-    out->ev = s_current_event;
-    compute_length(s_current_event.t_enter_ms, s_current_event.t_exit_ms, &out->length);
+    bool timed_out = time_elapsed_ms(now_ms, s_last_interrupt_ms) > VL6180_SESSION_TIMEOUT_MS;
+    return timed_out;
+}
+
+static void finalize_slot(SenseSlot* sl, SenseResult* out) {
+    out->ev = sl->ev;
+    compute_length(sl->ev.t_enter_ms, sl->ev.t_exit_ms, &out->length);
     // Use aggregated APDS9960 samples collected during the session; if none, take a single read now
     uint16_t r;
     uint16_t g;
     uint16_t b;
     uint16_t c;
-    if (s_color_sample_count > 0) {
-        r = (uint16_t)(s_col_r_sum / s_color_sample_count);
-        g = (uint16_t)(s_col_g_sum / s_color_sample_count);
-        b = (uint16_t)(s_col_b_sum / s_color_sample_count);
-        c = (uint16_t)(s_col_c_sum / s_color_sample_count);
+    if (sl->n > 0) {
+        r = (uint16_t)(sl->r_sum / sl->n);
+        g = (uint16_t)(sl->g_sum / sl->n);
+        b = (uint16_t)(sl->b_sum / sl->n);
+        c = (uint16_t)(sl->c_sum / sl->n);
     } else {
         apds9960_read_rgbc(&r, &g, &b, &c);
-        s_color_sample_count = 1; // for logging
+        sl->n = 1; // for logging
     }
     uint8_t is_ambiguous = 0;
     if (c < 50) {
@@ -164,40 +285,208 @@ static inline void finalize_result(SenseResult* out) {
     Color col = apds9960_classify(r, g, b, c);
     out->color = col;
     out->ambiguous = is_ambiguous;
-    char cbuf[112];
-    snprintf(cbuf, sizeof(cbuf), "color: n=%u r=%u g=%u b=%u c=%u class=%u amb=%u\r\n", (unsigned)s_color_sample_count, r, g, b, c, (unsigned)col, (unsigned)is_ambiguous);
-    uart_write(cbuf);
+#if SENSE_COLOR_DEBUG
+    if (LOG_ON(LOG_CAT_DEBUG)) {
+        if (s_dbg_count == SENSE_COLOR_DEBUG_LEN) {
+            // Drop the oldest record
+            s_dbg_head = (uint8_t)((s_dbg_head + 1U) % SENSE_COLOR_DEBUG_LEN);
+            s_dbg_count--;
+            if (s_dbg_lost < 0xFFFFU) {
+                s_dbg_lost++;
+            }
+        }
+        ColorDebugRec* d = &s_dbg[(uint8_t)((s_dbg_head + s_dbg_count) % SENSE_COLOR_DEBUG_LEN)];
+        d->n = sl->n;
+        d->r = r;
+        d->g = g;
+        d->b = b;
+        d->c = c;
+        d->cls = (uint8_t)col;
+        d->amb = is_ambiguous;
+        s_dbg_count++;
+    }
+#endif
+    if (sl->timed_out) {
+        out->ambiguous = 1; // exit time unknown, so is the length
+    }
+}
+
+static inline void finalize_result(SenseResult* out) {
+    if (!out) {
+        return;
+    }
+    finalize_slot(&s_slots[s_cur], out);
+}
+
+// Oldest slot waiting to finalize, or SENSE_SLOTS if none
+static uint8_t oldest_finalizing(void) {
+    uint8_t best = SENSE_SLOTS;
+    for (uint8_t i = 0; i < SENSE_SLOTS; i++) {
+        if (s_slots[i].state == SLOT_FINALIZING &&
+            (best == SENSE_SLOTS || (int8_t)(s_slots[i].seq - s_slots[best].seq) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Finalize one slot into the result FIFO. Unless forced, a slot whose color
+// read is still on the bus waits for it, and a slot without samples first
+// gets one asynchronous read (finalize_slot() falls back to a blocking one).
+static bool finalize_step(bool force, uint32_t now_ms) {
+    uint8_t i = oldest_finalizing();
+    if (i == SENSE_SLOTS || s_res_count >= SENSE_RESULT_QUEUE_LEN) {
+        return false;
+    }
+    if (s_color_read_pending && s_read_owner == i) {
+        if (!force) {
+            return false;
+        }
+        apds9960_read_rgbc_cancel();
+        s_color_read_pending = 0;
+    }
+    if (!force && s_slots[i].n == 0 && !s_slots[i].late_read && !s_color_read_pending) {
+        s_slots[i].late_read = 1;
+        if (apds9960_read_rgbc_async()) {
+            s_color_read_pending = 1;
+            s_read_owner = i;
+            s_last_color_sample_ms = now_ms;
+            return false;
+        }
+    }
+    SenseResult* out = &s_results[(uint8_t)((s_res_head + s_res_count) % SENSE_RESULT_QUEUE_LEN)];
+    finalize_slot(&s_slots[i], out);
+    s_slots[i].state = SLOT_FREE;
+    s_res_count++;
+    return true;
+}
+
+// Pick a slot for a new session. If every slot is still finalizing, finish
+// the oldest one now; if the result FIFO is full too (main has not polled for
+// several blocks), that session is dropped.
+static void claim_slot(uint32_t now_ms) {
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        for (uint8_t k = 1; k <= SENSE_SLOTS; k++) {
+            uint8_t i = (uint8_t)((s_cur + k) % SENSE_SLOTS);
+            if (s_slots[i].state == SLOT_FREE) {
+                s_cur = i;
+                return;
+            }
+        }
+        if (!finalize_step(true, now_ms)) {
+            break;
+        }
+    }
+    s_cur = oldest_finalizing();
+    if (s_color_read_pending && s_read_owner == s_cur) {
+        apds9960_read_rgbc_cancel();
+        s_color_read_pending = 0;
+    }
 }
 
 int sense_poll(SenseResult* out) {
     uint32_t now = millis();
     // Handle VL6180 GPIO event: read range and manage session start.
+    // Handle VL6180 GPIO event: idle -> LOW event = block arrived,
+    // active -> HIGH event = block left.
+    bool left = false;
     if (vl6180_event()) {
-        uint8_t st = 0;
-        uint8_t rng = 0;
-        vl6180_read_status_range(&st, &rng);
-        vl6180_clear_interrupt();
-        s_last_interrupt_ms = now;
+        uint32_t edge_ms = event_time_ms(now);
+        s_last_interrupt_ms = edge_ms;
         if (!s_session_active) {
-            // In low-threshold mode, any event implies range < LOW; start session on first event.
-            start_session(now);
-            uart_write("Block detected!\r\n");
+            arm_sensor(VL6180_INT_HIGH); // next: wait for the block to leave
+            claim_slot(now);
+            start_session(edge_ms);
+            if (LOG_ON(LOG_CAT_DETECT)) {
+                uart_write_P(PSTR("Block detected!\r\n"));
+            }
+        } else {
+            arm_sensor(VL6180_INT_LOW); // next: wait for the next block
+            left = true;
         }
     }
 
-    // While active, sample APDS on a time cadence; avoid work when idle.
-    if (s_session_active && ((now - s_last_color_sample_ms) >= VL6180_MEAS_PERIOD_MS)) {
-        accumulate_color_sample();
-        s_last_color_sample_ms = now;
+    // Collect the APDS sample started on an earlier poll once the TWI engine is done.
+    if (s_color_read_pending) {
+        collect_color_sample(now);
     }
 
-    // If active but quiet for too long, end session at last interrupt time
-    if (session_should_end(now)) {
-        end_session(s_last_interrupt_ms);  // no bug: multiple interrupts while block present
-        finalize_result(out);
-        return 1;
+    // End at the exit edge, or (exit event lost) at the fallback timeout
+    bool timed_out = !left && session_should_end(now);
+    if (left || timed_out) {
+        if (timed_out) {
+            arm_sensor(VL6180_INT_LOW);
+        }
+        end_session(left ? s_last_interrupt_ms : now);
+        s_slots[s_cur].timed_out = timed_out ? 1U : 0U;
     }
-    return 0;
+    // Classify the oldest ended session whose samples are all in
+    finalize_step(false, now);
+
+    // While active, start an APDS read on a time cadence; avoid work when idle.
+    // The burst read runs in the TWI ISR, so this returns immediately.
+    if (s_session_active && !s_color_read_pending && (time_elapsed_ms(now, s_last_color_sample_ms) >= VL6180_MEAS_PERIOD_MS)) {
+        if (apds9960_read_rgbc_async()) {
+            s_color_read_pending = 1;
+            s_read_owner = s_cur;
+            s_last_color_sample_ms = now;
+        }
+    }
+
+    if (!s_res_count) {
+        return 0;
+    }
+    if (out) {
+        *out = s_results[s_res_head];
+    }
+    s_res_head = (uint8_t)((s_res_head + 1U) % SENSE_RESULT_QUEUE_LEN);
+    s_res_count--;
+    return 1;
+}
+
+#if SENSE_COLOR_DEBUG
+// s is a flash string (PSTR)
+static uint8_t put_str(char* buf, uint8_t i, const char* s) {
+    char ch;
+    while ((ch = (char)pgm_read_byte(s++)) != '\0') {
+        buf[i++] = ch;
+    }
+    return i;
+}
+
+// Longest "color:" line: 16-bit n/r/g/b/c/lost, 8-bit class/amb
+#define SENSE_DEBUG_LINE_MAX (9U + 5U + 4U * (3U + 5U) + 7U + 3U + 5U + 3U + 6U + 5U + 2U)
+
+static uint8_t put_kv(char* buf, uint8_t i, const char* key, uint16_t v) {
+    i = put_str(buf, i, key);
+    return (uint8_t)(i + fmt_u32(&buf[i], v));
+}
+#endif
+
+void sense_debug_tick(void) {
+#if SENSE_COLOR_DEBUG
+    if (!s_dbg_count || uart_tx_free() < SENSE_DEBUG_LINE_MAX) {
+        return;
+    }
+    const ColorDebugRec* d = &s_dbg[s_dbg_head];
+    char line[SENSE_DEBUG_LINE_MAX + 1U];
+    uint8_t i = put_kv(line, 0, PSTR("color: n="), d->n);
+    i = put_kv(line, i, PSTR(" r="), d->r);
+    i = put_kv(line, i, PSTR(" g="), d->g);
+    i = put_kv(line, i, PSTR(" b="), d->b);
+    i = put_kv(line, i, PSTR(" c="), d->c);
+    i = put_kv(line, i, PSTR(" class="), d->cls);
+    i = put_kv(line, i, PSTR(" amb="), d->amb);
+    if (s_dbg_lost) {
+        i = put_kv(line, i, PSTR(" lost="), s_dbg_lost);
+        s_dbg_lost = 0;
+    }
+    i = put_str(line, i, PSTR("\r\n"));
+    line[i] = '\0';
+    uart_write(line);
+    s_dbg_head = (uint8_t)((s_dbg_head + 1U) % SENSE_COLOR_DEBUG_LEN);
+    s_dbg_count--;
+#endif
 }
 
 
@@ -212,21 +501,31 @@ bool t_session_should_end(uint32_t now_ms) { return session_should_end(now_ms);
 void t_finalize_result(SenseResult* out) { finalize_result(out); }
 
 /// Functions for TESTING internal variables ///
+// They act on the current slot, as if the pipeline had a single session.
 uint8_t get_session_active() { return s_session_active; }
-DetectEvent get_current_event() { return s_current_event; }
+DetectEvent get_current_event() { return s_slots[s_cur].ev; }
 uint32_t get_last_interrupt_ms() { return s_last_interrupt_ms; }
 uint32_t get_last_color_sample_ms() { return s_last_color_sample_ms; }
 uint16_t get_above_count() { return s_above_count; }
-uint32_t get_col_r_sum() { return s_col_r_sum; }
-uint32_t get_col_g_sum() { return s_col_g_sum; }
-uint32_t get_col_b_sum() { return s_col_b_sum; }
-uint32_t get_col_c_sum() { return s_col_c_sum; }
-uint16_t get_color_sample_count() { return s_color_sample_count; }
-
-void set_session_active(uint8_t i) { s_session_active = i; }
-void set_current_event(DetectEvent de) { s_current_event = de; }
+uint32_t get_col_r_sum() { return s_slots[s_cur].r_sum; }
+uint32_t get_col_g_sum() { return s_slots[s_cur].g_sum; }
+uint32_t get_col_b_sum() { return s_slots[s_cur].b_sum; }
+uint32_t get_col_c_sum() { return s_slots[s_cur].c_sum; }
+uint16_t get_color_sample_count() { return s_slots[s_cur].n; }
+uint8_t get_color_read_pending() { return s_color_read_pending; }
+uint8_t get_result_count() { return s_res_count; }
+
+// Also drops other sessions and queued results left over from earlier tests
+void set_session_active(uint8_t i) {
+    reset_pipeline();
+    s_session_active = i;
+    s_slots[s_cur].state = i ? SLOT_COLLECTING : SLOT_FREE;
+    s_slots[s_cur].timed_out = 0;
+}
+void set_current_event(DetectEvent de) { s_slots[s_cur].ev = de; }
 void set_last_interrupt(uint32_t i) { s_last_interrupt_ms = i; }
 void set_last_color_sample(uint32_t i) { s_last_color_sample_ms = i; }
 void set_above_count(uint16_t i) { s_above_count = i; }
-void set_col_sums(uint32_t i[]) { s_col_r_sum = i[0]; s_col_g_sum = i[1]; s_col_b_sum = i[2]; s_col_c_sum = i[3]; }
-void set_color_sample_count(uint16_t i) { s_color_sample_count = i; }
+void set_col_sums(uint32_t i[]) { s_slots[s_cur].r_sum = i[0]; s_slots[s_cur].g_sum = i[1]; s_slots[s_cur].b_sum = i[2]; s_slots[s_cur].c_sum = i[3]; }
+void set_color_sample_count(uint16_t i) { s_slots[s_cur].n = i; }
+void set_color_read_pending(uint8_t i) { s_color_read_pending = i; s_read_owner = s_cur; }
@@ -32,12 +32,19 @@ typedef struct {
 void sense_init(void);
 
 /** Poll the sensing pipeline; returns a completed result when available.
- * Non-blocking; accumulates APDS samples during active detections.
+ * Non-blocking; accumulates APDS samples during active detections. A block
+ * that arrives while the previous one is still being classified gets its own
+ * session; finished results queue up and come out one per call, oldest first.
  * @param out Pointer to receive result when return value is 1.
  * @return 1 if a full detection cycle completed and out was written; 0 otherwise.
  */
 int sense_poll(SenseResult* out);
 
+/** Print the oldest queued "color:" debug line once the UART TX ring has room
+ * for the longest one (no-op with SENSE_COLOR_DEBUG 0). Call every loop pass.
+ */
+void sense_debug_tick(void);
+
 
 #ifdef TESTING
 // Expose internal fuctions for testing
@@ -60,8 +67,10 @@ uint32_t get_col_g_sum();
 uint32_t get_col_b_sum();
 uint32_t get_col_c_sum();
 uint16_t get_color_sample_count();
+uint8_t get_color_read_pending();
+uint8_t get_result_count();
 
-// Setters for internal variables
+// Setters for internal variables (set_session_active also clears other sessions and queued results)
 void set_session_active(uint8_t i);
 void set_current_event(DetectEvent de);
 void set_last_interrupt(uint32_t i);
@@ -69,4 +78,5 @@ void set_last_color_sample(uint32_t i);
 void set_above_count(uint16_t i);
 void set_col_sums(uint32_t i[]);
 void set_color_sample_count(uint16_t i);
+void set_color_read_pending(uint8_t i);
 #endif // TESTING
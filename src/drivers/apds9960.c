@@ -2,7 +2,9 @@
  * APDS-9960 color sensor (ALS) minimal driver
  * -------------------------------------------
  * - Initializes the ALS (ambient light/color) path and reads RGBC channels.
- * - apds9960_read_rgbc() returns raw 16-bit values for R/G/B/C.
+ * - apds9960_read_rgbc() returns raw 16-bit values for R/G/B/C (blocking).
+ * - apds9960_read_rgbc_async()/_result() run the same 8-byte burst read on the
+ *   TWI engine so the caller can poll for the sample instead of waiting ~1 ms.
  * - apds9960_classify() implements a simple ratio-based color classification
  *   without expensive divisions (tunable thresholds).
  * Notes: We keep this minimal for the project’s needs; gesture/proximity are unused.
@@ -12,8 +14,6 @@
 #include "hal/twi.h"
 #include "drivers/apds9960.h"
 
-#define APDS9960_I2C_ADDR 0x39
-
 // Registers
 #define APDS_ENABLE   0x80
 #define APDS_ATIME    0x81
@@ -40,42 +40,44 @@
 #define APDS_ENABLE_PON 0x01
 #define APDS_ENABLE_AEN 0x02
 
-static inline uint8_t addr_w(void) {
-    return (APDS9960_I2C_ADDR<<1);
-}
-static inline uint8_t addr_r(void) {
-    return (APDS9960_I2C_ADDR<<1) | 0x01;
-}
-
 static void write_reg(uint8_t reg, uint8_t val) {
-    twi_start(addr_w());
-    twi_write(reg);
-    twi_write(val);
-    twi_stop();
+    uint8_t tx[2] = { reg, val };
+    twi_write_read(APDS9960_I2C_ADDR, tx, 2, 0, 0);
 }
 
 static uint8_t read_reg(uint8_t reg) {
-    twi_start(addr_w());
-    twi_write(reg);
-    twi_start(addr_r());
-    uint8_t v = twi_read_nack();
-    twi_stop();
+    uint8_t v = 0;
+    twi_write_read(APDS9960_I2C_ADDR, &reg, 1, &v, 1);
     return v;
 }
 
-static void read_multi(uint8_t startReg, uint8_t* buf, uint8_t len) {
-    twi_start(addr_w());
-    twi_write(startReg);
-    twi_start(addr_r());
-    for (uint8_t i = 0; i < len; i++) {
-        if (i + 1 < len) { 
-            buf[i] = twi_read_ack(); 
-        } 
-        else { 
-            buf[i] = twi_read_nack(); 
-        }
+static bool read_multi(uint8_t startReg, uint8_t* buf, uint8_t len) {
+    // Register write, repeated START, burst read with auto-increment
+    return twi_write_read(APDS9960_I2C_ADDR, &startReg, 1, buf, len);
+}
+
+// Asynchronous RGBC burst read: driver-owned transaction and buffer
+static const uint8_t s_rgbc_reg = APDS_CDATAL;
+static uint8_t s_rgbc_buf[8];
+static TwiXfer s_rgbc_xfer;
+
+static void unpack_rgbc(const uint8_t* buf, uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c) {
+    uint16_t cval = (uint16_t)buf[1] << 8 | buf[0];
+    uint16_t rval = (uint16_t)buf[3] << 8 | buf[2];
+    uint16_t gval = (uint16_t)buf[5] << 8 | buf[4];
+    uint16_t bval = (uint16_t)buf[7] << 8 | buf[6];
+    if (r) { 
+        *r = rval; 
+    }
+    if (g) { 
+        *g = gval; 
+    }
+    if (b) { 
+        *b = bval; 
+    }
+    if (c) { 
+        *c = cval; 
     }
-    twi_stop();
 }
 
 bool apds9960_init(void) {
@@ -92,24 +94,45 @@ bool apds9960_init(void) {
 
 bool apds9960_read_rgbc(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c) {
     uint8_t buf[8];
-    read_multi(APDS_CDATAL, buf, 8);
-    uint16_t cval = (uint16_t)buf[1] << 8 | buf[0];
-    uint16_t rval = (uint16_t)buf[3] << 8 | buf[2];
-    uint16_t gval = (uint16_t)buf[5] << 8 | buf[4];
-    uint16_t bval = (uint16_t)buf[7] << 8 | buf[6];
-    if (r) { 
-        *r = rval; 
+    if (!read_multi(APDS_CDATAL, buf, 8)) {
+        return false;
     }
-    if (g) { 
-        *g = gval; 
+    unpack_rgbc(buf, r, g, b, c);
+    return true;
+}
+
+bool apds9960_read_rgbc_async(void) {
+    if (s_rgbc_xfer.state == TWI_XFER_QUEUED || s_rgbc_xfer.state == TWI_XFER_BUSY) {
+        return false; // previous read still in flight
     }
-    if (b) { 
-        *b = bval; 
+    s_rgbc_xfer.addr = APDS9960_I2C_ADDR;
+    s_rgbc_xfer.tx = &s_rgbc_reg;
+    s_rgbc_xfer.tx_len = 1;
+    s_rgbc_xfer.rx = s_rgbc_buf;
+    s_rgbc_xfer.rx_len = sizeof(s_rgbc_buf);
+    s_rgbc_xfer.done = 0;
+    return twi_submit(&s_rgbc_xfer);
+}
+
+int8_t apds9960_read_rgbc_result(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c) {
+    uint8_t st = s_rgbc_xfer.state;
+    if (st == TWI_XFER_QUEUED || st == TWI_XFER_BUSY) {
+        return 0;
     }
-    if (c) { 
-        *c = cval; 
+    s_rgbc_xfer.state = TWI_XFER_IDLE; // result consumed
+    if (st != TWI_XFER_DONE) {
+        return -1;
     }
-    return true;
+    unpack_rgbc(s_rgbc_buf, r, g, b, c);
+    return 1;
+}
+
+void apds9960_read_rgbc_cancel(void) {
+    uint8_t st = s_rgbc_xfer.state;
+    if (st == TWI_XFER_QUEUED || st == TWI_XFER_BUSY) {
+        twi_abort(); // bus is stuck on this read; reset it
+    }
+    s_rgbc_xfer.state = TWI_XFER_IDLE;
 }
 
 Color apds9960_classify(uint16_t r, uint16_t g, uint16_t b, uint16_t c) {
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define APDS9960_I2C_ADDR 0x39
+
 typedef enum { COLOR_RED, COLOR_GREEN, COLOR_BLUE, COLOR_OTHER } Color;
 
 /** Initialize APDS9960 sensor with reasonable defaults.
@@ -19,6 +21,22 @@ bool apds9960_init(void);
  */
 bool apds9960_read_rgbc(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c);
 
+/** Start a non-blocking RGBC burst read on the TWI engine.
+ * Collect the sample later with apds9960_read_rgbc_result().
+ * @return false if a previous read is still in flight or the TWI queue is full.
+ */
+bool apds9960_read_rgbc_async(void);
+
+/** Poll the read started by apds9960_read_rgbc_async().
+ * Any pointer may be NULL to skip that channel.
+ * @return 1 when a fresh sample was written (consumed), 0 while still on the
+ *         bus, -1 on I2C failure or when no read was started.
+ */
+int8_t apds9960_read_rgbc_result(uint16_t* r, uint16_t* g, uint16_t* b, uint16_t* c);
+
+/** Abandon an asynchronous read (resets the TWI bus if it is still pending). */
+void apds9960_read_rgbc_cancel(void);
+
 /** Classify basic color from RGB+C reading using ratio thresholds.
  * @return COLOR_RED/GREEN/BLUE or COLOR_OTHER if ambiguous.
  */
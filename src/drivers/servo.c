@@ -1,15 +1,21 @@
 /*
- * Servo driver (software PWM on Timer2)
- * -------------------------------------
+ * Servo driver (compare-match pulse scheduler on Timer2)
+ * ------------------------------------------------------
  * What it does:
- * - Generates 50 Hz servo control pulses for up to 3 channels using a simple
- *   software PWM loop. Each 20 ms frame, we start all three pulses HIGH, then
- *   drop each channel LOW when its desired pulse width (in microseconds) elapses.
- * - Timer2 fires every 0.5 ms (500 us) to keep the ISR short and deterministic.
+ * - Generates 50 Hz servo control pulses for up to 3 channels. The channels are
+ *   staggered within each 20 ms frame: channel 0 goes HIGH, and the compare match
+ *   that ends its pulse drops it LOW and raises channel 1, and so on; after
+ *   channel 2 the rest of the frame is an idle gap.
+ * - Timer2 runs in CTC mode and every interrupt programs OCR2A for the next edge,
+ *   so pulse widths are timed by the hardware counter with 4 us resolution
+ *   (prescaler 64) instead of being rounded to a fixed 0.5 ms tick. Since Timer2
+ *   is 8-bit, intervals longer than 255 ticks are split into two or more chunks.
+ * - The idle gap runs on prescaler 1024, so a whole frame costs about 8
+ *   interrupts instead of 40.
  * - Inside the ISR we use direct PORT writes (not HAL) to minimize overhead and
- *   jitter when other ISRs (like the stepper) are active.
+ *   jitter when other ISRs are active.
  * Key constants:
- * - s_servo_pulse_width_us[i] holds the requested pulse width for channel i (typical 1000–2000 us).
+ * - s_servo_ticks[i] holds the requested pulse width for channel i in timer ticks.
  * - SERVO_STARTUP_MUTE_MS keeps outputs LOW for a short time after boot to avoid twitches.
  * Pins (per pins.h): SERVO1=D5 (PORTD5), SERVO2=D6 (PORTD6), SERVO3=D10 (PORTB2).
  */
@@ -19,22 +25,53 @@
 #include "platform/config.h"
 #include "hal/gpio.h"
 #include "drivers/servo.h"
+#include "utils/instr.h"
 
 // Validate that ISR fast-path port/bit mappings match configured pins
 #if (PIN_SERVO1 != 5) || (PIN_SERVO2 != 6) || (PIN_SERVO3 != 10)
 #error "Servo ISR assumes SERVO1=D5 (PD5), SERVO2=D6 (PD6), SERVO3=D10 (PB2). Update ISR bit ops if pins change."
 #endif
 
-static volatile uint16_t s_servo_pulse_width_us[3] = {1500,1500,1500};
-static volatile uint16_t s_mute_ticks = 0; // number of 0.5ms ISR ticks to keep outputs low at startup
+// Timer2 clock selections: fast for pulse edges, slow for the idle gap
+#define SERVO_CS_FAST   (1<<CS22)                         // clk/64   -> 4 us/tick
+#define SERVO_CS_SLOW   ((1<<CS22)|(1<<CS21)|(1<<CS20))   // clk/1024 -> 64 us/tick
+#define SERVO_US_PER_TICK      ((uint16_t)(64000000UL / F_CPU))
+#define SERVO_US_PER_SLOW_TICK ((uint16_t)(1024000000UL / F_CPU))
+#define SERVO_SLOT_GAP 3 // slots 0..2 are channel pulses
+
+static volatile uint16_t s_servo_ticks[3] = {
+    1500 / SERVO_US_PER_TICK, 1500 / SERVO_US_PER_TICK, 1500 / SERVO_US_PER_TICK
+};
+static volatile uint16_t s_mute_frames = 0; // number of 20 ms frames to keep outputs low at startup
+
+// ISR-only scheduler state
+static uint8_t s_slot = SERVO_SLOT_GAP; // current slot; starts in the gap so the first match opens a frame
+static uint16_t s_remaining = 0;        // ticks still to wait in the current slot
+static uint16_t s_frame_us = 0;         // pulse time used so far in this frame
+static uint8_t s_outputs_on = 0;        // 0 while muted
+
+// Program the next compare; long intervals are split so each chunk fits 8 bits
+// and no chunk is so short that ISR latency could overrun it.
+static inline void arm(uint16_t ticks) {
+    uint16_t n = ticks;
+    if (n > 255U) {
+        n = (n < 510U) ? (uint16_t)(n / 2U) : 255U;
+    }
+    if (n == 0U) {
+        n = 1U;
+        ticks = 1U;
+    }
+    s_remaining = (uint16_t)(ticks - n);
+    OCR2A = (uint8_t)(n - 1U); // CTC period is OCR2A+1 ticks
+}
 
 void servo_init(void) {
-    // Use Timer2 for 20 ms period tick; software pulse control (simple)
-    // Prescaler 64: 16MHz/64=250kHz → 4us per tick
-    // We'll interrupt every 0.5 ms (125 ticks) for 0.5 ms resolution of pulse width
+    // Timer2 CTC; OCR2A is reprogrammed from the ISR for every edge
     TCCR2A = (1<<WGM21); // CTC
-    TCCR2B = (1<<CS22);  // prescaler 64
-    OCR2A = 125; // 0.5ms per interrupt (250kHz -> 0.5ms every 125 counts)
+    TCCR2B = SERVO_CS_FAST;
+    s_slot = SERVO_SLOT_GAP;
+    s_remaining = 0;
+    OCR2A = 249; // first frame starts after ~1 ms
     TIMSK2 |= (1<<OCIE2A);
     // Configure servo pins as outputs via HAL and ensure LOW start
     gpio_pin_mode(GPIO_PIN_SERVO1, GPIO_OUTPUT);
@@ -44,50 +81,79 @@ void servo_init(void) {
     gpio_write(GPIO_PIN_SERVO2, GPIO_LOW);
     gpio_write(GPIO_PIN_SERVO3, GPIO_LOW);
     // Mute pulses for a brief period to avoid startup jitter
-    s_mute_ticks = (uint16_t)(SERVO_STARTUP_MUTE_MS * 2U); // 0.5ms per tick
+    s_mute_frames = (uint16_t)(SERVO_STARTUP_MUTE_MS / (SERVO_FRAME_US / 1000U));
 }
 
 void servo_set_pulse_us(uint8_t idx, uint16_t us) {
-    if (idx < 3) { 
-        s_servo_pulse_width_us[idx] = us; 
+    if (idx >= 3) {
+        return;
     }
+    if (us < SERVO_MIN_US) { us = SERVO_MIN_US; }
+    if (us > SERVO_MAX_US) { us = SERVO_MAX_US; }
+    uint16_t ticks = (uint16_t)((us + SERVO_US_PER_TICK / 2U) / SERVO_US_PER_TICK);
+    // 16-bit store must not tear while the ISR reads it
+    uint8_t s = SREG;
+    cli();
+    s_servo_ticks[idx] = ticks;
+    SREG = s;
 }
 
-ISR(TIMER2_COMPA_vect) {
+// Timer2 compare match handler; kept apart from the ISR so the instrumentation
+// brackets cover its early returns.
+static inline void servo_on_compare(void) {
     // NOTE: Use direct register writes inside the ISR for deterministic timing and
     // minimal overhead. HAL gpio_write() performs read-modify-write via function
     // calls and port mapping, which increased jitter and led to visible small
-    // twitches on servos when combined with other ISRs (e.g., TB6600 stepper).
+    // twitches on servos when combined with other ISRs.
     // Pins (per pins.h defaults): SERVO1=D5 (PORTD5), SERVO2=D6 (PORTD6), SERVO3=D10 (PORTB2).
-    // During startup mute, keep outputs low and skip pulse generation
-    if (s_mute_ticks) {
-        if (s_mute_ticks) { 
-            s_mute_ticks--; 
-        }
-        // Force LOW on all servo outputs (fast path)
-        PORTD &= ~(1<<PD5);
-        PORTD &= ~(1<<PD6);
-        PORTB &= ~(1<<PB2);
+    if (s_remaining) {
+        arm(s_remaining); // middle of a long interval
         return;
     }
-    static uint16_t ticks_in_period = 0; // counts 0.5ms steps up to 20ms
-    static uint16_t t_us = 0;
-    if (ticks_in_period == 0) {
-        // start pulse - set all three HIGH (fast path)
-        PORTD |= (1<<PD5); // servo1
-        PORTD |= (1<<PD6); // servo2
-        PORTB |= (1<<PB2); // servo3
-        t_us = 0;
+    // End of the current slot: drop the channel whose pulse just elapsed
+    switch (s_slot) {
+        case 0: PORTD &= ~(1<<PD5); break;
+        case 1: PORTD &= ~(1<<PD6); break;
+        case 2: PORTB &= ~(1<<PB2); break;
+        default: break;
+    }
+    s_slot++;
+    if (s_slot == SERVO_SLOT_GAP) {
+        // Rest of the 20 ms frame is idle: count it on the slow clock
+        TCCR2B = SERVO_CS_SLOW;
+        uint16_t gap_us = (s_frame_us < SERVO_FRAME_US) ? (uint16_t)(SERVO_FRAME_US - s_frame_us) : 0U;
+        arm((uint16_t)(gap_us / SERVO_US_PER_SLOW_TICK));
+        return;
     }
-    // 0.5 ms resolution
-    t_us += 500;
-    {
-    if (t_us >= s_servo_pulse_width_us[0]) { PORTD &= ~(1<<PD5); }
-    if (t_us >= s_servo_pulse_width_us[1]) { PORTD &= ~(1<<PD6); }
-    if (t_us >= s_servo_pulse_width_us[2]) { PORTB &= ~(1<<PB2); }
+    if (s_slot > SERVO_SLOT_GAP) {
+        // New frame: back to the fast clock with a fresh prescaler phase
+        s_slot = 0;
+        s_frame_us = 0;
+        TCCR2B = SERVO_CS_FAST;
+        GTCCR |= (1<<PSRASY);
+        TCNT2 = 0;
+        if (s_mute_frames) {
+            s_mute_frames--;
+            s_outputs_on = 0;
+        } else {
+            s_outputs_on = 1;
+        }
     }
-    ticks_in_period++;
-    if (ticks_in_period >= 40) { // 40 * 0.5ms = 20ms
-        ticks_in_period = 0;
+    // Start the pulse for this slot; its end is the next compare match
+    uint16_t w = s_servo_ticks[s_slot];
+    if (s_outputs_on) {
+        switch (s_slot) {
+            case 0: PORTD |= (1<<PD5); break;
+            case 1: PORTD |= (1<<PD6); break;
+            default: PORTB |= (1<<PB2); break;
+        }
     }
+    s_frame_us = (uint16_t)(s_frame_us + w * SERVO_US_PER_TICK);
+    arm(w);
+}
+
+ISR(TIMER2_COMPA_vect) {
+    INSTR_ISR_BEGIN();
+    servo_on_compare();
+    INSTR_ISR_END(INSTR_ISR_T2A);
 }
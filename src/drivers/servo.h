@@ -1,6 +1,6 @@
 /*
  * Servo driver: generates ~50Hz pulses on three channels to control
- * pushers; pulse width set per channel in microseconds.
+ * pushers; pulse width set per channel in microseconds (4 us resolution).
  */
 #pragma once
 #include <stdint.h>
@@ -9,6 +9,8 @@
 void servo_init(void);
 
 /** Set pulse width for a servo channel in microseconds.
+ * Takes effect from the channel's next pulse; clamped to SERVO_MIN_US..SERVO_MAX_US
+ * and rounded to the 4 us timer tick.
  * @param idx Channel index 0..2.
  * @param us  Pulse width (typically ~1000..2000us, 1500us = center).
  */
@@ -5,35 +5,94 @@
  * - Converts a desired belt speed (mm/s) into a STEP pulse rate (Hz) using the
  *   geometry constant MM_PER_PULSE_X1000. The driver stores both the requested
  *   rate and the quantized achieved speed for logging/queries.
- * - Configures Timer1 in CTC mode (prescaler 8) and triggers an interrupt at
- *   2x the desired STEP edge rate (we need both rising and falling edges).
- * - Inside the ISR we toggle the STEP pin using a single hardware instruction
- *   (PINB ^= (1<<PB1)) for minimal jitter and overhead.
- * Pins: STEP=D9 (PB1), DIR=D8, EN=D7 (see pins.h).
+ * - Configures Timer1 in CTC mode (prescaler 8) with a compare match at 2x the
+ *   desired STEP edge rate (we need both rising and falling edges).
+ * - TB6600_HW_STEP=1 (default): the compare match toggles OC1A (= D9, the STEP
+ *   pin) in hardware via COM1A0, so the pulse train costs zero interrupts and
+ *   has no ISR latency jitter. The step count is derived from the programmed
+ *   rate and elapsed time, re-anchored on every rate change/start/stop.
+ * - TB6600_HW_STEP=0: legacy mode; TIMER1_COMPA ISR toggles the pin with a
+ *   single PINB write and counts edges.
+ * - Speed changes are trapezoidal: setters only record a target rate and the
+ *   TIMER0_COMPB ISR (same 1 kHz period as millis(), half a period later)
+ *   moves the output rate towards it by accel/decel per millisecond. Below
+ *   TB6600_START_RATE_HZ the rate jumps, as the motor can pull in from rest.
+ *   The ramp ISR is only enabled while the rate differs from the target.
+ * Pins: STEP=D9 (PB1/OC1A), DIR=D8, EN=D7 (see pins.h).
  */
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "platform/pins.h"
 #include "platform/config.h"
 #include "hal/gpio.h"
+#include "hal/timers.h"
 #include "drivers/tb6600.h"
+#include "utils/instr.h"
 
-static volatile uint16_t g_step_rate_hz = 0;
+// Validate hardcoded pin mapping used by the OC1A output / ISR fast path
+#if PIN_TB6600_STEP != 9
+#error "TB6600 STEP assumes D9 (PB1/OC1A). Update Timer1 output and this check if pins change."
+#endif
+
+static volatile uint16_t g_step_rate_hz = 0;   // rate currently on the pin (ramped)
+static volatile uint16_t g_target_rate_hz = 0; // rate the ramp is heading for
 static volatile uint8_t g_stepper_enabled = 0;
-static volatile uint16_t g_belt_mm_per_s = 0;
+static volatile uint16_t g_belt_mm_per_s = 0;  // quantized target speed
+
+// Ramp slopes in Hz per second, and the sub-Hz remainder carried between
+// 1 ms ticks (in 1/1000 Hz) so slow slopes still advance.
+static uint32_t s_accel_hz_per_s = 0;
+static uint32_t s_decel_hz_per_s = 0;
+static uint16_t s_ramp_frac = 0;
+
+#if TB6600_HW_STEP
+// Step accounting without interrupts: steps completed up to s_anchor_ms, plus
+// the rate actually on the pin since then (0 while stopped). The part of a
+// step not yet completed at the anchor is carried in s_steps_frac (Hz*ms,
+// < 1000) so re-anchoring on every 1 ms ramp tick loses nothing.
+static uint32_t s_steps_base = 0;
+static uint16_t s_steps_frac = 0;
+static uint32_t s_anchor_ms = 0;
+static uint16_t s_output_rate_hz = 0;
+
+// Rate*ms accumulated since the anchor, plus the carried fraction
+static uint32_t steps_x1000_since_anchor(uint32_t now_ms) {
+    uint32_t elapsed = now_ms - s_anchor_ms;
+    // Fold whole seconds into the base so the product below cannot overflow
+    if (elapsed >= 1000UL) {
+        uint32_t secs = elapsed / 1000UL;
+        s_steps_base += secs * (uint32_t)s_output_rate_hz;
+        s_anchor_ms += secs * 1000UL;
+        elapsed -= secs * 1000UL;
+    }
+    return (uint32_t)s_steps_frac + (uint32_t)s_output_rate_hz * elapsed;
+}
+
+static uint32_t steps_at(uint32_t now_ms) {
+    return s_steps_base + steps_x1000_since_anchor(now_ms) / 1000UL;
+}
+
+static void reanchor(uint16_t new_output_rate) {
+    uint32_t now = millis();
+    uint32_t acc = steps_x1000_since_anchor(now);
+    s_steps_base += acc / 1000UL;
+    s_steps_frac = (uint16_t)(acc % 1000UL);
+    s_anchor_ms = now;
+    s_output_rate_hz = new_output_rate;
+}
+#else
+static volatile uint32_t s_step_edges = 0; // toggles; two per step
+#endif
 
 static void apply_timer_for_rate(uint16_t rate){
     if(rate == 0){
-        // Stop timer
+        // Stop timer and disconnect OC1A (pin falls back to PORTB1 = LOW)
         TIMSK1 &= ~(1<<OCIE1A);
         TCCR1A = 0;
         TCCR1B = 0;
         return;
     }
-    // CTC mode, prescaler 8
-    TCCR1A = 0;
-    TCCR1B = (1<<WGM12) | (1<<CS11);
-    // We toggle STEP in the ISR; to generate 'rate' rising edges per second,
+    // We toggle STEP on each compare; to generate 'rate' rising edges per second,
     // we need to toggle at 2*rate.
     uint32_t base = (F_CPU/8UL);
     uint32_t div = (uint32_t)rate * 2UL;
@@ -41,7 +100,63 @@ static void apply_timer_for_rate(uint16_t rate){
     uint32_t ocr_calc = base / div;
     if (ocr_calc > 0) { ocr_calc -= 1; }
     if (ocr_calc == 0) { ocr_calc = 1; }
+    if (ocr_calc > 0xFFFFUL) { ocr_calc = 0xFFFFUL; }
     OCR1A = (uint16_t)ocr_calc;
+    // Lowering TOP below the running count would make the counter run to
+    // 0xFFFF and wrap (a ~32 ms gap in the pulse train); restart the period.
+    if (TCNT1 > OCR1A) { TCNT1 = 0; }
+#if TB6600_HW_STEP
+    // CTC mode, prescaler 8; OC1A toggles in hardware only while enabled
+    TCCR1A = g_stepper_enabled ? (1<<COM1A0) : 0;
+#else
+    TCCR1A = 0;
+#endif
+    TCCR1B = (1<<WGM12) | (1<<CS11);
+}
+
+static uint32_t hz_per_s_for(uint16_t mm_per_s2) {
+    return ((uint32_t)mm_per_s2 * 1000UL) / (uint32_t)MM_PER_PULSE_X1000;
+}
+
+// Program a new output rate. Called with interrupts masked (or from an ISR).
+static void apply_output_rate(uint16_t rate) {
+#if TB6600_HW_STEP
+    reanchor(g_stepper_enabled ? rate : 0);
+#endif
+    g_step_rate_hz = rate;
+    apply_timer_for_rate(rate);
+#if !TB6600_HW_STEP
+    if (rate && g_stepper_enabled) { TIMSK1 |= (1<<OCIE1A); }
+#endif
+}
+
+static uint16_t ramp_delta(uint32_t hz_per_s) {
+    uint32_t acc = (uint32_t)s_ramp_frac + hz_per_s; // per 1 ms tick
+    s_ramp_frac = (uint16_t)(acc % 1000UL);
+    acc /= 1000UL;
+    return (acc > 0xFFFFUL) ? 0xFFFFU : (uint16_t)acc;
+}
+
+// Next output rate on the way from cur to tgt (cur != tgt).
+static uint16_t ramp_next(uint16_t cur, uint16_t tgt) {
+    if (cur < tgt) {
+        if (s_accel_hz_per_s == 0) { return tgt; }
+        if (cur < TB6600_START_RATE_HZ) {
+            return (tgt < TB6600_START_RATE_HZ) ? tgt : TB6600_START_RATE_HZ;
+        }
+        uint16_t d = ramp_delta(s_accel_hz_per_s);
+        return ((uint16_t)(tgt - cur) > d) ? (uint16_t)(cur + d) : tgt;
+    }
+    if (s_decel_hz_per_s == 0) { return tgt; }
+    uint16_t d = ramp_delta(s_decel_hz_per_s);
+    uint16_t next = ((uint16_t)(cur - tgt) > d) ? (uint16_t)(cur - d) : tgt;
+    if (next < TB6600_START_RATE_HZ) { next = tgt; } // slow enough to stop/land directly
+    return next;
+}
+
+// Let the ramp ISR run; it disables itself once the target is reached.
+static inline void ramp_kick(void) {
+    TIMSK0 |= (1<<OCIE0B);
 }
 
 void tb6600_init(void) {
@@ -52,55 +167,157 @@ void tb6600_init(void) {
     gpio_pin_mode(GPIO_PIN_TB6600_EN, GPIO_OUTPUT);
     gpio_write(GPIO_PIN_TB6600_STEP, GPIO_LOW);
     // Leave EN asserted as wired; DIR is set elsewhere as needed
+    s_accel_hz_per_s = hz_per_s_for(TB6600_ACCEL_MM_PER_S2);
+    s_decel_hz_per_s = hz_per_s_for(TB6600_DECEL_MM_PER_S2);
+    // Ramp tick: Timer0 COMPB, half a millis() period after COMPA (timers_init
+    // must have run so OCR0A holds the 1 kHz TOP)
+    OCR0B = (uint8_t)(OCR0A >> 1);
+}
+
+void tb6600_set_accel_mm_per_s2(uint16_t accel, uint16_t decel) {
+    uint32_t a = hz_per_s_for(accel);
+    uint32_t d = hz_per_s_for(decel);
+    uint8_t s = SREG;
+    cli();
+    s_accel_hz_per_s = a;
+    s_decel_hz_per_s = d;
+    SREG = s;
 }
 
 void tb6600_set_step_rate_hz(uint16_t rate) {
-    g_step_rate_hz = rate;
-    if (rate == 0) {
-        apply_timer_for_rate(0);
-        return;
+    uint8_t s = SREG;
+    cli();
+    g_target_rate_hz = rate;
+    if (g_stepper_enabled && rate != g_step_rate_hz) {
+        ramp_kick();
     }
-    apply_timer_for_rate(rate);
-    if (g_stepper_enabled) { TIMSK1 |= (1<<OCIE1A); }
+    SREG = s;
 }
 
 uint16_t tb6600_get_step_rate_hz(void) {
-    return g_step_rate_hz;
+    uint16_t r;
+    uint8_t s = SREG;
+    cli();
+    r = g_step_rate_hz;
+    SREG = s;
+    return r;
+}
+
+uint16_t tb6600_get_target_step_rate_hz(void) {
+    return g_target_rate_hz;
+}
+
+bool tb6600_at_target_speed(void) {
+    bool at;
+    uint8_t s = SREG;
+    cli();
+    at = g_stepper_enabled ? (g_step_rate_hz == g_target_rate_hz) : (g_step_rate_hz == 0);
+    SREG = s;
+    return at;
 }
 
 void tb6600_start(void) {
+    uint8_t s = SREG;
+    cli();
     g_stepper_enabled = 1;
-    if (g_step_rate_hz) { 
-        apply_timer_for_rate(g_step_rate_hz);
-        TIMSK1 |= (1<<OCIE1A);
+    s_ramp_frac = 0;
+    // Ramp up from rest; the pulse train starts from the ISR
+    if (g_target_rate_hz) {
+        ramp_kick();
     }
+    SREG = s;
 }
 
 void tb6600_stop(void) {
+    uint8_t s = SREG;
+    cli();
+    TIMSK0 &= ~(1<<OCIE0B); // abort any ramp in progress
+#if TB6600_HW_STEP
+    reanchor(0);
+    TCCR1A &= ~(1<<COM1A0); // release the pin to PORTB1 (LOW)
+#endif
     g_stepper_enabled = 0;
+    g_step_rate_hz = 0;
     TIMSK1 &= ~(1<<OCIE1A);
     // Stop timer clock to reduce ISR overhead to zero
     TCCR1B &= ~((1<<CS12)|(1<<CS11)|(1<<CS10));
+    SREG = s;
 }
 
-// Validate hardcoded pin mapping used by ISR fast path
-#if PIN_TB6600_STEP != 9
-#error "TB6600 STEP fast-path assumes D9 (PB1). Update ISR toggle and this check if pins change."
+uint32_t tb6600_get_step_count(void) {
+#if TB6600_HW_STEP
+    // The ramp ISR re-anchors the accounting; read it atomically
+    uint32_t n;
+    uint8_t s = SREG;
+    cli();
+    n = steps_at(millis());
+    SREG = s;
+    return n;
+#else
+    uint32_t e;
+    uint8_t s = SREG;
+    cli();
+    e = s_step_edges;
+    SREG = s;
+    return e / 2UL;
 #endif
+}
+
+uint32_t tb6600_get_position_pulses(void) {
+    return tb6600_get_step_count();
+}
+
+uint32_t tb6600_position_at_ms(uint32_t t_ms) {
+    uint32_t now = millis();
+    uint32_t pos = tb6600_get_position_pulses();
+    uint32_t dt = now - t_ms;
+    if (dt > 0x7FFFFFFFUL) {
+        return pos; // t_ms is in the future
+    }
+    if (dt > 60000UL) { dt = 60000UL; } // keep rate*dt within 32 bits
+    uint16_t rate = g_stepper_enabled ? tb6600_get_step_rate_hz() : 0;
+    uint32_t back = ((uint32_t)rate * dt) / 1000UL;
+    return (pos > back) ? (pos - back) : 0;
+}
+
+// One ramp step per 1 ms tick (body of the Timer0 COMPB ISR)
+static inline void ramp_tick(void) {
+    uint16_t cur = g_step_rate_hz;
+    uint16_t tgt = g_stepper_enabled ? g_target_rate_hz : 0;
+    if (cur == tgt) {
+        TIMSK0 &= ~(1<<OCIE0B); // cruising: no ramp ticks until the next change
+        s_ramp_frac = 0;
+        return;
+    }
+    uint16_t next = ramp_next(cur, tgt);
+    if (next != cur) {
+        apply_output_rate(next);
+    }
+}
+
+ISR(TIMER0_COMPB_vect) {
+    INSTR_ISR_ENTRY(INSTR_ISR_T0B);
+    ramp_tick();
+}
+
+#if !TB6600_HW_STEP
 ISR(TIMER1_COMPA_vect) {
-    if (!g_stepper_enabled) { 
-        return; 
+    INSTR_ISR_BEGIN();
+    if (g_stepper_enabled) {
+        // Fast-path toggle: D9 (TB6600 STEP) is PB1 on ATmega328P.
+        // Writing a 1 to PINB bit toggles the corresponding PORTB bit atomically.
+        // This avoids function call overhead and RMW timing jitter.
+        PINB = (1 << PB1);
+        s_step_edges++;
     }
-    // Fast-path toggle: D9 (TB6600 STEP) is PB1 on ATmega328P.
-    // Writing a 1 to PINB bit toggles the corresponding PORTB bit atomically.
-    // This avoids function call overhead and RMW timing jitter.
-    PINB = (1 << PB1);
+    INSTR_ISR_END(INSTR_ISR_T1A);
 }
+#endif
 
 void tb6600_set_speed(uint16_t mm_per_s){
-    g_belt_mm_per_s = 0;
     if(mm_per_s == 0){
-        tb6600_set_step_rate_hz(0);
+        g_belt_mm_per_s = 0;
+        tb6600_set_step_rate_hz(0); // ramps down, then the pulse train stops
         return;
     }
     // Convert desired mm/s to step rate (Hz): rate = (mm/s) / (mm/pulse)
@@ -108,12 +325,18 @@ void tb6600_set_speed(uint16_t mm_per_s){
     uint32_t num = (uint32_t)mm_per_s * 1000UL;
     uint16_t rate = (uint16_t)((num + (MM_PER_PULSE_X1000/2)) / (uint32_t)MM_PER_PULSE_X1000); // rounded
     if(rate == 0){ rate = 1; }
-    tb6600_set_step_rate_hz(rate);
-    // Store the achieved speed (quantized) for queries
-    uint32_t mmps_q = ((uint32_t)g_step_rate_hz * (uint32_t)MM_PER_PULSE_X1000) / 1000UL;
+    // Store the achieved target speed (quantized) for queries
+    uint32_t mmps_q = ((uint32_t)rate * (uint32_t)MM_PER_PULSE_X1000) / 1000UL;
     g_belt_mm_per_s = (uint16_t)mmps_q;
+    tb6600_set_step_rate_hz(rate);
 }
 
 uint16_t tb6600_get_speed_mm_per_s(void){
+    // Instantaneous speed: follows the ramp
+    uint32_t mmps = ((uint32_t)tb6600_get_step_rate_hz() * (uint32_t)MM_PER_PULSE_X1000) / 1000UL;
+    return (uint16_t)mmps;
+}
+
+uint16_t tb6600_get_target_speed_mm_per_s(void){
     return g_belt_mm_per_s;
 }
@@ -9,26 +9,65 @@
 /** Initialize TB6600 control pins and timer resources. */
 void tb6600_init(void);
 
-/** Set desired step rate in Hz (rising edges per second).
- * @param rate Step rate; 0 stops the timer configuration.
+/** Set target step rate in Hz (rising edges per second). The output rate
+ * ramps towards it at the configured accel/decel; nothing is applied in the
+ * caller's context.
+ * @param rate Step rate; 0 ramps down and then stops the pulse train.
  */
 void tb6600_set_step_rate_hz(uint16_t rate);
 
-/** Get the last configured step rate in Hz. */
+/** Instantaneous step rate in Hz (follows the ramp; 0 while stopped). */
 uint16_t tb6600_get_step_rate_hz(void);
 
-/** Enable step pulse output (timer ISR toggling). */
+/** Target step rate in Hz set by the last speed/rate call. */
+uint16_t tb6600_get_target_step_rate_hz(void);
+
+/** Set ramp slopes for speed increases and decreases.
+ * @param accel Acceleration in mm/s^2 (0 = jump straight to a higher target).
+ * @param decel Deceleration in mm/s^2 (0 = jump straight to a lower target).
+ */
+void tb6600_set_accel_mm_per_s2(uint16_t accel, uint16_t decel);
+
+/** @return true once the output rate has reached the target (or the
+ * stepper is stopped), i.e. no ramp is in progress.
+ */
+bool tb6600_at_target_speed(void);
+
+/** Enable step pulse output (OC1A hardware toggle, or timer ISR toggling
+ * when TB6600_HW_STEP is 0) and ramp up from rest to the target rate. */
 void tb6600_start(void);
 
-/** Disable step pulse output. */
+/** Disable step pulse output immediately (no ramp; use tb6600_set_speed(0)
+ * for a controlled stop). */
 void tb6600_stop(void);
 
+/** Number of STEP pulses emitted since boot.
+ * In hardware-toggle mode this is derived from the programmed rate and
+ * elapsed millis() (no per-step interrupt), so it is exact to about one
+ * millisecond's worth of steps.
+ */
+uint32_t tb6600_get_step_count(void);
+
+/** Monotonic belt position in STEP pulses since boot (the belt only runs
+ * forward, so this is the step count). Use for position-keyed scheduling.
+ */
+uint32_t tb6600_get_position_pulses(void);
+
+/** Belt position (pulses) at an earlier millis() timestamp, extrapolated back
+ * from the current position at the current step rate.
+ * @param t_ms Timestamp not later than now; exact if the rate has not changed since.
+ */
+uint32_t tb6600_position_at_ms(uint32_t t_ms);
+
 /** Set desired belt speed in millimeters per second.
- * Converts mm/s to a step rate using geometry constants and applies timer config.
- * Passing 0 stops stepping. The actual set speed may be quantized to the closest
- * achievable value; query with tb6600_get_speed_mm_per_s().
+ * Converts mm/s to a target step rate using geometry constants; the belt ramps
+ * to it. Passing 0 ramps down and stops stepping. The target may be quantized
+ * to the closest achievable value; query with tb6600_get_target_speed_mm_per_s().
  */
 void tb6600_set_speed(uint16_t mm_per_s);
 
-/** Get the last configured belt speed (mm/s). */
+/** Instantaneous belt speed (mm/s), derived from the current ramped step rate. */
 uint16_t tb6600_get_speed_mm_per_s(void);
+
+/** Target belt speed (mm/s) as quantized by the last tb6600_set_speed(). */
+uint16_t tb6600_get_target_speed_mm_per_s(void);
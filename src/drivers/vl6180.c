@@ -3,12 +3,13 @@
  * ---------------------------------
  * - Initializes the sensor with the mandatory configuration sequence and
  *   configures GPIO1 as an active-low interrupt on range low-threshold events.
- * - We operate in continuous ranging with a low-threshold interrupt: when the
- *   measured distance is below the configured threshold, GPIO1 pulls low (INT0),
- *   which the sense module uses to start/continue a detection session. Ending
- *   a session is handled by a quiet-timeout without further polling.
+ * - We operate in continuous ranging with threshold interrupts and two modes:
+ *   LOW (distance below the threshold: a block arrived) and HIGH (distance above
+ *   threshold + hysteresis: the block left). GPIO1 pulls low (INT0) on the
+ *   selected event; the sense module flips the mode at each edge, so both the
+ *   start and the end of a detection session are interrupt-driven.
  * - Provides helpers to set threshold, start a shot, read status/range, and
- *   clear the latched interrupt.
+ *   clear the latched interrupt (blocking, or queued on the TWI engine).
  */
 #include <stdint.h>
 #include <stdbool.h>
@@ -18,26 +19,16 @@
 #include "platform/config.h"
 #include "hal/timers.h"
 
-static uint8_t addr7(void) {
-    return (VL6180_I2C_ADDR<<1);
-}
-
 static void write_reg(uint16_t reg, uint8_t val) {
-    twi_start(addr7());
-    twi_write((uint8_t)(reg>>8));
-    twi_write((uint8_t)(reg&0xFF));
-    twi_write(val);
-    twi_stop();
+    uint8_t tx[3] = { (uint8_t)(reg>>8), (uint8_t)(reg&0xFF), val };
+    twi_write_read(VL6180_I2C_ADDR, tx, 3, 0, 0);
 }
 
 static uint8_t read_reg(uint16_t reg) {
-    twi_start(addr7());
-    twi_write((uint8_t)(reg>>8));
-    twi_write((uint8_t)(reg&0xFF));
-    // repeated start for read
-    twi_start(addr7() | 0x01);
-    uint8_t v = twi_read_nack();
-    twi_stop();
+    // 16-bit register index, then repeated start for read
+    uint8_t tx[2] = { (uint8_t)(reg>>8), (uint8_t)(reg&0xFF) };
+    uint8_t v = 0;
+    twi_write_read(VL6180_I2C_ADDR, tx, 2, &v, 1);
     return v;
 }
 
@@ -50,6 +41,9 @@ static uint8_t read_reg(uint16_t reg) {
 #define SYSRANGE__THRESH_HIGH             0x019
 #define SYSRANGE__THRESH_LOW              0x01A
 #define SYSRANGE__INTERMEASUREMENT_PERIOD 0x01B
+// INTERRUPT_CONFIG_GPIO: [2:0] selects the range event (Vl6180IntMode); the
+// upper field keeps the value of the original 0x21 setup
+#define VL6180_INT_CONFIG_BASE            0x20
 // Status/result (optional)
 #define RESULT__INTERRUPT_STATUS_GPIO     0x04F
 
@@ -130,14 +124,14 @@ bool vl6180_init(void) {
 }
 
 bool vl6180_config_threshold_mm(uint8_t threshold_mm, uint8_t hysteresis_mm) {
-    (void)hysteresis_mm; // not used in low-threshold mode
-    // Configure only LOW threshold at the desired distance in mm.
-    // Any measurement below LOW will assert the GPIO1 interrupt (active-low).
+    // LOW threshold detects arrival; HIGH = threshold + hysteresis detects the
+    // block leaving, so range noise around the threshold cannot toggle the state.
+    uint16_t high = (uint16_t)threshold_mm + hysteresis_mm;
+    if (high > 0xFF) { high = 0xFF; }
     write_reg(SYSRANGE__THRESH_LOW, threshold_mm);
-    write_reg(SYSRANGE__THRESH_HIGH, 0xFF); // unused in low-threshold mode
-    // Configure GPIO1 to assert on RANGE LOW-THRESHOLD events for Range function.
-    // [5:3]=010 (Range), [2:0]=001 (Low threshold) => 0x21
-    write_reg(SYSTEM__INTERRUPT_CONFIG_GPIO, 0x21);
+    write_reg(SYSRANGE__THRESH_HIGH, (uint8_t)high);
+    // Start in LOW mode (0x21): wait for a block
+    write_reg(SYSTEM__INTERRUPT_CONFIG_GPIO, VL6180_INT_CONFIG_BASE | VL6180_INT_LOW);
     // Clear any latched interrupt to arm next event (ensure GPIO1 idles high)
     write_reg(SYSTEM__INTERRUPT_CLEAR, 0x07);
     // Start continuous ranging only after mode/thresholds/clear are applied so the
@@ -157,6 +151,30 @@ void vl6180_clear_interrupt(void) {
     write_reg(SYSTEM__INTERRUPT_CLEAR, 0x07);
 }
 
+void vl6180_set_interrupt_mode(Vl6180IntMode mode) {
+    write_reg(SYSTEM__INTERRUPT_CONFIG_GPIO, (uint8_t)(VL6180_INT_CONFIG_BASE | mode));
+    write_reg(SYSTEM__INTERRUPT_CLEAR, 0x07);
+}
+
+// SYSTEM__INTERRUPT_CONFIG_GPIO <- mode, SYSTEM__INTERRUPT_CLEAR <- 0x07 in one
+// write (the register index auto-increments), queued on the TWI engine
+static uint8_t s_mode_cmd[4] = { 0x00, 0x14, 0x00, 0x07 };
+static TwiXfer s_mode_xfer;
+
+bool vl6180_set_interrupt_mode_async(Vl6180IntMode mode) {
+    if (s_mode_xfer.state == TWI_XFER_QUEUED || s_mode_xfer.state == TWI_XFER_BUSY) {
+        return false;
+    }
+    s_mode_cmd[2] = (uint8_t)(VL6180_INT_CONFIG_BASE | mode);
+    s_mode_xfer.addr = VL6180_I2C_ADDR;
+    s_mode_xfer.tx = s_mode_cmd;
+    s_mode_xfer.tx_len = sizeof(s_mode_cmd);
+    s_mode_xfer.rx = 0;
+    s_mode_xfer.rx_len = 0;
+    s_mode_xfer.done = 0;
+    return twi_submit(&s_mode_xfer);
+}
+
 void vl6180_start_single(void) {
     // Deprecated in continuous mode; keep no-op or single-shot trigger if used for tests.
     write_reg(SYSRANGE__START, 0x01);
@@ -8,12 +8,20 @@
 
 #define VL6180_I2C_ADDR 0x29
 
+/** GPIO1 range interrupt source (SYSTEM__INTERRUPT_CONFIG_GPIO[2:0]). */
+typedef enum {
+    VL6180_INT_LOW = 1,           /**< Range below the low threshold (block arrived). */
+    VL6180_INT_HIGH = 2,          /**< Range above the high threshold (block left). */
+    VL6180_INT_OUT_OF_WINDOW = 3  /**< Either of the above. */
+} Vl6180IntMode;
+
 /** Initialize VL6180 and apply mandatory configuration; sets up GPIO1 interrupts. */
 bool vl6180_init(void);
 
-/** Configure range low-threshold in millimeters; hysteresis parameter reserved.
- * @param threshold_mm Threshold distance in mm for low-threshold interrupt.
- * @param hysteresis_mm Reserved/unused in current low-threshold mode.
+/** Configure range thresholds, select LOW mode and start continuous ranging.
+ * @param threshold_mm  Low threshold in mm: closer than this = block present.
+ * @param hysteresis_mm High threshold is threshold_mm + hysteresis_mm: farther
+ *                      than that = block gone (HIGH mode).
  */
 bool vl6180_config_threshold_mm(uint8_t threshold_mm, uint8_t hysteresis_mm);
 
@@ -23,6 +31,17 @@ void vl6180_enable_interrupt(void);
 /** Clear sensor interrupt sources (range/ALS/error). */
 void vl6180_clear_interrupt(void);
 
+/** Select the GPIO1 range interrupt source and clear any latched interrupt
+ * (blocking).
+ */
+void vl6180_set_interrupt_mode(Vl6180IntMode mode);
+
+/** Queue the mode switch plus interrupt clear as one TWI write and return
+ * immediately.
+ * @return false if the previous switch is still in flight or the queue is full.
+ */
+bool vl6180_set_interrupt_mode_async(Vl6180IntMode mode);
+
 /** Start a single-ranging measurement; use with configured interrupt mode. */
 void vl6180_start_single(void);
 
@@ -2,15 +2,20 @@
  * HAL Timers
  * ----------
  * Provides a simple millis() clock using Timer0 in CTC mode at 1 kHz. This is
- * the timebase used throughout the app for scheduling and logging. Other timers
+ * the timebase used throughout the app for scheduling and logging. micros()
+ * adds the running Timer0 count (4 us per tick) for edge timestamps taken in
+ * ISRs. Other timers
  * are reserved by drivers:
- * - Timer1: TB6600 stepper pulse rate (CTC).
- * - Timer2: Software servo PWM tick at 0.5 ms.
+ * - Timer0 COMPB: TB6600 acceleration ramp tick (same 1 kHz period).
+ * - Timer1: TB6600 stepper pulse rate (CTC, OC1A hardware toggle).
+ * - Timer2: Servo pulse scheduler (CTC, compare reprogrammed per edge).
  */
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <stdint.h>
+#include "utils/instr.h"
 
+#define TIMER0_US_PER_TICK (64000000UL / F_CPU) // clk/64
 
 static volatile uint32_t g_millis = 0;
 void timers_init(void) {
@@ -25,6 +30,7 @@ void timers_init(void) {
     TIMSK0 = (1<<OCIE0A);
 }
 ISR(TIMER0_COMPA_vect) {
+    INSTR_ISR_ENTRY(INSTR_ISR_T0A);
     g_millis++;
 }
 uint32_t millis(void) {
@@ -33,5 +39,20 @@ uint32_t millis(void) {
     cli();
     m = g_millis;
     SREG = s;
-    return (m & 0x3FFFFUL);
+    return m; // full 32 bits; compare with utils/time_util.h helpers
+}
+uint32_t micros(void) {
+    uint32_t m;
+    uint8_t t;
+    uint8_t s = SREG;
+    cli();
+    m = g_millis;
+    t = TCNT0;
+    // Compare match already happened but its ISR has not run yet (we are in
+    // another ISR or interrupts are masked): the counter restarted from 0.
+    if ((TIFR0 & (1<<OCF0A)) && (t < OCR0A)) {
+        m++;
+    }
+    SREG = s;
+    return m * 1000UL + (uint32_t)t * TIMER0_US_PER_TICK;
 }
@@ -9,5 +9,14 @@
 /** Initialize Timer0-based 1 kHz millisecond timebase. */
 void timers_init(void);
 
-/** Get milliseconds since timers_init() using an ISR-driven counter. */
+/** Get milliseconds since timers_init() using an ISR-driven counter.
+ * Full 32-bit range (wraps after ~49.7 days); compare timestamps with the
+ * wrap-safe helpers in utils/time_util.h, never with < or >=.
+ */
 uint32_t millis(void);
+
+/** Microseconds since timers_init(), from millis() plus the Timer0 count
+ * (4 us resolution at 16 MHz). Wraps after ~71.6 minutes, so use it only for
+ * short intervals (wrap-safe differences). Safe to call from ISRs.
+ */
+uint32_t micros(void);
@@ -1,14 +1,44 @@
 /*
  * HAL TWI (I2C) implementation
  * ----------------------------
- * Blocking master-mode helpers used by the VL6180 and APDS9960 drivers.
- * Simplicity over features: fixed 100 kHz, basic timeout to avoid lockups,
- * and minimal status handling sufficient for bring-up and polling.
+ * Master-mode transaction engine used by the VL6180 and APDS9960 drivers.
+ * - Callers describe a write-then-read transaction (TwiXfer) and queue it with
+ *   twi_submit(). TWI_vect walks the START / SLA / data / repeated START /
+ *   STOP sequence one TWINT at a time, so the main loop never spins on the bus.
+ * - Completion is reported through TwiXfer.state (poll) and an optional
+ *   callback. Back-to-back transactions chain STOP+START inside the ISR.
+ * - twi_transfer()/twi_write_read() are blocking wrappers over the same engine;
+ *   before sei() they step the state machine from the polling loop.
+ * - The original polled byte-level helpers (twi_start/twi_write/...) remain
+ *   for bring-up code; they wait for queued transactions to drain first.
+ * - Bus clock is selected per device (e.g. 400 kHz fast mode for the sensors)
+ *   and applied at each START; unknown devices use the default TWI_FREQ_HZ.
+ *   The speed table lives in twi_speed.c.
+ * Basic timeouts avoid lockups.
  */
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "twi.h"
+#include "twi_speed.h"
 #include "platform/config.h"
 
+// TWSR status codes (master transmitter/receiver)
+#define TW_START         0x08
+#define TW_REP_START     0x10
+#define TW_MT_SLA_ACK    0x18
+#define TW_MT_DATA_ACK   0x28
+#define TW_MR_SLA_ACK    0x40
+#define TW_MR_DATA_ACK   0x50
+#define TW_MR_DATA_NACK  0x58
+
+// TWCR value while the engine owns the bus: interrupt on every TWINT
+#define TWCR_RUN ((1<<TWINT)|(1<<TWEN)|(1<<TWIE))
+
+static TwiXfer* volatile s_queue[TWI_QUEUE_LEN];
+static volatile uint8_t s_q_head = 0;  // slot of the transaction on the bus
+static volatile uint8_t s_q_count = 0; // transactions queued incl. the active one
+static volatile uint8_t s_idx = 0;     // byte index within the current phase
+
 static inline uint8_t twi_wait_twint(void) {
     uint32_t loops = TWI_TIMEOUT_LOOPS;
     while (!(TWCR & (1<<TWINT))) {
@@ -17,12 +47,189 @@ static inline uint8_t twi_wait_twint(void) {
     return 1;
 }
 
+static inline void twi_wait_stop(void) {
+    // A STOP takes ~10 us at 100 kHz; don't start a new frame on top of it
+    uint16_t loops = 0xFFFF;
+    while ((TWCR & (1<<TWSTO)) && --loops) { }
+}
+
+static inline bool irq_enabled(void) {
+    return (SREG & (1<<SREG_I)) != 0;
+}
+
+static inline TwiXfer* current(void) {
+    return s_queue[s_q_head];
+}
+
+// Pop the active transaction and hand the bus to the next one (or release it).
+static void finish_current(uint8_t state) {
+    TwiXfer* x = current();
+    s_q_head = (uint8_t)((s_q_head + 1) % TWI_QUEUE_LEN);
+    s_q_count--;
+    s_idx = 0;
+    if (s_q_count) {
+        current()->state = TWI_XFER_BUSY;
+        TWBR = twi_speed_twbr(current()->addr);
+        TWCR = TWCR_RUN | (1<<TWSTO) | (1<<TWSTA); // STOP followed by START
+    } else {
+        TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO); // STOP, engine idle
+    }
+    x->state = state;
+    if (x->done) { x->done(x); }
+}
+
+// One state-machine step per TWINT; called from TWI_vect or the polled wait.
+static void twi_step(void) {
+    TwiXfer* x = current();
+    uint8_t st = TWSR & 0xF8;
+    switch (st) {
+        case TW_START:
+        case TW_REP_START:
+            // Write phase first (or an address-only probe), then read after repeated START
+            if (st == TW_START && (x->tx_len || !x->rx_len)) {
+                TWDR = (uint8_t)(x->addr << 1);
+            } else {
+                TWDR = (uint8_t)((x->addr << 1) | 0x01);
+            }
+            s_idx = 0;
+            TWCR = TWCR_RUN;
+            break;
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (s_idx < x->tx_len) {
+                TWDR = x->tx[s_idx++];
+                TWCR = TWCR_RUN;
+            } else if (x->rx_len) {
+                TWCR = TWCR_RUN | (1<<TWSTA); // repeated START for the read phase
+            } else {
+                finish_current(TWI_XFER_DONE);
+            }
+            break;
+        case TW_MR_SLA_ACK:
+            TWCR = TWCR_RUN | ((x->rx_len > 1) ? (1<<TWEA) : 0);
+            break;
+        case TW_MR_DATA_ACK:
+            x->rx[s_idx++] = TWDR;
+            // ACK all but the last byte
+            TWCR = TWCR_RUN | (((uint8_t)(s_idx + 1) < x->rx_len) ? (1<<TWEA) : 0);
+            break;
+        case TW_MR_DATA_NACK:
+            x->rx[s_idx++] = TWDR;
+            finish_current(TWI_XFER_DONE);
+            break;
+        default:
+            // SLA/data NACK, arbitration lost or bus error
+            finish_current(TWI_XFER_ERROR);
+            break;
+    }
+}
+
+ISR(TWI_vect) {
+    if (s_q_count == 0) {
+        // Spurious: nobody owns the bus, release it
+        TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+        return;
+    }
+    twi_step();
+}
+
 void twi_init(void) {
     TWSR = 0x00; // prescaler 1
-    TWBR = (uint8_t)(((F_CPU/TWI_FREQ_HZ)-16)/2);
+    twi_speed_reset();
+    TWBR = twi_speed_twbr(0);
+    TWCR = (1<<TWEN);
+    s_q_head = 0;
+    s_q_count = 0;
+    s_idx = 0;
+}
+
+bool twi_probe(uint8_t addr7) {
+    // Address-only write: START, SLA+W, STOP. ACK means the device answered.
+    return twi_write_read(addr7, 0, 0, 0, 0);
+}
+
+bool twi_submit(TwiXfer* x) {
+    if (!x || x->state == TWI_XFER_QUEUED || x->state == TWI_XFER_BUSY) {
+        return false;
+    }
+    bool ok = false;
+    uint8_t s = SREG;
+    cli();
+    if (s_q_count < TWI_QUEUE_LEN) {
+        x->state = TWI_XFER_QUEUED;
+        s_queue[(uint8_t)((s_q_head + s_q_count) % TWI_QUEUE_LEN)] = x;
+        s_q_count++;
+        if (s_q_count == 1) {
+            // Bus idle: kick off START; the rest happens in TWI_vect
+            x->state = TWI_XFER_BUSY;
+            s_idx = 0;
+            twi_wait_stop();
+            TWBR = twi_speed_twbr(x->addr);
+            TWCR = TWCR_RUN | (1<<TWSTA);
+        }
+        ok = true;
+    }
+    SREG = s;
+    return ok;
+}
+
+bool twi_busy(void) {
+    return s_q_count != 0;
+}
+
+void twi_abort(void) {
+    uint8_t s = SREG;
+    cli();
+    TWCR = 0; // disable TWI: releases SDA/SCL and resets the state machine
+    while (s_q_count) {
+        TwiXfer* x = current();
+        s_q_head = (uint8_t)((s_q_head + 1) % TWI_QUEUE_LEN);
+        s_q_count--;
+        x->state = TWI_XFER_ERROR;
+        if (x->done) { x->done(x); }
+    }
+    s_idx = 0;
     TWCR = (1<<TWEN);
+    SREG = s;
 }
+
+bool twi_transfer(TwiXfer* x) {
+    // Queued async traffic may fill every slot; wait for the head to finish
+    // rather than failing the caller (abort like twi_start() if it never does)
+    uint32_t slot_loops = TWI_TIMEOUT_LOOPS;
+    while (s_q_count >= TWI_QUEUE_LEN) {
+        if (!irq_enabled() && (TWCR & (1<<TWINT))) { twi_step(); }
+        if (--slot_loops == 0) { twi_abort(); break; }
+    }
+    if (!twi_submit(x)) {
+        return false;
+    }
+    uint32_t loops = TWI_TIMEOUT_LOOPS * ((uint32_t)x->tx_len + x->rx_len + 3UL);
+    while (x->state == TWI_XFER_QUEUED || x->state == TWI_XFER_BUSY) {
+        if (!irq_enabled() && (TWCR & (1<<TWINT))) {
+            twi_step(); // no ISR before sei(): drive the engine from here
+        }
+        if (--loops == 0) {
+            twi_abort();
+            return false;
+        }
+    }
+    return x->state == TWI_XFER_DONE;
+}
+
+bool twi_write_read(uint8_t addr7, const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len) {
+    TwiXfer x = { addr7, tx, tx_len, rx, rx_len, 0, TWI_XFER_IDLE };
+    return twi_transfer(&x);
+}
+
 uint8_t twi_start(uint8_t addr) {
+    // Don't interleave polled frames with queued transactions
+    uint32_t loops = TWI_TIMEOUT_LOOPS;
+    while (twi_busy()) {
+        if (!irq_enabled() && (TWCR & (1<<TWINT))) { twi_step(); }
+        if (--loops == 0) { twi_abort(); break; }
+    }
+    TWBR = twi_speed_twbr((uint8_t)(addr >> 1));
     TWCR = (1<<TWINT)|(1<<TWSTA)|(1<<TWEN);
     if (!twi_wait_twint()) { return 0; }
     TWDR = addr;
@@ -1,14 +1,100 @@
 /*
- * HAL TWI (I2C): blocking master-mode transactions for VL6180 and
- * APDS9960 sensors.
+ * HAL TWI (I2C): master-mode transactions for VL6180 and APDS9960
+ * sensors. Transactions are queued and run by the TWI_vect state machine;
+ * blocking helpers wrap the same engine for init code and simple drivers.
  */
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 
-/** Initialize TWI hardware for 100kHz master mode. */
+/** Lifecycle of a queued transaction (TwiXfer.state). */
+typedef enum {
+    TWI_XFER_IDLE = 0,  /**< Never submitted or already consumed. */
+    TWI_XFER_QUEUED,    /**< Waiting for the bus. */
+    TWI_XFER_BUSY,      /**< On the bus. */
+    TWI_XFER_DONE,      /**< Completed; rx buffer is valid. */
+    TWI_XFER_ERROR      /**< NACK, arbitration loss or abort. */
+} TwiXferState;
+
+typedef struct TwiXfer TwiXfer;
+
+/** Completion callback; runs in ISR context, keep it short and do not
+ * call twi_submit() from it (set a flag and submit from the main loop). */
+typedef void (*TwiXferCallback)(TwiXfer* x);
+
+/** One write-then-read transaction. The write phase is sent first; if
+ * rx_len > 0 a repeated START switches to reading rx_len bytes (burst read).
+ * Either phase may be empty. The struct and its buffers must stay valid
+ * until state becomes DONE or ERROR.
+ */
+struct TwiXfer {
+    uint8_t addr;            /**< 7-bit device address. */
+    const uint8_t* tx;       /**< Bytes to write (register address, data). */
+    uint8_t tx_len;
+    uint8_t* rx;             /**< Destination for bytes read. */
+    uint8_t rx_len;
+    TwiXferCallback done;    /**< Optional completion callback (may be NULL). */
+    volatile uint8_t state;  /**< TwiXferState; poll for completion. */
+};
+
+/** Initialize TWI hardware for master mode at TWI_FREQ_HZ (100 kHz);
+ * clears all per-device speed selections.
+ */
 void twi_init(void);
 
+/** Set the default SCL clock for devices without an explicit speed. */
+void twi_set_speed_hz(uint32_t hz);
+
+/** Select the SCL clock used for one device (applied at each START to it).
+ * @param addr7 7-bit device address.
+ * @param hz    Bus clock, e.g. 100000 or 400000.
+ * @return false if the per-device table (TWI_MAX_DEVICES) is full.
+ */
+bool twi_set_device_speed_hz(uint8_t addr7, uint32_t hz);
+
+/** Effective SCL clock for a device (its own selection or the default). */
+uint32_t twi_get_device_speed_hz(uint8_t addr7);
+
+/** Address-only probe at the device's current speed.
+ * @return true if the device ACKed its address.
+ */
+bool twi_probe(uint8_t addr7);
+
+/** Boot-time speed check: select hz for the device and probe it; if it
+ * does not ACK, fall back to TWI_FREQ_HZ.
+ * @return The speed now in effect for the device.
+ */
+uint32_t twi_negotiate_speed_hz(uint8_t addr7, uint32_t hz);
+
+/** Queue a transaction; starts immediately if the bus is idle.
+ * Non-blocking. Completion is reported via x->state and x->done.
+ * @return false if x is already in flight or the queue is full.
+ */
+bool twi_submit(TwiXfer* x);
+
+/** @return true while a queued transaction is pending or on the bus. */
+bool twi_busy(void);
+
+/** Reset the TWI peripheral and fail every queued transaction with
+ * TWI_XFER_ERROR. Use to recover from a stuck bus.
+ */
+void twi_abort(void);
+
+/** Submit a transaction and wait for it to finish (bounded by
+ * TWI_TIMEOUT_LOOPS per byte). If the queue is full it first waits, bounded
+ * by TWI_TIMEOUT_LOOPS, for a slot to free up. Works before sei() by stepping
+ * the state machine from the polling loop.
+ * @return true on TWI_XFER_DONE, false on error or timeout.
+ */
+bool twi_transfer(TwiXfer* x);
+
+/** Blocking convenience: write tx then read rx from a 7-bit address.
+ * @return true on success.
+ */
+bool twi_write_read(uint8_t addr7, const uint8_t* tx, uint8_t tx_len, uint8_t* rx, uint8_t rx_len);
+
 /** Send START and slave address (7-bit<<1 | R/W) and wait.
+ * Low-level polled API; waits for queued transactions to drain first.
  * @param addr Address byte including R/W bit.
  * @return TWSR status code (upper 5 bits) or 0 on timeout.
  */
@@ -0,0 +1,80 @@
+/*
+ * HAL TWI bus clock selection
+ * ---------------------------
+ * Each device gets its own SCL clock, kept as the precomputed TWBR value that
+ * hal/twi.c loads at the START of every transaction to it, so fast-mode
+ * sensors and 100 kHz-only devices can share the bus. Devices without an
+ * entry use the default (TWI_FREQ_HZ unless twi_set_speed_hz() changed it).
+ * twi_negotiate_speed_hz() is the boot-time check: select the fast clock,
+ * probe, and fall back to standard mode if the device does not answer.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform/config.h"
+#include "twi.h"
+#include "twi_speed.h"
+
+typedef struct {
+    uint8_t addr; // 7-bit address
+    uint8_t twbr; // precomputed bit-rate register value
+} TwiDeviceSpeed;
+static TwiDeviceSpeed s_dev_speed[TWI_MAX_DEVICES];
+static uint8_t s_dev_count = 0;
+static uint8_t s_default_twbr = 0;
+
+static uint8_t twbr_for_hz(uint32_t hz) {
+    // SCL = F_CPU / (16 + 2*TWBR) with prescaler 1
+    if (hz == 0) { hz = TWI_FREQ_HZ; }
+    uint32_t div = F_CPU / hz;
+    uint32_t twbr = (div > 16UL) ? ((div - 16UL) / 2UL) : 0;
+    if (twbr > 255UL) { twbr = 255UL; }
+    return (uint8_t)twbr;
+}
+
+void twi_speed_reset(void) {
+    s_default_twbr = twbr_for_hz(TWI_FREQ_HZ);
+    s_dev_count = 0;
+}
+
+uint8_t twi_speed_twbr(uint8_t addr7) {
+    for (uint8_t i = 0; i < s_dev_count; i++) {
+        if (s_dev_speed[i].addr == addr7) { return s_dev_speed[i].twbr; }
+    }
+    return s_default_twbr;
+}
+
+void twi_set_speed_hz(uint32_t hz) {
+    s_default_twbr = twbr_for_hz(hz);
+}
+
+bool twi_set_device_speed_hz(uint8_t addr7, uint32_t hz) {
+    uint8_t twbr = twbr_for_hz(hz);
+    for (uint8_t i = 0; i < s_dev_count; i++) {
+        if (s_dev_speed[i].addr == addr7) {
+            s_dev_speed[i].twbr = twbr;
+            return true;
+        }
+    }
+    if (s_dev_count >= TWI_MAX_DEVICES) {
+        return false;
+    }
+    s_dev_speed[s_dev_count].addr = addr7;
+    s_dev_speed[s_dev_count].twbr = twbr;
+    s_dev_count++;
+    return true;
+}
+
+uint32_t twi_get_device_speed_hz(uint8_t addr7) {
+    return F_CPU / (16UL + 2UL * (uint32_t)twi_speed_twbr(addr7));
+}
+
+uint32_t twi_negotiate_speed_hz(uint8_t addr7, uint32_t hz) {
+    if (!twi_set_device_speed_hz(addr7, hz)) {
+        return twi_get_device_speed_hz(addr7);
+    }
+    if (!twi_probe(addr7)) {
+        // NACK (or timeout) at the requested clock: fall back to standard mode
+        twi_set_device_speed_hz(addr7, TWI_FREQ_HZ);
+    }
+    return twi_get_device_speed_hz(addr7);
+}
@@ -0,0 +1,14 @@
+/*
+ * HAL TWI bus clock selection: the per-device speed table behind
+ * twi_set_speed_hz(), twi_set_device_speed_hz(), twi_get_device_speed_hz()
+ * and twi_negotiate_speed_hz() (declared in twi.h). It touches no registers,
+ * so the host simulator links it as-is next to its model of the bus.
+ */
+#pragma once
+#include <stdint.h>
+
+/** Forget all per-device selections; the default is TWI_FREQ_HZ again. */
+void twi_speed_reset(void);
+
+/** Bit-rate register value (prescaler 1) for a device's clock. */
+uint8_t twi_speed_twbr(uint8_t addr7);
@@ -1,13 +1,53 @@
 /*
- * HAL UART (TX-only)
- * ------------------
+ * HAL UART
+ * --------
  * Minimal UART init and transmit functions used for logging. We use double
  * speed mode for better baud accuracy at 115200 on 16 MHz.
+ * Transmit is buffered: the uart_write*() functions only copy into a ring
+ * buffer and the USART_UDRE ISR shifts bytes out, so a log line costs the main
+ * loop a few microseconds instead of ~90 us per character. When the ring is
+ * full the data is dropped (and counted) rather than stalling decide/actuate.
+ * Writes between uart_line_begin() and uart_line_end() form one line: the ISR
+ * only sends up to s_tx_commit, so the line's bytes wait in the ring until
+ * uart_line_end() releases them, or rolls them back if any part did not fit.
+ * A log line is thus sent whole or not at all, never cut between tokens.
+ * Until global interrupts are enabled the ISR cannot run, so writes fall back
+ * to polled transmission to keep boot banners visible.
+ * Receive is the mirror image: the USART_RX ISR appends each byte to a small
+ * ring and uart_read_byte() takes them out from the main loop. Bytes that
+ * arrive with the ring full, or with a framing/overrun error, are dropped and
+ * counted.
  */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "platform/config.h"
 #include "uart.h"
 
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) || (UART_TX_BUFFER_SIZE > 256)
+#error "UART_TX_BUFFER_SIZE must be a power of two <= 256"
+#endif
+#define TX_MASK ((uint8_t)(UART_TX_BUFFER_SIZE - 1))
+#if (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1)) || (UART_RX_BUFFER_SIZE > 256)
+#error "UART_RX_BUFFER_SIZE must be a power of two <= 256"
+#endif
+#define RX_MASK ((uint8_t)(UART_RX_BUFFER_SIZE - 1))
+
+static volatile uint8_t s_tx_buf[UART_TX_BUFFER_SIZE];
+static volatile uint8_t s_tx_head = 0; // next write slot (main loop only)
+static volatile uint8_t s_tx_tail = 0; // next byte to send (ISR only once running)
+static volatile uint8_t s_tx_commit = 0; // the ISR sends up to here (main loop only)
+static bool s_in_line = false;
+static bool s_line_failed = false; // part of the current line was dropped
+static uint8_t s_line_start = 0;    // s_tx_head at uart_line_begin()
+static uint32_t s_tx_queued = 0;
+static uint32_t s_tx_dropped = 0;
+static volatile uint8_t s_rx_buf[UART_RX_BUFFER_SIZE];
+static volatile uint8_t s_rx_head = 0; // next write slot (ISR only)
+static volatile uint8_t s_rx_tail = 0; // next byte to read (main loop only)
+static volatile uint32_t s_rx_dropped = 0; // written by the ISR
+
 void uart_init(uint32_t baud) {
     // Assume F_CPU=16MHz. Use double speed (U2X0) for better accuracy at high baud rates (e.g., 115200).
     // Baud formula with U2X0=1: UBRR = F_CPU/(8*baud) - 1
@@ -15,18 +55,236 @@ void uart_init(uint32_t baud) {
     uint16_t ubrr = (uint16_t)((F_CPU / (8UL * baud)) - 1UL);
     UBRR0H = (ubrr >> 8);
     UBRR0L = (ubrr & 0xFF);
-    UCSR0B = (1<<TXEN0); // TX only for now
+    UCSR0B = (1<<TXEN0)|(1<<RXEN0)|(1<<RXCIE0); // UDRIE0 is enabled on demand
     UCSR0C = (1<<UCSZ01)|(1<<UCSZ00); // 8N1
+    s_tx_head = 0;
+    s_tx_tail = 0;
+    s_tx_commit = 0;
+    s_in_line = false;
+    s_tx_queued = 0;
+    s_tx_dropped = 0;
+    s_rx_head = 0;
+    s_rx_tail = 0;
+    s_rx_dropped = 0;
 }
-void uart_write_byte(uint8_t b) {
-    while (!(UCSR0A & (1<<UDRE0))) { }
-    UDR0 = b;
+
+static inline uint8_t tx_free(void) {
+    // One slot is kept empty to distinguish full from empty
+    return (uint8_t)(TX_MASK - ((uint8_t)(s_tx_head - s_tx_tail) & TX_MASK));
+}
+
+static inline bool irq_enabled(void) {
+    return (SREG & (1<<SREG_I)) != 0;
 }
+
+// Polled drain used before sei(): push out anything queued so far, in order.
+static void tx_drain_polled(void) {
+    while (s_tx_tail != s_tx_commit) {
+        while (!(UCSR0A & (1<<UDRE0))) { }
+        UDR0 = s_tx_buf[s_tx_tail];
+        s_tx_tail = (uint8_t)((s_tx_tail + 1) & TX_MASK);
+    }
+}
+
+static inline void tx_push(uint8_t b) {
+    s_tx_buf[s_tx_head] = b;
+    s_tx_head = (uint8_t)((s_tx_head + 1) & TX_MASK);
+}
+
+// Let the ISR send what was pushed, unless a line is still being built
+static inline void tx_commit(void) {
+    if (!s_in_line) {
+        s_tx_commit = s_tx_head;
+        UCSR0B |= (1<<UDRIE0);
+    }
+}
+
+// A write of n bytes does not fit: count it, and fail the line it belongs to
+static inline void tx_drop(uint16_t n) {
+    s_tx_dropped += n;
+    if (s_in_line) {
+        s_line_failed = true;
+    }
+}
+
+// Once part of a line is dropped the rest of it is dropped too
+static inline bool line_failed(void) {
+    return s_in_line && s_line_failed;
+}
+
+bool uart_write_byte(uint8_t b) {
+    if (!irq_enabled()) {
+        tx_drain_polled();
+        while (!(UCSR0A & (1<<UDRE0))) { }
+        UDR0 = b;
+        s_tx_queued++;
+        return true;
+    }
+    if (line_failed() || tx_free() == 0) {
+        tx_drop(1);
+        return false;
+    }
+    tx_push(b);
+    s_tx_queued++;
+    tx_commit();
+    return true;
+}
+
 int uart_write(const char* s) {
     int n = 0;
-    while (*s) { 
-        uart_write_byte((uint8_t)*s++); 
-        n++; 
+    if (!irq_enabled()) {
+        while (*s) {
+            uart_write_byte((uint8_t)*s++);
+            n++;
+        }
+        return n;
+    }
+    const char* p = s;
+    while (*p) {
+        p++;
+    }
+    uint16_t len = (uint16_t)(p - s);
+    if (len == 0) {
+        return 0;
+    }
+    if (line_failed() || len > tx_free()) {
+        tx_drop(len);
+        return 0;
+    }
+    while (*s) {
+        tx_push((uint8_t)*s++);
+        n++;
+    }
+    s_tx_queued += (uint32_t)n;
+    tx_commit();
+    return n;
+}
+
+int uart_write_P(const char* s) {
+    int n = 0;
+    uint8_t ch;
+    if (!irq_enabled()) {
+        while ((ch = pgm_read_byte(s++)) != 0) {
+            uart_write_byte(ch);
+            n++;
+        }
+        return n;
+    }
+    size_t len = strlen_P(s);
+    if (len == 0) {
+        return 0;
     }
+    if (line_failed() || len > tx_free()) {
+        tx_drop((uint16_t)len);
+        return 0;
+    }
+    while ((ch = pgm_read_byte(s++)) != 0) {
+        tx_push(ch);
+        n++;
+    }
+    s_tx_queued += (uint32_t)n;
+    tx_commit();
+    return n;
+}
+
+uint8_t uart_write_bytes(const uint8_t* p, uint8_t n) {
+    if (!irq_enabled()) {
+        for (uint8_t i = 0; i < n; i++) {
+            uart_write_byte(p[i]);
+        }
+        return n;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (line_failed() || n > tx_free()) {
+        tx_drop(n);
+        return 0;
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        tx_push(p[i]);
+    }
+    s_tx_queued += n;
+    tx_commit();
     return n;
 }
+
+void uart_line_begin(void) {
+    s_in_line = true;
+    s_line_failed = false;
+    s_line_start = s_tx_head;
+}
+
+bool uart_line_end(void) {
+    if (!s_in_line) {
+        return true;
+    }
+    s_in_line = false;
+    if (s_line_failed) {
+        // Take back the part that fit; the ISR never saw it
+        uint8_t n = (uint8_t)((s_tx_head - s_line_start) & TX_MASK);
+        s_tx_head = s_line_start;
+        s_tx_queued -= n;
+        s_tx_dropped += n;
+        return false;
+    }
+    if (s_tx_head != s_tx_commit) {
+        tx_commit();
+    }
+    return true;
+}
+
+uint8_t uart_tx_free(void) {
+    return tx_free();
+}
+
+uint32_t uart_tx_queued(void) {
+    return s_tx_queued;
+}
+
+uint32_t uart_tx_dropped(void) {
+    return s_tx_dropped;
+}
+
+bool uart_read_byte(uint8_t* b) {
+    uint8_t tail = s_rx_tail;
+    if (tail == s_rx_head) {
+        return false;
+    }
+    *b = s_rx_buf[tail];
+    s_rx_tail = (uint8_t)((tail + 1) & RX_MASK);
+    return true;
+}
+
+uint32_t uart_rx_dropped(void) {
+    uint8_t s = SREG;
+    cli();
+    uint32_t v = s_rx_dropped;
+    SREG = s;
+    return v;
+}
+
+ISR(USART_RX_vect) {
+    // Status must be read before UDR0, which clears it
+    uint8_t err = UCSR0A & ((1<<FE0)|(1<<DOR0));
+    uint8_t b = UDR0;
+    uint8_t head = s_rx_head;
+    uint8_t next = (uint8_t)((head + 1) & RX_MASK);
+    if (err || next == s_rx_tail) {
+        s_rx_dropped++;
+        return;
+    }
+    s_rx_buf[head] = b;
+    s_rx_head = next;
+}
+
+ISR(USART_UDRE_vect) {
+    uint8_t tail = s_tx_tail;
+    if (tail == s_tx_commit) {
+        // Ring drained: stop UDRE interrupts until the next write
+        UCSR0B &= ~(1<<UDRIE0);
+        return;
+    }
+    UDR0 = s_tx_buf[tail];
+    s_tx_tail = (uint8_t)((tail + 1) & TX_MASK);
+}
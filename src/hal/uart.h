@@ -1,17 +1,62 @@
 /*
  * HAL UART: initialize and transmit bytes/strings at a configured baud
- * rate; TX-only minimal API for logging.
+ * rate. TX is buffered and drained by the UDRE ISR (logging); RX is buffered
+ * by the RX ISR and read without blocking (serial commands).
  */
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 
-/** Initialize UART for TX at the given baud rate. */
+/** Initialize UART for TX and RX at the given baud rate. */
 void uart_init(uint32_t baud);
 
-/** Write one byte to UART (blocking until shifted). */
-void uart_write_byte(uint8_t b);
+/** Queue one byte for transmission (non-blocking once interrupts are enabled).
+ * Before sei() the byte is shifted out synchronously so boot banners appear
+ * even if a later init step hangs.
+ * @return true if queued/sent, false if dropped because the TX buffer was full.
+ */
+bool uart_write_byte(uint8_t b);
 
-/** Write a NUL-terminated string to UART.
- * @return Number of characters written.
+/** Queue a NUL-terminated string for transmission.
+ * The string is queued whole or not at all, so it is never cut mid-token; a
+ * line built from several writes needs uart_line_begin()/uart_line_end() to
+ * be kept whole. A dropped string is counted in uart_tx_dropped().
+ * @return Number of characters queued (0 if dropped).
  */
 int uart_write(const char* s);
+
+/** uart_write() for a string in flash (PSTR() or PROGMEM, see platform/progmem.h). */
+int uart_write_P(const char* s);
+
+/** Queue n raw bytes (may contain NUL), whole or not at all like uart_write().
+ * @return n if queued, 0 if dropped.
+ */
+uint8_t uart_write_bytes(const uint8_t* p, uint8_t n);
+
+/** Start a line: the writes up to uart_line_end() are sent as one unit.
+ * Lines do not nest. Before sei() writes are polled out and this has no effect.
+ */
+void uart_line_begin(void);
+
+/** Finish the line started by uart_line_begin(). If any write in it did not
+ * fit, the whole line is taken back and counted in uart_tx_dropped().
+ * @return true if the line was queued, false if it was dropped.
+ */
+bool uart_line_end(void);
+
+/** Bytes that can be queued right now without dropping (0 when full). */
+uint8_t uart_tx_free(void);
+
+/** Total bytes accepted into the TX buffer since uart_init(). */
+uint32_t uart_tx_queued(void);
+
+/** Total bytes dropped because the TX buffer was full since uart_init(). */
+uint32_t uart_tx_dropped(void);
+
+/** Take the oldest received byte from the RX buffer (never blocks).
+ * @return true and the byte in *b, or false if nothing has been received.
+ */
+bool uart_read_byte(uint8_t* b);
+
+/** Total received bytes lost since uart_init(): RX buffer full, framing or overrun errors. */
+uint32_t uart_rx_dropped(void);
@@ -17,62 +17,100 @@
  *   and application modules (interrupt wiring, sensing pipeline, actuation).
  * - Print a few boot lines so you can verify serial works even if sensors hang.
  * - Start the belt by setting a target speed in mm/s (driver turns that into steps/s).
- * - Enter the main loop:
- *     sense_poll() processes VL6180 low-threshold interrupts (< threshold) and ends a "session" via quiet-timeout.
+ * - app_setup() does all of the above; main() then calls app_loop() forever
+ *   (the host simulator in sim/ drives the same two functions). Each pass:
+ *     sense_poll() processes VL6180 threshold interrupts: LOW (< threshold) starts a "session",
+ *     HIGH (> threshold + hysteresis) ends it.
  *     When a session ends, we compute length from dwell time, classify color from APDS samples,
- *     then route/schedule a future actuation for the correct diverter.
- *     decide_tick() checks if any scheduled actuation is due (enforcing min spacing) and fires it.
- *     actuate_tick() recenters servos after a short dwell.
- *     log_count() prints counters every N seconds for visibility.
+ *     then route/schedule a future actuation for the correct diverter. A block arriving while
+ *     the previous one is still being finalized gets its own session slot; finished results
+ *     wait in a small FIFO and are handed out one per pass.
+ *     decide_tick() checks if any scheduled actuation is due (enforcing per-diverter min spacing) and fires it.
+ *     actuate_tick() recenters servos once the block has passed (per-block hold).
+ *     Every N seconds the UART, SCHED and COUNT lines are printed for visibility,
+ *     one per pass once the TX ring has room for the longest of them (followed
+ *     by the utils/instr.c timing statistics when INSTR_ENABLE is set).
+ *     commands_poll() reads a few received bytes and runs at most one serial
+ *     command (get/set belt speed, spacing, throughput limit; stats).
  * Notes:
- * - Timer usage: Timer0 = millis(), Timer1 = stepper rate (CTC), Timer2 = software servo PWM.
+ * - Timer usage: Timer0 = millis() (COMPA) and belt ramp tick (COMPB), Timer1 = stepper rate (CTC, OC1A toggles STEP in hardware),
+ *   Timer2 = servo pulse scheduler (compare match per edge).
  * - ISRs use direct port writes where timing is sensitive to reduce jitter.
  */
+#include <stdbool.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "platform/pins.h"
 #include "platform/config.h"
+#include "platform/progmem.h"
 #include "hal/timers.h"
 #include "hal/uart.h"
 #include "hal/twi.h"
 #include "drivers/tb6600.h"
 #include "drivers/servo.h"
+#include "drivers/vl6180.h"
+#include "drivers/apds9960.h"
 #include "app/interrupts.h"
 #include "app/sense.h"
 #include "app/decide.h"
 #include "app/actuate.h"
+#include "app/commands.h"
 #include "utils/log.h"
+#include "utils/instr.h"
+#include "utils/trace.h"
+#include "main.h"
 
 // Forward declaration to ensure availability even if headers differ
 void log_sep(void);
 
+// Main loop state (kept across app_loop() iterations)
+static uint32_t s_last_count_log_ms = 0;
+static uint16_t s_event_id = 0;
+static bool s_belt_ramping = true;
 
-int main(void) {
+// Stats dump (UART, SCHED, COUNT), printed one line per pass once the TX ring
+// has room for a whole line (LOG_STATS_LINE_MAX), so a burst never overflows
+// the ring and a busy link still gets them out between event logs.
+typedef enum { STATS_IDLE = 0, STATS_UART, STATS_SCHED, STATS_COUNT } StatsLine;
+static uint8_t s_stats_line = STATS_IDLE;
+static uint32_t s_stats_t_ms = 0;
+static bool s_stats_periodic = false; // arm instr_dump() after COUNT
+static bool s_stats_forced = false;   // "stats" command: print with LOG_CAT_COUNT off too
+
+void app_setup(void) {
     
     timers_init();
     uart_init(UART_BAUD);
     // Print early boot banner before any I2C/sensor init to verify UART works even if sensors hang
-    uart_write("BOOT Liukuhihna firmware\r\n");
-    uart_write("UART=115200 8N1, VL6180 continuous, low-threshold=6cm\r\n");
+    uart_write_P(PSTR("BOOT Liukuhihna firmware\r\n"));
+    uart_write_P(PSTR("UART=115200 8N1, VL6180 continuous, thresholds=6cm/+5mm\r\n"));
 
     twi_init();
-    uart_write("I2C init done\r\n");
+    uart_write_P(PSTR("I2C init done\r\n"));
 
     tb6600_init();
     servo_init();
     interrupts_init();
     actuate_init();
     sense_init();
-    uart_write("Sensors init done\r\n");
+    commands_init();
+    uart_write_P(PSTR("Sensors init done\r\n"));
+
+    // Both sensors support 400 kHz fast mode; keep 100 kHz for any that NACKs
+    log_i2c_speed(PSTR("VL6180"), twi_negotiate_speed_hz(VL6180_I2C_ADDR, TWI_FAST_FREQ_HZ));
+    log_i2c_speed(PSTR("APDS9960"), twi_negotiate_speed_hz(APDS9960_I2C_ADDR, TWI_FAST_FREQ_HZ));
 
     decide_init();
     decide_set_max_blocks_per_min(DECIDE_MAX_BLOCKS_PER_MIN);
-    decide_set_min_spacing_ms(DECIDE_MIN_SPACING_MS); 
+    decide_set_position_min_spacing_ms(POS1, DECIDE_MIN_SPACING_POS1_MS);
+    decide_set_position_min_spacing_ms(POS2, DECIDE_MIN_SPACING_POS2_MS);
+    decide_set_position_min_spacing_ms(POS3, DECIDE_MIN_SPACING_POS3_MS);
 
     // Configure belt speed on the driver, then propagate the achieved (quantized)
-    // value back to Decide so length math matches real motion.
+    // value back to Decide so length math matches real motion. The belt ramps up
+    // after sei(); the main loop tracks the instantaneous speed until it arrives.
     tb6600_set_speed(BELT_MM_PER_S);
-    decide_set_belt_mm_per_s(tb6600_get_speed_mm_per_s());
+    decide_set_belt_mm_per_s(tb6600_get_target_speed_mm_per_s());
     tb6600_start(); // BUG tb6600_start was missing?
 
     counters_reset();
@@ -91,59 +129,132 @@ int main(void) {
     
 
     sei(); // enable interrupts
+}
 
-    uint32_t last_count_log_ms = 0;
-    static uint16_t event_id = 0;
-    for (;;) {
-        SenseResult sr;
-        if (sense_poll(&sr)) {
-            uint16_t my_id = ++event_id;
+// A request while a dump is pending restarts it and keeps both reasons
+static void stats_request(uint32_t now, bool periodic) {
+    if (s_stats_line == STATS_IDLE) {
+        s_stats_periodic = false;
+        s_stats_forced = false;
+    }
+    if (periodic) {
+        s_stats_periodic = true;
+    } else {
+        s_stats_forced = true;
+    }
+    s_stats_line = STATS_UART;
+    s_stats_t_ms = now;
+}
+
+static void stats_tick(void) {
+    if (s_stats_line == STATS_IDLE || uart_tx_free() < LOG_STATS_LINE_MAX) {
+        return;
+    }
+    uint32_t t = s_stats_t_ms;
+    uint8_t mask = log_get_mask();
+    if (s_stats_forced) {
+        log_set_mask((uint8_t)(mask | LOG_CAT_COUNT));
+    }
+    switch (s_stats_line) {
+        case STATS_UART:
+            log_uart_stats(t);
+            s_stats_line = STATS_SCHED;
+            break;
+        case STATS_SCHED:
+            log_sched_stats(t, decide_queue_depth(), decide_queue_high_water(), SCHED_CAPACITY,
+                            decide_missed_count());
+            s_stats_line = STATS_COUNT;
+            break;
+        default: {
+            const Counters* c = counters_get();
+            log_count(t, c->total, c->diverted, c->passed, c->fault,
+                      c->red, c->green, c->blue, c->other);
+            if (s_stats_periodic) {
+                instr_dump(t);
+            }
+            s_stats_line = STATS_IDLE;
+            break;
+        }
+    }
+    log_set_mask(mask);
+}
 
-            log_detect(sr.ev.t_enter_ms, my_id);
-            log_clear(sr.ev.t_exit_ms, my_id);
-            log_length(sr.ev.t_exit_ms, sr.length.length_mm, sr.length.dwell_ms, my_id);
+void app_loop(void) {
+    instr_loop_mark();
+    // While tb6600 ramps, feed the instantaneous speed to Decide (and so to
+    // Sense length math); one last update once it settles on the target.
+    bool ramping = !tb6600_at_target_speed();
+    if (ramping || s_belt_ramping) {
+        decide_set_belt_mm_per_s(tb6600_get_speed_mm_per_s());
+    }
+    s_belt_ramping = ramping;
+    SenseResult sr;
+    if (sense_poll(&sr)) {
+        uint16_t my_id = ++s_event_id;
+        trace_begin(my_id, sr.ev.t_enter_ms, sr.ev.t_exit_ms, millis());
 
-            counters_inc_total();
+        log_detect(sr.ev.t_enter_ms, my_id);
+        log_clear(sr.ev.t_exit_ms, my_id);
+        log_length(sr.ev.t_exit_ms, sr.length.length_mm, sr.length.dwell_ms, my_id);
 
-            // Handle ambiguous classifications as faults
-            if (sr.ambiguous) {
-                log_fault(millis(), "Ambiguous");
-                counters_inc_fault();
-                continue;
-            }
+        counters_inc_total();
+
+        // Handle ambiguous classifications as faults
+        if (sr.ambiguous) {
+            log_fault(millis(), PSTR("Ambiguous"));
+            counters_inc_fault();
+            trace_close(my_id);
+            return;
+        }
 
-            TargetPosition pos = decide_route(sr.color, sr.length.cls);
-            log_classify(sr.ev.t_exit_ms, sr.color, sr.length, my_id);
-            // Increment color counters only for non-ambiguous classifications
-            if (!sr.ambiguous) {
-                switch (sr.color) {
-                    case COLOR_RED: counters_inc_red(); break;
-                    case COLOR_GREEN: counters_inc_green(); break;
-                    case COLOR_BLUE: counters_inc_blue(); break;
-                    default: counters_inc_other(); break;
-                }
+        TargetPosition pos = decide_route(sr.color, sr.length.cls);
+        log_classify(sr.ev.t_exit_ms, sr.color, sr.length, my_id);
+        // Increment color counters only for non-ambiguous classifications
+        if (!sr.ambiguous) {
+            switch (sr.color) {
+                case COLOR_RED: counters_inc_red(); break;
+                case COLOR_GREEN: counters_inc_green(); break;
+                case COLOR_BLUE: counters_inc_blue(); break;
+                default: counters_inc_other(); break;
             }
-            
-            if (pos == PASS_THROUGH) { 
+        }
+        
+        if (pos == PASS_THROUGH) { 
+            counters_inc_passed();
+            log_pass(millis());
+            trace_close(my_id);
+        } else {
+            if (decide_schedule_at_position(pos, tb6600_position_at_ms(sr.ev.t_exit_ms), sr.ev.t_exit_ms, sr.length, my_id)) {
+                counters_inc_diverted();
+            } else {
                 counters_inc_passed();
                 log_pass(millis());
-            } else {
-                if (decide_schedule(pos, sr.ev.t_exit_ms, my_id)) {
-                    counters_inc_diverted();
-                } else {
-                    counters_inc_passed();
-                    log_pass(millis());
-                }
+                trace_close(my_id);
             }
         }
-        uint32_t now = millis();
-        decide_tick(now);
-        actuate_tick(now);
-        const Counters* c = counters_get();
-        if ((now - last_count_log_ms) >= COUNT_LOG_MIN_INTERVAL_MS) {
-            log_count(now, c->total, c->diverted, c->passed, c->fault,
-                      c->red, c->green, c->blue, c->other);
-            last_count_log_ms = now;
-        }
+    }
+    uint32_t now = millis();
+    decide_tick(now);
+    actuate_tick(now);
+    if ((now - s_last_count_log_ms) >= COUNT_LOG_MIN_INTERVAL_MS) {
+        stats_request(now, true);
+        s_last_count_log_ms = now;
+    }
+    stats_tick();
+    sense_debug_tick();
+    instr_tick();
+    trace_tick();
+    commands_poll();
+    if (commands_take_stats_request()) {
+        stats_request(now, false);
+    }
+}
+
+#ifndef SIM_HOST
+int main(void) {
+    app_setup();
+    for (;;) {
+        app_loop();
     }
 }
+#endif
@@ -0,0 +1,12 @@
+/*
+ * Firmware entry points: one-time setup and one main-loop iteration.
+ * main() runs app_setup() then app_loop() forever; the host simulator
+ * (sim/, built with SIM_HOST) drives the same two functions.
+ */
+#pragma once
+
+/** Initialize hardware, drivers and app modules, then enable interrupts. */
+void app_setup(void);
+
+/** One pass of the main loop: sense, route/schedule, tick, periodic COUNT. */
+void app_loop(void);
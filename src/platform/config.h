@@ -1,6 +1,8 @@
 /*
  * Platform config: compile-time defaults for belt speed, thresholds,
  * and distances. Tune during calibration.
+ * The throughput limits (scheduler, spacing, dwell, session timeout) can be
+ * overridden with -D so scripts/bench_throughput.sh can sweep them.
  */
 #pragma once
 // Config defaults (to be tuned during calibration)
@@ -8,6 +10,15 @@
 // Stepper/TB6600
 #define STEPPER_FULL_STEPS_PER_REV 200UL
 #define TB6600_MICROSTEPS           8UL     // microstep setting => pulses/rev = 1600
+// STEP generation: 1 = Timer1 toggles OC1A (D9) in hardware, no ISR;
+// 0 = legacy TIMER1_COMPA ISR toggles the pin in software
+#define TB6600_HW_STEP              1
+// Trapezoidal belt ramps, stepped from the Timer0 COMPB tick (1 kHz).
+// 0 = change speed in one jump in that direction.
+#define TB6600_ACCEL_MM_PER_S2      200U
+#define TB6600_DECEL_MM_PER_S2      200U
+// Rate the motor can start/stop at without ramping (pull-in), in Hz
+#define TB6600_START_RATE_HZ        200U
 
 // Belt transmission
 #define GEAR_PINION_TEETH          20UL     // motor pinion
@@ -33,10 +44,51 @@
 #define SERVO_D2_MM 240   // 24 cm
 #define SERVO_D3_MM 360   // 36 cm
 #define UART_BAUD 115200
+// UART TX ring buffer size (bytes, power of two <= 256). Drained by the UDRE ISR.
+// Sized for the worst burst: a block's CLASSIFY/SCHEDULE/ACTUATE lines queued
+// back to back (~200 bytes).
+#define UART_TX_BUFFER_SIZE 256
+// UART RX ring buffer size (bytes, power of two <= 256). Filled by the RX ISR,
+// drained by commands_poll().
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE 32
+#endif
+// Serial command interpreter (app/commands.c): longest command line, longest
+// formatted reply ("OK spacing=65535,65535,65535\r\n" plus NUL), and the most
+// received bytes one commands_poll() call consumes.
+#ifndef CMD_LINE_MAX
+#define CMD_LINE_MAX 32
+#endif
+#ifndef CMD_REPLY_MAX
+#define CMD_REPLY_MAX 32
+#endif
+#ifndef CMD_BYTES_PER_POLL
+#define CMD_BYTES_PER_POLL 8
+#endif
+// Highest belt speed the "set speed"/"set belt" commands accept (mm/s)
+#ifndef CMD_BELT_MAX_MM_PER_S
+#define CMD_BELT_MAX_MM_PER_S 500
+#endif
 #define DEBOUNCE_MS 10
 
-// How long to hold servo at deflect position before auto-centering (ms)
+// How long actuate_fire() holds a servo at the deflect position before
+// auto-centering (ms). Scheduled actuations hold per block instead: until the
+// block's trailing edge has passed the diverter, plus SERVO_RELEASE_MS.
+#ifndef SERVO_DWELL_MS
 #define SERVO_DWELL_MS 250
+#endif
+#ifndef SERVO_RELEASE_MS
+#define SERVO_RELEASE_MS 50
+#endif
+// Longest per-block hold (ms), also used while the belt is stopped
+#ifndef SERVO_HOLD_MAX_MS
+#define SERVO_HOLD_MAX_MS 3000U
+#endif
+
+// Servo pulse frame and accepted pulse-width range (us); widths have 4 us resolution
+#define SERVO_FRAME_US 20000U
+#define SERVO_MIN_US 500U
+#define SERVO_MAX_US 2500U
 
 // Startup mute period for servos (ms): keep outputs low to avoid jitter, then start centered pulses
 #define SERVO_STARTUP_MUTE_MS 1500
@@ -44,24 +96,113 @@
 // Minimum interval between COUNT logs when no changes (ms)
 #define COUNT_LOG_MIN_INTERVAL_MS 10000
 
-// VL6180 single-shot measurement cadence and session quiet timeout (ms)
+// Event log format at boot: 0 = text lines, 1 = binary frames (about a quarter
+// of the bytes; decode with scripts/log_decode.py). log_set_format() switches
+// at run time.
+#ifndef LOG_FORMAT_DEFAULT
+#define LOG_FORMAT_DEFAULT 0
+#endif
+// Log categories (LOG_CAT_* in utils/log.h): 0x01 detect (DETECT, CLEAR,
+// LENGTH, "Block detected!"), 0x02 classify (CLASSIFY, FAULT), 0x04 schedule
+// (SCHEDULE, SCHEDULE_REJECT, PASS), 0x08 actuate (ACTUATE, MISSED), 0x10
+// count (COUNT, UART, SCHED), 0x20 debug ("color:"). Categories outside
+// LOG_CATEGORIES_MAX are compiled out; log_set_mask() picks among the rest at
+// run time, starting from LOG_CATEGORIES_DEFAULT. Production: 0x18.
+#ifndef LOG_CATEGORIES_MAX
+#define LOG_CATEGORIES_MAX 0x3FU
+#endif
+#ifndef LOG_CATEGORIES_DEFAULT
+#define LOG_CATEGORIES_DEFAULT LOG_CATEGORIES_MAX
+#endif
+
+// Timing instrumentation (utils/instr.c): main-loop period and actuation
+// lateness histograms plus per-ISR entry counts and cycles, printed after each
+// COUNT. 0 = compiled out (no RAM, no ISR overhead).
+#ifndef INSTR_ENABLE
+#define INSTR_ENABLE 0
+#endif
+// log2 buckets per histogram: bucket k counts values in [2^(k-1), 2^k) us, the last one is open-ended
+#define INSTR_HIST_BUCKETS 16
+
+// Per-block timing trace (utils/trace.c): one TRACE line per block with its
+// detect, classify, due, fire and return-to-center times. 0 = compiled out.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+// Blocks tracked at once (detected but not yet printed); 32 bytes each
+#define TRACE_RING_LEN 8
+
+// VL6180 measurement cadence (ms). Sessions end on the HIGH-threshold (block
+// left) interrupt; the timeout only closes a session whose exit event was lost,
+// so it must exceed the longest block dwell.
 #define VL6180_MEAS_PERIOD_MS 50
-#define VL6180_QUIET_TIMEOUT_MS 400
+#ifndef VL6180_SESSION_TIMEOUT_MS
+#define VL6180_SESSION_TIMEOUT_MS 3000
+#endif
+// Sense pipeline: session slots (one collecting, the rest finishing their
+// color reads) and finished results waiting for the main loop
+#define SENSE_SLOTS 2
+#define SENSE_RESULT_QUEUE_LEN 4
+// Per-block "color:" debug line (averaged RGBC, class, ambiguity). Finalize
+// only queues a 12-byte record; sense_debug_tick() prints it once the TX ring
+// is empty. 0 = compiled out; follows the debug log category by default.
+#ifndef SENSE_COLOR_DEBUG
+#define SENSE_COLOR_DEBUG ((LOG_CATEGORIES_MAX & 0x20U) != 0U)
+#endif
+// Color debug records waiting to be printed (oldest overwritten when full)
+#define SENSE_COLOR_DEBUG_LEN 4
 
 // I2C/TWI bus configuration
 #define TWI_FREQ_HZ 100000UL
+// Fast-mode clock tried at boot for sensors that support it (falls back to TWI_FREQ_HZ)
+#define TWI_FAST_FREQ_HZ 400000UL
+// Number of devices that can have their own bus speed
+#define TWI_MAX_DEVICES 4
 #define TWI_TIMEOUT_LOOPS 50000UL
+// Max queued TWI transactions (incl. the one on the bus)
+#define TWI_QUEUE_LEN 4
+// Abort an asynchronous sensor read still pending after this long (ms)
+#define TWI_ASYNC_TIMEOUT_MS 100
 
 // Length classification threshold (mm): smaller than this is LEN_SMALL
 #define LENGTH_SMALL_MAX_MM 50
 
-// Advance actuation to occur earlier than nominal time-of-flight arrival.
-// Positive value subtracts from scheduled due time (ms), clamped to detection time.
-#define ACTUATION_ADVANCE_MS 500
+// Open the diverter this long (ms) before the block's leading edge reaches it
+// (servo travel plus loop jitter), clamped to detection time.
+#ifndef ACTUATION_ADVANCE_MS
+#define ACTUATION_ADVANCE_MS 100
+#endif
+
+// Late actuations: an item may fire until the block's trailing edge is this
+// share of the block length (%) short of the diverter; later it is dropped as
+// MISSED. The window is never shorter than DECIDE_MISS_MIN_WINDOW_MS.
+#ifndef DECIDE_MISS_OVERLAP_PCT
+#define DECIDE_MISS_OVERLAP_PCT 50
+#endif
+#define DECIDE_MISS_MIN_WINDOW_MS 20
 
-// Scheduler capacity: max number of pending actuations queued
-#define SCHED_CAPACITY 4
+// Scheduler capacity: max number of pending actuations queued (18 bytes of
+// RAM each). The SCHED log line reports the high-water mark to size it.
+#ifndef SCHED_CAPACITY
+#define SCHED_CAPACITY 16
+#endif
 
 // Decide module defaults (used by main to initialize runtime settings)
-#define DECIDE_MIN_SPACING_MS 1000
+// Minimum rest between a diverter recentering and opening again (ms); a
+// diverter still open is simply held longer. Diverters are independent, so
+// each has its own interval (defaulting to the common one).
+#ifndef DECIDE_MIN_SPACING_MS
+#define DECIDE_MIN_SPACING_MS 250
+#endif
+#ifndef DECIDE_MIN_SPACING_POS1_MS
+#define DECIDE_MIN_SPACING_POS1_MS DECIDE_MIN_SPACING_MS
+#endif
+#ifndef DECIDE_MIN_SPACING_POS2_MS
+#define DECIDE_MIN_SPACING_POS2_MS DECIDE_MIN_SPACING_MS
+#endif
+#ifndef DECIDE_MIN_SPACING_POS3_MS
+#define DECIDE_MIN_SPACING_POS3_MS DECIDE_MIN_SPACING_MS
+#endif
+#ifndef DECIDE_MAX_BLOCKS_PER_MIN
 #define DECIDE_MAX_BLOCKS_PER_MIN 15
+#endif
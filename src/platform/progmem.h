@@ -0,0 +1,20 @@
+/*
+ * Flash-resident constants: PROGMEM data and PSTR() literals stay in flash
+ * instead of being copied to SRAM at startup; read them with pgm_read_*()
+ * or uart_write_P(). Host builds (simulator, unit tests) have a single
+ * address space, so the macros fall back to plain pointers there.
+ */
+#pragma once
+#include <stdint.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#include <string.h>
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_ptr(p) (*(const void* const*)(p))
+#define strcmp_P(s, p) strcmp((s), (p))
+#define strlen_P(p) strlen((p))
+#endif
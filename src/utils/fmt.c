@@ -0,0 +1,22 @@
+/*
+ * Number formatting
+ * -----------------
+ * Decimal conversion by repeated division, least significant digit first,
+ * then reversed in place; no printf, so nothing of stdio is linked.
+ */
+#include "utils/fmt.h"
+
+uint8_t fmt_u32(char* buf, uint32_t v) {
+    uint8_t n = 0;
+    do {
+        buf[n++] = (char)('0' + (v % 10U));
+        v /= 10U;
+    } while (v);
+    buf[n] = '\0';
+    for (uint8_t i = 0, j = (uint8_t)(n - 1U); i < j; i++, j--) {
+        char t = buf[i];
+        buf[i] = buf[j];
+        buf[j] = t;
+    }
+    return n;
+}
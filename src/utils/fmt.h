@@ -0,0 +1,15 @@
+/*
+ * Number formatting shared by the text printers (log, instr, trace, the
+ * sense colour debug and serial command replies), so the firmware carries one
+ * decimal conversion instead of one per module.
+ */
+#pragma once
+#include <stdint.h>
+
+/** Buffer size that holds any uint32_t in decimal plus the terminating NUL. */
+#define FMT_U32_LEN 11U
+
+/** Write v in decimal to buf, NUL-terminated (up to FMT_U32_LEN bytes).
+ * @return number of digits written (excluding the NUL).
+ */
+uint8_t fmt_u32(char* buf, uint32_t v);
@@ -0,0 +1,203 @@
+/*
+ * Instrumentation
+ * ---------------
+ * Timing statistics for tuning, compiled in with INSTR_ENABLE (see instr.h).
+ * - Histograms use log2 buckets: bucket 0 holds 0 us, bucket k holds
+ *   [2^(k-1), 2^k) us and the last bucket everything above. Buckets and the
+ *   maximum are only touched from the main loop.
+ * - ISR stats are updated by instr_isr_add() (INSTR_ISR_ENTRY() for the
+ *   Timer0 ISRs, which have no cycle total) inside the ISRs; the main loop
+ *   reads and clears them with interrupts masked.
+ * - instr_dump() (after each COUNT) arms five lines, printed one per
+ *   instr_tick() once the TX ring has room for that line's worst case:
+ *     LOOP t=... n=... max_us=...
+ *     LOOP t=... h=<bucket>:<count>,...
+ *     LATE t=... n=... max_us=...
+ *     LATE t=... h=<bucket>:<count>,...
+ *     ISR t=... T0A=<entries> T0B=<entries> T1A=<entries>/<cycles> T2A=... INT0=...
+ *   Empty buckets are omitted. A histogram is split in two lines because
+ *   sixteen 10-digit buckets alone would not fit the ring; its first line
+ *   takes the buckets aside and clears the histogram, the second prints them.
+ *   The ISR line reads and clears its counters when it is printed.
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "platform/config.h"
+#include "platform/progmem.h"
+#include "hal/timers.h"
+#include "hal/uart.h"
+#include "utils/instr.h"
+#include "utils/fmt.h"
+
+#if INSTR_ENABLE
+
+#define INSTR_CYCLES_PER_TICK 64U // Timer0 at clk/64
+
+// Longest line of each kind: 4-letter tag, 10-digit numbers, 2-digit buckets
+#define INSTR_HEAD_LINE_MAX (4U + 3U + 10U + 3U + 10U + 8U + 10U + 2U)
+#define INSTR_HIST_LINE_MAX (4U + 3U + 10U + 3U + INSTR_HIST_BUCKETS * (2U + 1U + 10U) + \
+                             (INSTR_HIST_BUCKETS - 1U) + 2U)
+#define INSTR_ISR_LINE_MAX  (6U + 10U + 2U * (5U + 10U) + 2U * (5U + 21U) + 6U + 21U + 2U)
+#if INSTR_HIST_LINE_MAX > UART_TX_BUFFER_SIZE - 1U
+#error "INSTR_HIST_BUCKETS too large for one histogram line in the UART TX ring"
+#endif
+
+typedef struct {
+    uint32_t bucket[INSTR_HIST_BUCKETS];
+    uint32_t n;
+    uint32_t max_us;
+} InstrHist;
+
+volatile uint32_t g_instr_isr_count[INSTR_ISR_COUNT];
+volatile uint32_t g_instr_isr_ticks[INSTR_ISR_COUNT];
+
+static InstrHist s_loop;
+static InstrHist s_late;
+static uint32_t s_last_loop_us = 0;
+static uint8_t s_have_last_loop = 0;
+static uint32_t s_dump_bucket[INSTR_HIST_BUCKETS]; // histogram being printed
+
+// Dump state: lines still to print for the dump started at s_dump_t_ms
+enum { DUMP_IDLE = 0, DUMP_LOOP, DUMP_LOOP_H, DUMP_LATE, DUMP_LATE_H, DUMP_ISR };
+static uint8_t s_dump_line = DUMP_IDLE;
+static uint32_t s_dump_t_ms = 0;
+
+static uint8_t bucket_for(uint32_t us) {
+    uint8_t k = 0;
+    while (us) {
+        us >>= 1;
+        k++;
+    }
+    return (k < INSTR_HIST_BUCKETS) ? k : (uint8_t)(INSTR_HIST_BUCKETS - 1U);
+}
+
+static void hist_add(InstrHist* h, uint32_t us) {
+    h->bucket[bucket_for(us)]++;
+    h->n++;
+    if (us > h->max_us) {
+        h->max_us = us;
+    }
+}
+
+void instr_loop_mark(void) {
+    uint32_t now = micros();
+    if (s_have_last_loop) {
+        hist_add(&s_loop, now - s_last_loop_us);
+    }
+    s_last_loop_us = now;
+    s_have_last_loop = 1;
+}
+
+void instr_actuation_late_us(uint32_t late_us) {
+    hist_add(&s_late, late_us);
+}
+
+void instr_dump(uint32_t t_ms) {
+    s_dump_t_ms = t_ms;
+    s_dump_line = DUMP_LOOP;
+}
+
+static void write_u32(uint32_t v) {
+    char b[FMT_U32_LEN];
+    fmt_u32(b, v);
+    uart_write(b);
+}
+
+// First histogram line; moves the buckets to s_dump_bucket for the second.
+// tag is a flash string (PSTR)
+static void write_hist_head(const char* tag, InstrHist* h) {
+    uart_write_P(tag);
+    uart_write_P(PSTR(" t="));
+    write_u32(s_dump_t_ms);
+    uart_write_P(PSTR(" n="));
+    write_u32(h->n);
+    uart_write_P(PSTR(" max_us="));
+    write_u32(h->max_us);
+    uart_write_P(PSTR("\r\n"));
+    for (uint8_t k = 0; k < INSTR_HIST_BUCKETS; k++) {
+        s_dump_bucket[k] = h->bucket[k];
+        h->bucket[k] = 0;
+    }
+    h->n = 0;
+    h->max_us = 0;
+}
+
+// tag is a flash string (PSTR)
+static void write_hist_buckets(const char* tag) {
+    uart_write_P(tag);
+    uart_write_P(PSTR(" t="));
+    write_u32(s_dump_t_ms);
+    uart_write_P(PSTR(" h="));
+    uint8_t first = 1;
+    for (uint8_t k = 0; k < INSTR_HIST_BUCKETS; k++) {
+        if (!s_dump_bucket[k]) {
+            continue;
+        }
+        if (!first) {
+            uart_write_P(PSTR(","));
+        }
+        first = 0;
+        write_u32(k);
+        uart_write_P(PSTR(":"));
+        write_u32(s_dump_bucket[k]);
+    }
+    uart_write_P(PSTR("\r\n"));
+}
+
+static const char k_t0a[] PROGMEM = " T0A=";
+static const char k_t0b[] PROGMEM = " T0B=";
+static const char k_t1a[] PROGMEM = " T1A=";
+static const char k_t2a[] PROGMEM = " T2A=";
+static const char k_int0[] PROGMEM = " INT0=";
+static const char* const k_isr_names[INSTR_ISR_COUNT] PROGMEM = { k_t0a, k_t0b, k_t1a, k_t2a, k_int0 };
+
+static void write_isr(void) {
+    uint32_t count[INSTR_ISR_COUNT];
+    uint32_t ticks[INSTR_ISR_COUNT];
+    uint8_t s = SREG;
+    cli();
+    for (uint8_t i = 0; i < INSTR_ISR_COUNT; i++) {
+        count[i] = g_instr_isr_count[i];
+        ticks[i] = g_instr_isr_ticks[i];
+        g_instr_isr_count[i] = 0;
+        g_instr_isr_ticks[i] = 0;
+    }
+    SREG = s;
+    uart_write_P(PSTR("ISR t="));
+    write_u32(s_dump_t_ms);
+    for (uint8_t i = 0; i < INSTR_ISR_COUNT; i++) {
+        uart_write_P((const char*)pgm_read_ptr(&k_isr_names[i]));
+        write_u32(count[i]);
+        if (i >= INSTR_ISR_T1A) { // Timer0 ISRs: entries only
+            uart_write_P(PSTR("/"));
+            write_u32(ticks[i] * INSTR_CYCLES_PER_TICK);
+        }
+    }
+    uart_write_P(PSTR("\r\n"));
+}
+
+void instr_tick(void) {
+    if (s_dump_line == DUMP_IDLE) {
+        return;
+    }
+    uint8_t need;
+    switch (s_dump_line) {
+        case DUMP_LOOP:
+        case DUMP_LATE: need = INSTR_HEAD_LINE_MAX; break;
+        case DUMP_LOOP_H:
+        case DUMP_LATE_H: need = INSTR_HIST_LINE_MAX; break;
+        default: need = INSTR_ISR_LINE_MAX; break;
+    }
+    if (uart_tx_free() < need) {
+        return;
+    }
+    switch (s_dump_line) {
+        case DUMP_LOOP: write_hist_head(PSTR("LOOP"), &s_loop); s_dump_line = DUMP_LOOP_H; break;
+        case DUMP_LOOP_H: write_hist_buckets(PSTR("LOOP")); s_dump_line = DUMP_LATE; break;
+        case DUMP_LATE: write_hist_head(PSTR("LATE"), &s_late); s_dump_line = DUMP_LATE_H; break;
+        case DUMP_LATE_H: write_hist_buckets(PSTR("LATE")); s_dump_line = DUMP_ISR; break;
+        default: write_isr(); s_dump_line = DUMP_IDLE; break;
+    }
+}
+
+#endif
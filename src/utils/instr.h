@@ -0,0 +1,80 @@
+/*
+ * Instrumentation: optional timing statistics kept in RAM and printed with
+ * the periodic COUNT log (enable with INSTR_ENABLE in platform/config.h).
+ * - Main-loop period histogram (instr_loop_mark() once per app_loop()).
+ * - Actuation lateness histogram (fire time minus due point, from decide).
+ * - Per-ISR entry counts for the Timer0/1/2 and INT0 ISRs, and cycle totals
+ *   for the ones not driven by Timer0 (see INSTR_ISR_ENTRY()).
+ * With INSTR_ENABLE 0 every hook compiles to nothing.
+ */
+#pragma once
+#include <stdint.h>
+#include "platform/config.h"
+
+/** ISRs with entry/cycle accounting (index into the ISR stats). The Timer0
+ * ISRs come first; they only count entries. */
+typedef enum {
+    INSTR_ISR_T0A = 0, /**< TIMER0_COMPA: millis() tick (entries only). */
+    INSTR_ISR_T0B,     /**< TIMER0_COMPB: tb6600 ramp tick (entries only). */
+    INSTR_ISR_T1A,     /**< TIMER1_COMPA: legacy software STEP (TB6600_HW_STEP 0). */
+    INSTR_ISR_T2A,     /**< TIMER2_COMPA: servo pulse scheduler. */
+    INSTR_ISR_INT0,    /**< INT0: VL6180 GPIO1 edge. */
+    INSTR_ISR_COUNT
+} InstrIsr;
+
+#if INSTR_ENABLE
+#include <avr/io.h>
+
+extern volatile uint32_t g_instr_isr_count[INSTR_ISR_COUNT];
+extern volatile uint32_t g_instr_isr_ticks[INSTR_ISR_COUNT];
+
+/** Add one ISR pass measured from two Timer0 readings (64 cycles per tick).
+ * Timer0 runs in CTC mode, so a reading below the entry one wrapped at top.
+ * Short ISRs often read the same tick at both ends, so a single pass says
+ * little; the total only approaches the true cycle count when the ISR's entry
+ * times are spread evenly over the Timer0 tick. Prologue/epilogue are not
+ * included.
+ */
+static inline void instr_isr_add(uint8_t id, uint8_t t_entry, uint8_t t_exit, uint8_t top) {
+    uint16_t d = (t_exit >= t_entry) ? (uint16_t)(t_exit - t_entry)
+                                     : (uint16_t)(t_exit + top + 1U - t_entry);
+    g_instr_isr_count[id]++;
+    g_instr_isr_ticks[id] += d;
+}
+
+/** Bracket an ISR body (the body must not return early). */
+#define INSTR_ISR_BEGIN()  uint8_t instr_t_entry_ = TCNT0
+#define INSTR_ISR_END(id)  instr_isr_add((id), instr_t_entry_, TCNT0, OCR0A)
+
+/** Count one entry of a Timer0 ISR. Those run at fixed TCNT0 values (COMPA at
+ * top, COMPB at top/2), so Timer0 cannot time them; use the simavr profiler
+ * (scripts/profile.sh) for their cycles.
+ */
+#define INSTR_ISR_ENTRY(id) (g_instr_isr_count[(id)]++)
+
+/** Record one main-loop pass; the period is measured between calls. */
+void instr_loop_mark(void);
+
+/** Record how late an actuation fired relative to its due point (us). */
+void instr_actuation_late_us(uint32_t late_us);
+
+/** Start printing the statistics gathered since the previous dump.
+ * Call right after log_count(); counters restart from zero.
+ */
+void instr_dump(uint32_t t_ms);
+
+/** Emit the next pending dump line once the UART TX ring has room for the
+ * longest line of its kind, so the dump is never dropped yet still gets out
+ * while event logs keep the link busy. Call every loop pass.
+ */
+void instr_tick(void);
+
+#else
+#define INSTR_ISR_BEGIN()  do { } while (0)
+#define INSTR_ISR_END(id)  do { } while (0)
+#define INSTR_ISR_ENTRY(id) do { } while (0)
+static inline void instr_loop_mark(void) { }
+static inline void instr_actuation_late_us(uint32_t late_us) { (void)late_us; }
+static inline void instr_dump(uint32_t t_ms) { (void)t_ms; }
+static inline void instr_tick(void) { }
+#endif
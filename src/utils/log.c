@@ -7,181 +7,485 @@
  * - CLASSIFY: color (R/G/B/Other), length class and mm.
  * - SCHEDULE/ACTUATE/PASS/SCHEDULE_REJECT: routing and actuation lifecycle.
  * - COUNT: periodic counters snapshot.
+ * Each event belongs to a category (LOG_CAT_* in log.h); a disabled category
+ * returns before any formatting, one compiled out has an empty body.
+ * A text line is several writes between uart_line_begin() and uart_line_end(),
+ * so a full TX ring drops it whole instead of cutting it between tokens.
+ * All keys and names are flash strings (PSTR) written with uart_write_P(), so
+ * none of them take SRAM; reason/code/device arguments are flash strings too.
+ * Binary format (LOG_FORMAT_BINARY), one frame per event:
+ *   0xA5 <len> <type> <fields...> <crc>
+ * len counts type and fields; crc is CRC-8 (poly 0x07, init 0) over len,
+ * type and fields. Numbers are varints (7 bits per byte, low bits first, top
+ * bit set when more follow); color, position and length class are one byte;
+ * reason/fault strings are a length byte and the characters. Fields follow
+ * the text line's order (CLASSIFY: t id color len_mm class thr). Text bytes
+ * are 7-bit, so a reader can tell frames from the text lines that stay text.
  */
-#include <stdio.h>
 #include "platform/config.h"
+#include "platform/progmem.h"
 #include "hal/uart.h"
 #include "drivers/tb6600.h"
 #include "utils/log.h"
+#include "utils/fmt.h"
 
-static void u32_to_str(uint32_t v, char* buf){
-    // minimal itoa for non-negative integers
-    char tmp[10];
-    int i = 0;
-    if (v == 0) {
-        buf[0] = '0';
-        buf[1] = '\0';
-        return;
-    }
-    while (v > 0 && i < 10) {
-        tmp[i++] = '0' + (v % 10);
-        v /= 10;
-    }
-    int j = 0;
-    while (i > 0) {
-        buf[j++] = tmp[--i];
-    }
-    buf[j] = '\0';
-}
-
+// k is a flash string (PSTR)
 static void write_kv(const char* k, uint32_t v){
-    char b[12];
-    u32_to_str(v, b);
-    uart_write(k);
+    char b[FMT_U32_LEN];
+    fmt_u32(b, v);
+    uart_write_P(k);
     uart_write(b);
 }
 
+// Names are flash strings, for uart_write_P()
 static const char* color_str(Color c){
     switch (c) {
-        case COLOR_RED: return "R";
-        case COLOR_GREEN: return "G";
-        case COLOR_BLUE: return "B";
-        default: return "Other";
+        case COLOR_RED: return PSTR("R");
+        case COLOR_GREEN: return PSTR("G");
+        case COLOR_BLUE: return PSTR("B");
+        default: return PSTR("Other");
     }
 }
 
 static const char* pos_str(TargetPosition p){
     switch (p) {
-        case POS1: return "Pos1";
-        case POS2: return "Pos2";
-        case POS3: return "Pos3";
-        default: return "PassThrough";
+        case POS1: return PSTR("Pos1");
+        case POS2: return PSTR("Pos2");
+        case POS3: return PSTR("Pos3");
+        default: return PSTR("PassThrough");
     }
 }
 
+static uint8_t s_format = LOG_FORMAT_DEFAULT;
+static uint8_t s_mask = (uint8_t)(LOG_CATEGORIES_DEFAULT & LOG_CATEGORIES_MAX);
+
+void log_set_mask(uint8_t mask){
+    s_mask = (uint8_t)(mask & LOG_CATEGORIES_MAX);
+}
+
+uint8_t log_get_mask(void){
+    return s_mask;
+}
+
+bool log_enabled(uint8_t cat){
+    return (s_mask & cat) != 0U;
+}
+
+void log_set_format(LogFormat fmt){
+    s_format = (uint8_t)fmt;
+}
+
+LogFormat log_get_format(void){
+    return (LogFormat)s_format;
+}
+
+// Longest frame is COUNT: 3 header bytes, 9 varints of up to 5 bytes, CRC
+#define FRAME_MAX 49U
+#define FRAME_STR_MAX 16U
+
+typedef struct {
+    uint8_t b[FRAME_MAX];
+    uint8_t n;
+} Frame;
+
+static void frame_begin(Frame* f, LogFrameType type){
+    f->b[0] = LOG_FRAME_SYNC;
+    f->b[2] = (uint8_t)type;
+    f->n = 3;
+}
+
+static void frame_u8(Frame* f, uint8_t v){
+    f->b[f->n++] = v;
+}
+
+static void frame_varint(Frame* f, uint32_t v){
+    while (v >= 0x80U) {
+        f->b[f->n++] = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    f->b[f->n++] = (uint8_t)v;
+}
+
+// s is a flash string (PSTR)
+static void frame_str(Frame* f, const char* s){
+    uint8_t at = f->n++;
+    uint8_t len = 0;
+    uint8_t ch;
+    while (len < FRAME_STR_MAX && (ch = pgm_read_byte(s + len)) != 0) {
+        f->b[f->n++] = ch;
+        len++;
+    }
+    f->b[at] = len;
+}
+
+static void frame_send(Frame* f){
+    f->b[1] = (uint8_t)(f->n - 2U);
+    uint8_t crc = 0;
+    for (uint8_t i = 1; i < f->n; i++) {
+        crc ^= f->b[i];
+        for (uint8_t k = 0; k < 8; k++) {
+            crc = (crc & 0x80U) ? (uint8_t)((crc << 1) ^ 0x07U) : (uint8_t)(crc << 1);
+        }
+    }
+    f->b[f->n++] = crc;
+    uart_write_bytes(f->b, f->n);
+}
+
+// Frame with a timestamp and an event id, the common prefix
+static void frame_t_id(Frame* f, LogFrameType type, uint32_t t_ms, uint16_t evt_id){
+    frame_begin(f, type);
+    frame_varint(f, t_ms);
+    frame_varint(f, evt_id);
+}
+
 void log_detect(uint32_t t_ms, uint16_t evt_id){
-    uart_write("DETECT t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" id=");
-    { char b0[12]; u32_to_str(evt_id, b0); uart_write(b0);} 
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_DETECT)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_DETECT, t_ms, evt_id);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("DETECT t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_clear(uint32_t t_ms, uint16_t evt_id){
-    uart_write("CLEAR t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" id=");
-    { char b0[12]; u32_to_str(evt_id, b0); uart_write(b0);} 
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_DETECT)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_CLEAR, t_ms, evt_id);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("CLEAR t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_classify(uint32_t t_ms, Color color, LengthInfo info, uint16_t evt_id){
-    uart_write("CLASSIFY t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" id=");
-    { char b0[12]; u32_to_str(evt_id, b0); uart_write(b0);} 
-    uart_write(" color=");
-    uart_write(color_str(color));
-    uart_write(" len_mm=");
-    { char b2[12]; u32_to_str(info.length_mm, b2); uart_write(b2);} 
-    uart_write(" class=");
-    uart_write(info.cls == LEN_SMALL ? "Small" : "NotSmall");
-    uart_write(" thr=");
-    { char b3[12]; u32_to_str(LENGTH_SMALL_MAX_MM, b3); uart_write(b3);} 
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_CLASSIFY)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_CLASSIFY, t_ms, evt_id);
+        frame_u8(&f, (uint8_t)color);
+        frame_varint(&f, info.length_mm);
+        frame_u8(&f, (uint8_t)info.cls);
+        frame_varint(&f, LENGTH_SMALL_MAX_MM);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("CLASSIFY t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" color="));
+    uart_write_P(color_str(color));
+    uart_write_P(PSTR(" len_mm="));
+    { char b2[12]; fmt_u32(b2, info.length_mm); uart_write(b2);} 
+    uart_write_P(PSTR(" class="));
+    uart_write_P(info.cls == LEN_SMALL ? PSTR("Small") : PSTR("NotSmall"));
+    uart_write_P(PSTR(" thr="));
+    { char b3[12]; fmt_u32(b3, LENGTH_SMALL_MAX_MM); uart_write(b3);} 
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 void log_schedule(uint32_t t_ms, TargetPosition pos, uint32_t at_ms, uint16_t evt_id){
-    uart_write("SCHEDULE t="); { char b[12]; u32_to_str(t_ms,b); uart_write(b);} 
-    uart_write(" id="); { char b0[12]; u32_to_str(evt_id,b0); uart_write(b0);} 
-    uart_write(" pos="); uart_write(pos_str(pos)); 
-    uart_write(" at="); { char b2[12]; u32_to_str(at_ms,b2); uart_write(b2);} uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_SCHEDULE)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_SCHEDULE, t_ms, evt_id);
+        frame_u8(&f, (uint8_t)pos);
+        frame_varint(&f, at_ms);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("SCHEDULE t=")); { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id=")); { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" pos=")); uart_write_P(pos_str(pos)); 
+    uart_write_P(PSTR(" at=")); { char b2[12]; fmt_u32(b2, at_ms); uart_write(b2);} uart_write_P(PSTR("\r\n"));
+    uart_line_end();
+}
+void log_actuate(uint32_t t_ms, TargetPosition pos, uint16_t evt_id, uint32_t slack_ms){
+    if (!LOG_ON(LOG_CAT_ACTUATE)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_ACTUATE, t_ms, evt_id);
+        frame_u8(&f, (uint8_t)pos);
+        frame_varint(&f, slack_ms);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("ACTUATE t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" pos="));
+    uart_write_P(pos_str(pos));
+    write_kv(PSTR(" slack_ms="), slack_ms);
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
-void log_actuate(uint32_t t_ms, TargetPosition pos, uint16_t evt_id){
-    uart_write("ACTUATE t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" id=");
-    { char b0[12]; u32_to_str(evt_id, b0); uart_write(b0);} 
-    uart_write(" pos=");
-    uart_write(pos_str(pos));
-    uart_write("\r\n");
+
+void log_missed(uint32_t t_ms, TargetPosition pos, uint16_t evt_id, uint32_t late_ms){
+    if (!LOG_ON(LOG_CAT_ACTUATE)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_MISSED, t_ms, evt_id);
+        frame_u8(&f, (uint8_t)pos);
+        frame_varint(&f, late_ms);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("MISSED t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" pos="));
+    uart_write_P(pos_str(pos));
+    write_kv(PSTR(" late_ms="), late_ms);
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_schedule_reject(uint32_t t_ms, uint16_t evt_id, const char* reason){
-    uart_write("SCHEDULE_REJECT t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" id=");
-    { char b0[12]; u32_to_str(evt_id, b0); uart_write(b0);} 
-    uart_write(" reason=");
-    uart_write(reason ? reason : "unknown");
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_SCHEDULE)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_SCHEDULE_REJECT, t_ms, evt_id);
+        frame_str(&f, reason ? reason : PSTR("unknown"));
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("SCHEDULE_REJECT t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id="));
+    { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" reason="));
+    uart_write_P(reason ? reason : PSTR("unknown"));
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_pass(uint32_t t_ms){
-    uart_write("PASS t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_SCHEDULE)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_begin(&f, LOG_FRAME_PASS);
+        frame_varint(&f, t_ms);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("PASS t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_fault(uint32_t t_ms, const char* code){
-    uart_write("FAULT t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" code=");
-    uart_write(code ? code : "Unknown");
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_CLASSIFY)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_begin(&f, LOG_FRAME_FAULT);
+        frame_varint(&f, t_ms);
+        frame_str(&f, code ? code : PSTR("Unknown"));
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("FAULT t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" code="));
+    uart_write_P(code ? code : PSTR("Unknown"));
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_count(uint32_t t_ms, uint32_t total, uint32_t diverted, uint32_t passed, uint32_t fault,
                uint32_t red, uint32_t green, uint32_t blue, uint32_t other){
-    uart_write("COUNT t=");
-    { char b[12]; u32_to_str(t_ms, b); uart_write(b);} 
-    uart_write(" total=");
-    write_kv("", total);
-    uart_write(" diverted=");
-    write_kv("", diverted);
-    uart_write(" passed=");
-    write_kv("", passed);
-    uart_write(" fault=");
-    write_kv("", fault);
-    uart_write(" red=");
-    write_kv("", red);
-    uart_write(" green=");
-    write_kv("", green);
-    uart_write(" blue=");
-    write_kv("", blue);
-    uart_write(" other=");
-    write_kv("", other);
+    if (!LOG_ON(LOG_CAT_COUNT)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_begin(&f, LOG_FRAME_COUNT);
+        frame_varint(&f, t_ms);
+        frame_varint(&f, total);
+        frame_varint(&f, diverted);
+        frame_varint(&f, passed);
+        frame_varint(&f, fault);
+        frame_varint(&f, red);
+        frame_varint(&f, green);
+        frame_varint(&f, blue);
+        frame_varint(&f, other);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("COUNT t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" total="));
+    write_kv(PSTR(""), total);
+    uart_write_P(PSTR(" diverted="));
+    write_kv(PSTR(""), diverted);
+    uart_write_P(PSTR(" passed="));
+    write_kv(PSTR(""), passed);
+    uart_write_P(PSTR(" fault="));
+    write_kv(PSTR(""), fault);
+    uart_write_P(PSTR(" red="));
+    write_kv(PSTR(""), red);
+    uart_write_P(PSTR(" green="));
+    write_kv(PSTR(""), green);
+    uart_write_P(PSTR(" blue="));
+    write_kv(PSTR(""), blue);
+    uart_write_P(PSTR(" other="));
+    write_kv(PSTR(""), other);
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
+}
+
+void log_uart_stats(uint32_t t_ms){
+    if (!LOG_ON(LOG_CAT_COUNT)) {
+        return;
+    }
+    // Read the counters before emitting so this line's own bytes are not included
+    uint32_t queued = uart_tx_queued();
+    uint32_t dropped = uart_tx_dropped();
+    uint32_t rx_dropped = uart_rx_dropped();
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_begin(&f, LOG_FRAME_UART);
+        frame_varint(&f, t_ms);
+        frame_varint(&f, queued);
+        frame_varint(&f, dropped);
+        frame_varint(&f, rx_dropped);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("UART t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" tx_queued="));
+    write_kv(PSTR(""), queued);
+    uart_write_P(PSTR(" tx_dropped="));
+    write_kv(PSTR(""), dropped);
+    uart_write_P(PSTR(" rx_dropped="));
+    write_kv(PSTR(""), rx_dropped);
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
+}
+
+void log_sched_stats(uint32_t t_ms, uint8_t depth, uint8_t high_water, uint8_t capacity, uint32_t missed){
+    if (!LOG_ON(LOG_CAT_COUNT)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_begin(&f, LOG_FRAME_SCHED);
+        frame_varint(&f, t_ms);
+        frame_varint(&f, depth);
+        frame_varint(&f, high_water);
+        frame_varint(&f, capacity);
+        frame_varint(&f, missed);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("SCHED t="));
+    { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    write_kv(PSTR(" depth="), depth);
+    write_kv(PSTR(" hwm="), high_water);
+    write_kv(PSTR(" cap="), capacity);
+    write_kv(PSTR(" missed="), missed);
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
+}
+
+void log_i2c_speed(const char* dev, uint32_t hz){
+    // I2C: VL6180=400000 Hz
+    uart_write_P(PSTR("I2C: "));
+    uart_write_P(dev ? dev : PSTR("?"));
+    write_kv(PSTR("="), hz);
+    uart_write_P(PSTR(" Hz\r\n"));
 }
 
 void log_length(uint32_t t_ms, uint16_t length_mm, uint32_t dwell_ms, uint16_t evt_id){
-    uart_write("LENGTH t="); { char b[12]; u32_to_str(t_ms,b); uart_write(b);} 
-    uart_write(" id="); { char b0[12]; u32_to_str(evt_id,b0); uart_write(b0);} 
-    uart_write(" len_mm="); { char b2[12]; u32_to_str(length_mm,b2); uart_write(b2);} 
-    uart_write(" dwell_ms="); { char b3[12]; u32_to_str(dwell_ms,b3); uart_write(b3);} 
-    uart_write("\r\n");
+    if (!LOG_ON(LOG_CAT_DETECT)) {
+        return;
+    }
+    if (s_format == LOG_FORMAT_BINARY) {
+        Frame f;
+        frame_t_id(&f, LOG_FRAME_LENGTH, t_ms, evt_id);
+        frame_varint(&f, length_mm);
+        frame_varint(&f, dwell_ms);
+        frame_send(&f);
+        return;
+    }
+    uart_line_begin();
+    uart_write_P(PSTR("LENGTH t=")); { char b[12]; fmt_u32(b, t_ms); uart_write(b);} 
+    uart_write_P(PSTR(" id=")); { char b0[12]; fmt_u32(b0, evt_id); uart_write(b0);} 
+    uart_write_P(PSTR(" len_mm=")); { char b2[12]; fmt_u32(b2, length_mm); uart_write(b2);} 
+    uart_write_P(PSTR(" dwell_ms=")); { char b3[12]; fmt_u32(b3, dwell_ms); uart_write(b3);} 
+    uart_write_P(PSTR("\r\n"));
+    uart_line_end();
 }
 
 void log_sep(void){
-    uart_write("*******\r\n");
+    uart_write_P(PSTR("*******\r\n"));
 }
 
 void log_belt_configuration(void){
-    uint16_t step_rate = tb6600_get_step_rate_hz();
+    // Configured target; the belt may still be ramping towards it
+    uint16_t step_rate = tb6600_get_target_step_rate_hz();
     uint32_t mmpp = (uint32_t)MM_PER_PULSE_X1000;
-    uint16_t belt_mm_per_s = tb6600_get_speed_mm_per_s();
+    uint16_t belt_mm_per_s = tb6600_get_target_speed_mm_per_s();
     // BELT: step_rate=123 Hz, mm_per_pulse=0.031 mm, belt=50 mm/s
-    uart_write("BELT: step_rate=");
-    char b[12]; u32_to_str(step_rate, b); uart_write(b);
-    uart_write(" Hz, mm_per_pulse=");
-    char b_int[12]; u32_to_str(mmpp/1000UL, b_int); uart_write(b_int);
-    uart_write("."); char b_frac[12]; u32_to_str(mmpp%1000UL, b_frac); uart_write(b_frac);
-    uart_write(" mm, belt="); char b_belt[12]; u32_to_str(belt_mm_per_s, b_belt); uart_write(b_belt);
-    uart_write(" mm/s\r\n");
+    uart_write_P(PSTR("BELT: step_rate="));
+    char b[12]; fmt_u32(b, step_rate); uart_write(b);
+    uart_write_P(PSTR(" Hz, mm_per_pulse="));
+    char b_int[12]; fmt_u32(b_int, mmpp/1000UL); uart_write(b_int);
+    uart_write_P(PSTR(".")); char b_frac[12]; fmt_u32(b_frac, mmpp%1000UL); uart_write(b_frac);
+    uart_write_P(PSTR(" mm, belt=")); char b_belt[12]; fmt_u32(b_belt, belt_mm_per_s); uart_write(b_belt);
+    uart_write_P(PSTR(" mm/s\r\n"));
 }
 
 void log_servo_distances(void){
     // DIST: D1=120mm D2=240mm D3=360mm
-    uart_write("DIST: D1="); char b1[12]; u32_to_str(SERVO_D1_MM, b1); uart_write(b1);
-    uart_write("mm D2="); char b2[12]; u32_to_str(SERVO_D2_MM, b2); uart_write(b2);
-    uart_write("mm D3="); char b3[12]; u32_to_str(SERVO_D3_MM, b3); uart_write(b3);
-    uart_write("mm\r\n");
+    uart_write_P(PSTR("DIST: D1=")); char b1[12]; fmt_u32(b1, SERVO_D1_MM); uart_write(b1);
+    uart_write_P(PSTR("mm D2=")); char b2[12]; fmt_u32(b2, SERVO_D2_MM); uart_write(b2);
+    uart_write_P(PSTR("mm D3=")); char b3[12]; fmt_u32(b3, SERVO_D3_MM); uart_write(b3);
+    uart_write_P(PSTR("mm\r\n"));
 }
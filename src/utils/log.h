@@ -1,13 +1,74 @@
 /*
  * Log module: UART text logging per contracts/serial.md for
- * DETECT/CLEAR/CLASSIFY/SCHEDULE/ACTUATE/PASS/FAULT/COUNT events.
+ * DETECT/CLEAR/CLASSIFY/SCHEDULE/ACTUATE/PASS/FAULT/COUNT events, or the
+ * same events as compact binary frames (see log.c; scripts/log_decode.py
+ * turns a capture back into text).
  */
 #pragma once
 #include <stdint.h>
+#include <stdbool.h>
 #include "drivers/apds9960.h"
 #include "app/decide.h" // for TargetPosition
 #include "app/sense.h" // for LengthInfo
 #include "app/actuate.h" // for Counters
+#include "platform/config.h"
+
+typedef enum { LOG_FORMAT_TEXT = 0, LOG_FORMAT_BINARY = 1 } LogFormat;
+
+/** Binary frame types; values are part of the wire format (keep
+ * scripts/log_decode.py in sync). Boot-time lines (BELT, DIST, I2C,
+ * separator) stay text in either format.
+ */
+typedef enum {
+    LOG_FRAME_DETECT = 1,
+    LOG_FRAME_CLEAR,
+    LOG_FRAME_CLASSIFY,
+    LOG_FRAME_SCHEDULE,
+    LOG_FRAME_ACTUATE,
+    LOG_FRAME_MISSED,
+    LOG_FRAME_SCHEDULE_REJECT,
+    LOG_FRAME_PASS,
+    LOG_FRAME_FAULT,
+    LOG_FRAME_COUNT,
+    LOG_FRAME_UART,
+    LOG_FRAME_SCHED,
+    LOG_FRAME_LENGTH,
+} LogFrameType;
+
+/** First byte of every binary frame; never appears in text output. */
+#define LOG_FRAME_SYNC 0xA5U
+
+/** Log categories: bits of the run-time mask and of LOG_CATEGORIES_MAX. */
+#define LOG_CAT_DETECT   0x01U // DETECT, CLEAR, LENGTH, "Block detected!"
+#define LOG_CAT_CLASSIFY 0x02U // CLASSIFY, FAULT
+#define LOG_CAT_SCHEDULE 0x04U // SCHEDULE, SCHEDULE_REJECT, PASS
+#define LOG_CAT_ACTUATE  0x08U // ACTUATE, MISSED
+#define LOG_CAT_COUNT    0x10U // COUNT, UART, SCHED
+#define LOG_CAT_DEBUG    0x20U // per-block "color:" line
+#define LOG_CAT_ALL      0x3FU
+
+/** True if category cat is compiled in and enabled. With a constant cat
+ * outside LOG_CATEGORIES_MAX this folds to false, so code guarded by it
+ * (formatting, strings) compiles out.
+ */
+#define LOG_ON(cat) ((((cat) & LOG_CATEGORIES_MAX) != 0U) && log_enabled(cat))
+
+/** Enable the categories in mask (LOG_CAT_* bits) and disable the rest;
+ * bits outside LOG_CATEGORIES_MAX are ignored.
+ */
+void log_set_mask(uint8_t mask);
+
+/** Categories currently enabled. */
+uint8_t log_get_mask(void);
+
+/** True if any category in cat is enabled at run time; prefer LOG_ON(). */
+bool log_enabled(uint8_t cat);
+
+/** Select text or binary event logs (LOG_FORMAT_DEFAULT at boot). */
+void log_set_format(LogFormat fmt);
+
+/** Current event log format. */
+LogFormat log_get_format(void);
 
 /** Log a detection edge (object present detected by ToF).
  * @param t_ms   Millisecond timestamp (from millis()).
@@ -38,16 +99,25 @@ void log_classify(uint32_t t_ms, Color color, LengthInfo info, uint16_t evt_id);
 void log_schedule(uint32_t t_ms, TargetPosition pos, uint32_t at_ms, uint16_t evt_id);
 
 /** Log an actuation event.
- * @param t_ms   Millisecond timestamp when fired.
- * @param pos    Diverter position actuated.
- * @param evt_id Correlation id for this detection cycle.
+ * @param t_ms     Millisecond timestamp when fired.
+ * @param pos      Diverter position actuated.
+ * @param evt_id   Correlation id for this detection cycle.
+ * @param slack_ms Time left in the item's lateness window when it fired.
+ */
+void log_actuate(uint32_t t_ms, TargetPosition pos, uint16_t evt_id, uint32_t slack_ms);
+
+/** Log an actuation dropped because its block had already gone by.
+ * @param t_ms    Millisecond timestamp.
+ * @param pos     Diverter position it was scheduled for.
+ * @param evt_id  Correlation id for this detection cycle.
+ * @param late_ms How far past the due point it was.
  */
-void log_actuate(uint32_t t_ms, TargetPosition pos, uint16_t evt_id);
+void log_missed(uint32_t t_ms, TargetPosition pos, uint16_t evt_id, uint32_t late_ms);
 
 /** Log a rejection reason for a schedule request.
  * @param t_ms   Millisecond timestamp.
  * @param evt_id Correlation id for this detection cycle.
- * @param reason Short ASCII reason string (e.g., "queue-full").
+ * @param reason Short ASCII reason string in flash (e.g., PSTR("queue-full")).
  */
 void log_schedule_reject(uint32_t t_ms, uint16_t evt_id, const char* reason);
 
@@ -58,7 +128,7 @@ void log_pass(uint32_t t_ms);
 
 /** Log a fault condition with a string code.
  * @param t_ms Millisecond timestamp.
- * @param code Short ASCII fault code.
+ * @param code Short ASCII fault code in flash (PSTR).
  */
 void log_fault(uint32_t t_ms, const char* code);
 
@@ -78,6 +148,29 @@ void log_fault(uint32_t t_ms, const char* code);
 void log_count(uint32_t t_ms, uint32_t total, uint32_t diverted, uint32_t passed, uint32_t fault,
 			   uint32_t red, uint32_t green, uint32_t blue, uint32_t other);
 
+/** Longest UART, SCHED or COUNT line (text; a binary frame is shorter): the
+ * COUNT line with nine 10-digit numbers. Print them once uart_tx_free() is at
+ * least this, so the line always fits.
+ */
+#define LOG_STATS_LINE_MAX 157U
+
+/** Log UART statistics since boot: TX bytes queued and dropped, RX bytes dropped.
+ * @param t_ms Millisecond timestamp.
+ */
+void log_uart_stats(uint32_t t_ms);
+
+/** Log scheduler queue occupancy (current depth and high-water mark) and
+ * the number of actuations dropped as MISSED since boot.
+ * @param t_ms  Millisecond timestamp.
+ */
+void log_sched_stats(uint32_t t_ms, uint8_t depth, uint8_t high_water, uint8_t capacity, uint32_t missed);
+
+/** Log the I2C bus clock selected for a device at boot.
+ * @param dev Short device name in flash (e.g., PSTR("VL6180")).
+ * @param hz  SCL clock in Hz.
+ */
+void log_i2c_speed(const char* dev, uint32_t hz);
+
 /** Print a simple separator line to make logs easier to scan. */
 void log_sep(void);
 
@@ -0,0 +1,32 @@
+/*
+ * Time helpers: wrap-safe arithmetic on 32-bit millis() timestamps.
+ * millis() wraps after ~49.7 days; comparing timestamps directly (a <= b)
+ * breaks at the wrap, while the unsigned difference stays correct as long as
+ * the two instants are less than ~24.8 days apart. micros() wraps after
+ * ~71.6 minutes and has its own helper.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Milliseconds from since to now (correct across the wrap). */
+static inline uint32_t time_elapsed_ms(uint32_t now, uint32_t since) {
+    return now - since;
+}
+
+/** Microseconds from since to now, for micros() timestamps (correct across
+ * the wrap while they are less than ~35.8 minutes apart).
+ */
+static inline uint32_t time_elapsed_us(uint32_t now, uint32_t since) {
+    return now - since;
+}
+
+/** @return true once now has reached or passed deadline. */
+static inline bool time_reached(uint32_t now, uint32_t deadline) {
+    return (int32_t)(now - deadline) >= 0;
+}
+
+/** @return true if timestamp a is strictly earlier than b. */
+static inline bool time_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Trace records
+ * -------------
+ * One record per sense result, filled in as the block moves through the
+ * pipeline (see trace.h for the hooks). A record completes when its diverter
+ * returns to center, or at once when no actuation will follow; completed
+ * records are printed by trace_tick() one per loop pass, once the UART TX
+ * ring has room for the longest TRACE line, so a trace is never dropped:
+ *   TRACE id=... pos=1|2|3 enter=... exit=... cls=... due=... fire=... center=... [lost=N]
+ * Times are millis(). Fields a block never reached are omitted (pass-through
+ * blocks have no pos/due/fire/center). lost counts records overwritten before
+ * they could be printed since the previous line.
+ * A diverter fired again before it recentered holds the gate for both blocks;
+ * the earlier record then completes without a center time.
+ */
+#include "platform/config.h"
+#include "platform/progmem.h"
+#include "hal/uart.h"
+#include "utils/trace.h"
+#include "utils/fmt.h"
+
+#if TRACE_ENABLE
+
+enum { REC_FREE = 0, REC_OPEN, REC_FIRED, REC_DONE };
+#define HAVE_DUE    0x01U
+#define HAVE_FIRE   0x02U
+#define HAVE_CENTER 0x04U
+
+typedef struct {
+    uint32_t t_enter_ms;
+    uint32_t t_exit_ms;
+    uint32_t t_class_ms;
+    uint32_t t_due_ms;
+    uint32_t t_fire_ms;
+    uint32_t t_center_ms;
+    uint16_t evt_id;
+    uint8_t pos;
+    uint8_t state;
+    uint8_t have;
+} TraceRec;
+
+static TraceRec s_ring[TRACE_RING_LEN];
+static uint8_t s_next = 0; // next slot to open (the oldest record)
+static uint16_t s_lost = 0;
+
+static TraceRec* find_id(uint16_t evt_id) {
+    for (uint8_t i = 0; i < TRACE_RING_LEN; i++) {
+        if (s_ring[i].state != REC_FREE && s_ring[i].evt_id == evt_id) {
+            return &s_ring[i];
+        }
+    }
+    return 0;
+}
+
+// Record still waiting for the center of the diverter at pos
+static TraceRec* find_fired(uint8_t pos) {
+    for (uint8_t i = 0; i < TRACE_RING_LEN; i++) {
+        if (s_ring[i].state == REC_FIRED && s_ring[i].pos == pos) {
+            return &s_ring[i];
+        }
+    }
+    return 0;
+}
+
+void trace_begin(uint16_t evt_id, uint32_t t_enter_ms, uint32_t t_exit_ms, uint32_t t_class_ms) {
+    TraceRec* r = &s_ring[s_next];
+    s_next = (uint8_t)((s_next + 1U) % TRACE_RING_LEN);
+    if (r->state != REC_FREE && s_lost < 0xFFFFU) {
+        s_lost++;
+    }
+    r->t_enter_ms = t_enter_ms;
+    r->t_exit_ms = t_exit_ms;
+    r->t_class_ms = t_class_ms;
+    r->evt_id = evt_id;
+    r->pos = 0;
+    r->have = 0;
+    r->state = REC_OPEN;
+}
+
+void trace_due(uint16_t evt_id, uint32_t due_ms) {
+    TraceRec* r = find_id(evt_id);
+    if (r && r->state == REC_OPEN) {
+        r->t_due_ms = due_ms;
+        r->have |= HAVE_DUE;
+    }
+}
+
+void trace_fire(uint16_t evt_id, TargetPosition pos, uint32_t t_ms) {
+    TraceRec* prev = find_fired((uint8_t)pos);
+    if (prev) {
+        prev->state = REC_DONE; // re-fired while diverted: no center of its own
+    }
+    TraceRec* r = find_id(evt_id);
+    if (r && r->state == REC_OPEN) {
+        r->pos = (uint8_t)pos;
+        r->t_fire_ms = t_ms;
+        r->have |= HAVE_FIRE;
+        r->state = REC_FIRED;
+    }
+}
+
+void trace_center(TargetPosition pos, uint32_t t_ms) {
+    TraceRec* r = find_fired((uint8_t)pos);
+    if (r) {
+        r->t_center_ms = t_ms;
+        r->have |= HAVE_CENTER;
+        r->state = REC_DONE;
+    }
+}
+
+void trace_close(uint16_t evt_id) {
+    TraceRec* r = find_id(evt_id);
+    if (r && r->state == REC_OPEN) {
+        r->state = REC_DONE;
+    }
+}
+
+// Longest TRACE line: every field present, 16-bit id/lost, 32-bit times
+#define TRACE_LINE_MAX (9U + 5U + 5U + 1U + 7U + 10U + 6U + 10U + 5U + 10U + \
+                        5U + 10U + 6U + 10U + 8U + 10U + 6U + 5U + 2U)
+
+// key is a flash string (PSTR)
+static void write_u32(const char* key, uint32_t v) {
+    char b[FMT_U32_LEN];
+    fmt_u32(b, v);
+    uart_write_P(key);
+    uart_write(b);
+}
+
+static void write_rec(const TraceRec* r) {
+    write_u32(PSTR("TRACE id="), r->evt_id);
+    if (r->have & HAVE_FIRE) {
+        write_u32(PSTR(" pos="), (uint32_t)r->pos + 1U); // Pos1..Pos3
+    }
+    write_u32(PSTR(" enter="), r->t_enter_ms);
+    write_u32(PSTR(" exit="), r->t_exit_ms);
+    write_u32(PSTR(" cls="), r->t_class_ms);
+    if (r->have & HAVE_DUE) {
+        write_u32(PSTR(" due="), r->t_due_ms);
+    }
+    if (r->have & HAVE_FIRE) {
+        write_u32(PSTR(" fire="), r->t_fire_ms);
+    }
+    if (r->have & HAVE_CENTER) {
+        write_u32(PSTR(" center="), r->t_center_ms);
+    }
+    if (s_lost) {
+        write_u32(PSTR(" lost="), s_lost);
+        s_lost = 0;
+    }
+    uart_write_P(PSTR("\r\n"));
+}
+
+void trace_tick(void) {
+    if (uart_tx_free() < TRACE_LINE_MAX) {
+        return;
+    }
+    // Oldest completed record first
+    for (uint8_t n = 0; n < TRACE_RING_LEN; n++) {
+        TraceRec* r = &s_ring[(uint8_t)((s_next + n) % TRACE_RING_LEN)];
+        if (r->state == REC_DONE) {
+            write_rec(r);
+            r->state = REC_FREE;
+            return;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Trace: per-block timing records from detection to servo return-to-center,
+ * kept in a small ring and printed as one TRACE line per block (enable with
+ * TRACE_ENABLE in platform/config.h; scripts/trace_report.py summarizes them).
+ * Hooks are keyed by the event id main assigns to each sense result; with
+ * TRACE_ENABLE 0 they compile to nothing.
+ */
+#pragma once
+#include <stdint.h>
+#include "platform/config.h"
+#include "app/decide.h" // for TargetPosition
+
+#if TRACE_ENABLE
+/** Open a record for a sense result.
+ * @param t_enter_ms Detection (block entered the ToF beam).
+ * @param t_exit_ms  Block left the beam.
+ * @param t_class_ms Result (length and color) available to the main loop.
+ */
+void trace_begin(uint16_t evt_id, uint32_t t_enter_ms, uint32_t t_exit_ms, uint32_t t_class_ms);
+
+/** The actuation for evt_id was queued, due at due_ms (estimate for position-keyed items). */
+void trace_due(uint16_t evt_id, uint32_t due_ms);
+
+/** The actuation for evt_id fired on pos at t_ms. */
+void trace_fire(uint16_t evt_id, TargetPosition pos, uint32_t t_ms);
+
+/** The diverter at pos returned to center; completes the record that fired it. */
+void trace_center(TargetPosition pos, uint32_t t_ms);
+
+/** No actuation will follow (pass-through, fault or rejected); completes the record. */
+void trace_close(uint16_t evt_id);
+
+/** Print the oldest completed record once the TX ring has room for the longest
+ * TRACE line. Call every loop pass.
+ */
+void trace_tick(void);
+
+#else
+static inline void trace_begin(uint16_t evt_id, uint32_t t_enter_ms, uint32_t t_exit_ms, uint32_t t_class_ms) {
+    (void)evt_id; (void)t_enter_ms; (void)t_exit_ms; (void)t_class_ms;
+}
+static inline void trace_due(uint16_t evt_id, uint32_t due_ms) { (void)evt_id; (void)due_ms; }
+static inline void trace_fire(uint16_t evt_id, TargetPosition pos, uint32_t t_ms) { (void)evt_id; (void)pos; (void)t_ms; }
+static inline void trace_center(TargetPosition pos, uint32_t t_ms) { (void)pos; (void)t_ms; }
+static inline void trace_close(uint16_t evt_id) { (void)evt_id; }
+static inline void trace_tick(void) { }
+#endif
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for <avr/interrupt.h> (unit tests only). Tests call ISR
+ * bodies directly by their vector name.
+ */
+#pragma once
+#include "avr/io.h"
+
+#define sei() (SREG |= (uint8_t)(1U << SREG_I))
+#define cli() (SREG &= (uint8_t)~(1U << SREG_I))
+#define ISR(vector) void vector(void)
@@ -0,0 +1,7 @@
+#include "avr/io.h"
+
+volatile uint8_t SREG;
+volatile uint8_t TCNT0, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t PINB;
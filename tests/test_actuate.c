@@ -140,4 +140,33 @@ void test_counters_Should_IncrementAndRetrieveCorrectly(void) {
     TEST_ASSERT_EQUAL_UINT32(0, c->passed);
     TEST_ASSERT_EQUAL_UINT32(1, c->red);
     TEST_ASSERT_EQUAL_UINT32(2, c->green);
-}
\ No newline at end of file
+}
+void test_actuate_tick_Should_CenterAcrossMillisWrap(void) {
+    // Fire 100 ms before the 32-bit wrap; the dwell deadline lands at 150
+    servo_set_pulse_us_Expect(0, 1700);
+    millis_ExpectAndReturn(0xFFFFFFFFUL - 99UL);
+    actuate_fire(POS1);
+
+    // Fast-forward through the wrap: still diverted
+    actuate_tick(0xFFFFFFFFUL);
+    actuate_tick(0);
+    actuate_tick(149);
+
+    servo_set_pulse_us_Expect(0, 1500);
+    actuate_tick(150);
+}
+
+void test_actuate_fire_for_Should_CenterAfterGivenHold_AndRestartWhenRefired(void) {
+    servo_set_pulse_us_Expect(1, 1700);
+    millis_ExpectAndReturn(1000);
+    actuate_fire_for(POS2, 600);
+
+    // Fired again while deflected: the hold restarts from the second firing
+    servo_set_pulse_us_Expect(1, 1700);
+    millis_ExpectAndReturn(1500);
+    actuate_fire_for(POS2, 100);
+
+    actuate_tick(1599);
+    servo_set_pulse_us_Expect(1, 1500);
+    actuate_tick(1600);
+}
@@ -0,0 +1,157 @@
+#include <string.h>
+#include "unity.h"
+#include "commands.h"
+#include "config.h"
+#include "fmt.h"
+
+// Ceedling mocks
+#include "mock_uart.h"
+#include "mock_tb6600.h"
+#include "mock_decide.h"
+#include "mock_log.h"
+
+static char s_out[128];   // replies written to the UART
+static uint8_t s_tx_free; // what uart_tx_free() reports
+
+static int capture_write(const char* str, int calls) {
+    (void)calls;
+    strncat(s_out, str, sizeof(s_out) - strlen(s_out) - 1U);
+    return (int)strlen(str);
+}
+
+static uint8_t fake_tx_free(int calls) {
+    (void)calls;
+    return s_tx_free;
+}
+
+// Queue the bytes of s as received UART data, one uart_read_byte() call each
+static void receive(const char* s) {
+    for (; *s; s++) {
+        uart_read_byte_ExpectAnyArgsAndReturn(true);
+        uart_read_byte_ReturnThruPtr_b((uint8_t*)s);
+    }
+}
+
+void setUp(void) {
+    s_out[0] = '\0';
+    s_tx_free = UART_TX_BUFFER_SIZE - 1U; // TX ring idle
+    uart_write_StubWithCallback(capture_write);
+    uart_write_P_StubWithCallback(capture_write);
+    uart_tx_free_StubWithCallback(fake_tx_free);
+    commands_init();
+}
+void tearDown(void) {}
+
+void test_commands_poll_NoInput_DoesNothing(void) {
+    uart_read_byte_ExpectAnyArgsAndReturn(false);
+
+    commands_poll();
+}
+
+void test_commands_poll_Should_ConsumeBoundedBytesPerCall(void) {
+    // "set bpm 30\n" is 11 bytes: the first call reads CMD_BYTES_PER_POLL of them
+    receive("set bpm 30\n");
+    decide_set_max_blocks_per_min_Expect(30);
+    decide_get_max_blocks_per_min_ExpectAndReturn(30);
+
+    commands_poll();
+    commands_poll();
+}
+
+void test_commands_poll_Should_RunOneLinePerCall(void) {
+    receive("get bpm\n");
+    decide_get_max_blocks_per_min_ExpectAndReturn(15);
+
+    commands_poll();
+    TEST_ASSERT_EQUAL_STRING("OK bpm=15\r\n", s_out);
+
+    // The next line waits for the next call; the main loop prints the stats
+    receive("stats\n");
+    TEST_ASSERT_FALSE(commands_take_stats_request());
+
+    commands_poll();
+    TEST_ASSERT_TRUE(commands_take_stats_request());
+    TEST_ASSERT_FALSE(commands_take_stats_request());
+}
+
+void test_commands_reply_Should_WaitForRoomInTxAndHoldInput(void) {
+    s_tx_free = 10; // a log burst is still draining: "OK bpm=15\r\n" needs 11
+    receive("get bpm\n");
+    decide_get_max_blocks_per_min_ExpectAndReturn(15);
+
+    commands_poll();
+    // Strict mocks: reading more input here would fail the test
+    commands_poll();
+    TEST_ASSERT_EQUAL_STRING("", s_out);
+
+    s_tx_free = 11; // enough for the reply, though the ring is not idle
+    uart_read_byte_ExpectAnyArgsAndReturn(false);
+
+    commands_poll();
+    TEST_ASSERT_EQUAL_STRING("OK bpm=15\r\n", s_out);
+}
+
+void test_commands_set_spacing_Should_SetOneDiverterOrAll(void) {
+    receive("set spacing 300 2\r");
+    decide_set_position_min_spacing_ms_Expect(POS2, 300);
+    decide_get_position_min_spacing_ms_IgnoreAndReturn(300);
+
+    commands_poll();
+    commands_poll();
+    commands_poll();
+
+    // The LF of a CRLF is skipped as a blank line
+    receive("\nset spacing 0x100\n");
+    decide_set_min_spacing_ms_Expect(256);
+    decide_get_position_min_spacing_ms_IgnoreAndReturn(256);
+
+    commands_poll();
+    commands_poll();
+    commands_poll();
+}
+
+void test_commands_set_speed_Should_DriveStepperAndReportQuantizedTarget(void) {
+    receive("set speed 70\n");
+    tb6600_set_speed_Expect(70);
+    tb6600_get_target_speed_mm_per_s_ExpectAndReturn(69);
+
+    commands_poll();
+    commands_poll();
+    TEST_ASSERT_EQUAL_STRING("OK speed=69\r\n", s_out);
+}
+
+void test_commands_Should_RejectBadInputWithoutSideEffects(void) {
+    // Strict mocks: any setter call here fails the test
+    receive("set bpm 300\n");     // out of uint8_t range
+    commands_poll();
+    commands_poll();
+    receive("set belt 0\n");      // Decide needs > 0
+    commands_poll();
+    commands_poll();
+    receive("set bpm 3x\n");
+    commands_poll();
+    commands_poll();
+    receive("set spacing 10 4\n"); // no such diverter
+    commands_poll();
+    commands_poll();
+    commands_poll();
+    receive("set\n");
+    commands_poll();
+}
+
+void test_commands_poll_TooLongLine_IsDiscardedWhole(void) {
+    // CMD_LINE_MAX - 1 characters fit; the rest of the line is dropped with it
+    char line[CMD_LINE_MAX + 8];
+    memset(line, 'x', sizeof(line) - 2U);
+    memcpy(line, "set bpm ", 8);
+    line[sizeof(line) - 2U] = '\n';
+    line[sizeof(line) - 1U] = '\0';
+    receive(line);
+    for (uint8_t i = 0; i < (sizeof(line) - 1U + CMD_BYTES_PER_POLL - 1U) / CMD_BYTES_PER_POLL; i++) {
+        commands_poll();
+    }
+
+    receive("get bpm\n");
+    decide_get_max_blocks_per_min_ExpectAndReturn(0);
+    commands_poll();
+}
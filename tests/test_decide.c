@@ -7,6 +7,12 @@
 #include "mock_log.h"
 #include "mock_tb6600.h" 
 
+// 10 mm block at 100 mm/s: the gate opens 100 ms (ACTUATION_ADVANCE_MS) before
+// the leading edge, 200 ms before the trailing edge, and holds 200 + 50 ms
+// (SERVO_RELEASE_MS). Time-keyed items may fire up to 150 ms late (200 ms less
+// half the block) before they are MISSED.
+static const LengthInfo k_block = { 100, 10, LEN_SMALL };
+
 void setUp(void) {
     decide_init();
     decide_set_belt_mm_per_s(100);
@@ -49,38 +55,66 @@ void test_guardrail_Should_Reject_IfTooManyBlocks(void) {
     log_schedule_reject_Ignore();
 
     // 1st block: accepted
-    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, 1));
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, k_block, 1));
     
     // 2nd block: accepted
-    TEST_ASSERT_TRUE(decide_schedule(POS1, 2000, 2));
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 2000, k_block, 2));
     
     // 3rd block: should be REJECTED due to throughput limit
     log_schedule_reject_Expect(3000, 3, "throughput");
-    TEST_ASSERT_FALSE(decide_schedule(POS1, 3000, 3));
+    TEST_ASSERT_FALSE(decide_schedule(POS1, 3000, k_block, 3));
+}
+
+void test_guardrail_Should_KeepThroughputWindow_StartedAtZero(void) {
+    decide_set_max_blocks_per_min(1);
+    log_schedule_Ignore();
+
+    // A detection at millis() 0 (e.g. right after the wrap) opens the window
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 0, k_block, 1));
+
+    // Same minute: still counted against it
+    log_schedule_reject_Expect(500, 2, "throughput");
+    TEST_ASSERT_FALSE(decide_schedule(POS2, 500, k_block, 2));
 }
 
 void test_Guardrail_MinSpacing(void) {
-    decide_set_min_spacing_ms(500); 
+    decide_set_min_spacing_ms(100); 
 
     // Simulate that we just fired at T=1000
     // Run a valid cycle first to set internal state
-    actuate_fire_Expect(POS1); 
+    actuate_fire_for_Expect(POS1, 250); // recenters at 1250
     log_schedule_Ignore(); 
     log_actuate_Ignore();
-    decide_schedule(POS1, 0, 1);
+    decide_schedule(POS1, 0, k_block, 1);
     decide_tick(1000);
 
-    // Next item is due at 1200
-    // 1200 < (1000 + 500) -> violates spacing
-    decide_schedule(POS1, 500, 2);
+    // Next item is due at 1300
+    // 1300 < (1250 + 100) -> diverter still resting
+    decide_schedule(POS1, 300, k_block, 2);
     // Should NOT fire
-    decide_tick(1200);
+    decide_tick(1300);
     
-    // Tick at 1600
-    // 1600 > (1000 + 500) -> now valid and should fire
-    actuate_fire_Expect(POS1);
+    // Tick at 1350
+    // 1350 >= (1250 + 100) -> now valid; 50 ms late, so it holds 50 ms less
+    actuate_fire_for_Expect(POS1, 200);
+    log_actuate_Ignore();
+    decide_tick(1350);
+}
+
+void test_Guardrail_MinSpacing_DoesNotHoldBackOpenDiverter(void) {
+    decide_set_min_spacing_ms(500);
+    log_schedule_Ignore();
     log_actuate_Ignore();
-    decide_tick(1600);
+
+    // First block opens POS1 from 1000 to 1250; the next one is due at 1100,
+    // while the gate is still open, so it fires at once and extends the hold
+    decide_schedule(POS1, 0, k_block, 1);
+    decide_schedule(POS1, 100, k_block, 2);
+    actuate_fire_for_Expect(POS1, 250);
+    decide_tick(1000);
+    actuate_fire_for_Expect(POS1, 250);
+    decide_tick(1100);
+    TEST_ASSERT_EQUAL_UINT8(0, decide_queue_depth());
 }
 
 // ########## tests for logging ##########
@@ -89,12 +123,12 @@ void test_Logging_SCHEDULE(void) {
     decide_set_belt_mm_per_s(100);
 
     // Expect SCHEDULE log when a valid item is accepted
-    log_schedule_Expect(1000, POS2, 2900, 55); 
+    log_schedule_Expect(1000, POS2, 3200, 55); 
     // 240mm dist / 100 speed = 2400ms
-    // 2400 - 500 advance = 1900 delay
-    // 1000 + 1900 = 2900 due
+    // 2400 - 100 dwell - 100 advance = 2200 delay
+    // 1000 + 2200 = 3200 due
 
-    decide_schedule(POS2, 1000, 55);
+    decide_schedule(POS2, 1000, k_block, 55);
 }
 
 void test_Logging_PASS_Rejection(void) {
@@ -103,7 +137,7 @@ void test_Logging_PASS_Rejection(void) {
     // Expect SCHEDULE_REJECT with reason pass-through
     log_schedule_reject_Expect(1000, 99, "pass-through");
 
-    bool result = decide_schedule(PASS_THROUGH, 1000, 99);
+    bool result = decide_schedule(PASS_THROUGH, 1000, k_block, 99);
     TEST_ASSERT_FALSE(result);
 }
 
@@ -119,21 +153,222 @@ void test_RoutingAndTiming(void) {
 
     // TEST TIMING
     uint32_t t_detect = 1000;
-    uint32_t t_expected_fire = 1700;
+    uint32_t t_expected_fire = 2000;
 
     // Expect logging
     log_schedule_Expect(t_detect, POS1, t_expected_fire, 10);
 
     // Schedule
-    decide_schedule(POS1, t_detect, 10);
+    decide_schedule(POS1, t_detect, k_block, 10);
 
     // VERIFY ACTUATION
     // Tick before due time -> should not fire
-    decide_tick(1699); 
+    decide_tick(1999); 
     
     // Tick at due time -> should fire POS1
-    actuate_fire_Expect(POS1);
-    log_actuate_Expect(t_expected_fire, POS1, 10);
+    actuate_fire_for_Expect(POS1, 250);
+    log_actuate_Expect(t_expected_fire, POS1, 10, 150);
     
     decide_tick(t_expected_fire);
-}
\ No newline at end of file
+}
+// ########## tests for position-keyed scheduling ##########
+
+void test_ScheduleAtPosition_FiresOnBeltPosition(void) {
+    // 3200 Hz: 10 mm block = 318 pulses, advance 100 ms = 320 pulses
+    // POS1 120 mm = 3819 pulses -> 3181 pulses after detection (~994 ms)
+    tb6600_get_step_rate_hz_ExpectAndReturn(3200);
+    log_schedule_Expect(1000, POS1, 1994, 7);
+    TEST_ASSERT_TRUE(decide_schedule_at_position(POS1, 10000, 1000, k_block, 7));
+
+    // Wall-clock time alone does not fire it; the belt has not moved far enough
+    tb6600_get_position_pulses_ExpectAndReturn(13180);
+    decide_tick(5000);
+
+    // Hold: 638 pulses to the trailing edge at the current rate, plus release
+    tb6600_get_position_pulses_ExpectAndReturn(13181);
+    tb6600_get_step_rate_hz_ExpectAndReturn(3200);
+    actuate_fire_for_Expect(POS1, 249);
+    log_actuate_Expect(5010, POS1, 7, 149); // 479 pulses of window left
+    decide_tick(5010);
+}
+
+void test_ScheduleAtPosition_Rejects_WhenBeltStopped(void) {
+    tb6600_get_step_rate_hz_ExpectAndReturn(0);
+    log_schedule_reject_Expect(1000, 8, "invalid-config");
+    TEST_ASSERT_FALSE(decide_schedule_at_position(POS1, 0, 1000, k_block, 8));
+}
+
+// ########## tests for millis() wrap ##########
+
+void test_Tick_FiresAcrossMillisWrap(void) {
+    // Detect 300 ms before the 32-bit wrap; POS1 is due 1000 ms later (after it)
+    uint32_t t_detect = 0xFFFFFFFFUL - 299UL;
+    uint32_t t_due = t_detect + 1000UL; // = 700 after the wrap
+
+    log_schedule_Expect(t_detect, POS1, t_due, 20);
+    TEST_ASSERT_TRUE(decide_schedule(POS1, t_detect, k_block, 20));
+
+    // Just before the wrap, and just after it: not due yet
+    decide_tick(0xFFFFFFFFUL);
+    decide_tick(0);
+    decide_tick(t_due - 1UL);
+
+    actuate_fire_for_Expect(POS1, 250);
+    log_actuate_Expect(t_due, POS1, 20, 150);
+    decide_tick(t_due);
+}
+
+void test_Guardrail_MinSpacing_AcrossMillisWrap(void) {
+    decide_set_min_spacing_ms(100);
+    log_schedule_Ignore();
+    log_actuate_Ignore();
+
+    // Fire 100 ms before the wrap; the diverter recenters 150 ms after it
+    actuate_fire_for_Expect(POS1, 250);
+    decide_schedule(POS1, 0xFFFFFFFFUL - 1099UL, k_block, 1);
+    decide_tick(0xFFFFFFFFUL - 99UL);
+
+    // Second item is due at 200; the rest ends at 250
+    decide_schedule(POS1, 0xFFFFFFFFUL - 799UL, k_block, 2);
+    decide_tick(200);
+    decide_tick(249);
+
+    actuate_fire_for_Expect(POS1, 200);
+    decide_tick(250);
+}
+
+// ########## tests for the sorted queue ##########
+
+void test_Queue_FiresEarliestDueFirst_RegardlessOfScheduleOrder(void) {
+    log_schedule_Ignore();
+    log_actuate_Ignore();
+
+    // POS3 (360 mm) scheduled first is due at 1000 + 3400; POS1 (120 mm)
+    // scheduled later is due at 1500 + 1000 and must go first
+    TEST_ASSERT_TRUE(decide_schedule(POS3, 1000, k_block, 1));
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1500, k_block, 2));
+
+    actuate_fire_for_Expect(POS1, 250);
+    decide_tick(2500);
+    decide_tick(4399);
+    actuate_fire_for_Expect(POS3, 250);
+    decide_tick(4400);
+    TEST_ASSERT_EQUAL_UINT8(0, decide_queue_depth());
+}
+
+void test_Queue_RejectsWhenFull_AndReportsHighWater(void) {
+    log_schedule_Ignore();
+    for (uint16_t i = 0; i < SCHED_CAPACITY; i++) {
+        TEST_ASSERT_TRUE(decide_schedule(POS2, 1000U + i, k_block, i));
+    }
+    log_schedule_reject_Expect(5000, 999, "queue-full");
+    TEST_ASSERT_FALSE(decide_schedule(POS2, 5000, k_block, 999));
+    TEST_ASSERT_EQUAL_UINT8(SCHED_CAPACITY, decide_queue_high_water());
+
+    // Draining keeps the high-water mark
+    log_actuate_Ignore();
+    actuate_fire_for_Ignore();
+    decide_tick(1000U + SCHED_CAPACITY + 2200U);
+    TEST_ASSERT_EQUAL_UINT8(SCHED_CAPACITY - 1U, decide_queue_depth());
+    TEST_ASSERT_EQUAL_UINT8(SCHED_CAPACITY, decide_queue_high_water());
+}
+
+// ########## tests for per-diverter spacing ##########
+
+void test_Spacing_IsPerDiverter(void) {
+    decide_set_min_spacing_ms(1000);
+    log_schedule_Ignore();
+    log_actuate_Ignore();
+
+    // POS3 (3400 ms from detection) and POS1 (1000 ms) both due at 4400:
+    // the second firing must not wait for the first diverter's spacing
+    TEST_ASSERT_TRUE(decide_schedule(POS3, 1000, k_block, 1));
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 3400, k_block, 2));
+    actuate_fire_for_Expect(POS3, 250);
+    decide_tick(4400);
+    actuate_fire_for_Expect(POS1, 249);
+    decide_tick(4401);
+}
+
+void test_Spacing_BlockedItem_DoesNotHoldBackOtherDiverter(void) {
+    decide_set_min_spacing_ms(250);
+    decide_set_position_min_spacing_ms(POS2, 0);
+    log_schedule_Ignore();
+    log_actuate_Ignore();
+
+    // Two POS1 items and a later POS2 item all due; the second POS1 is held
+    // while the first diverter rests (2250..2500) and POS2 (no spacing) goes
+    // past it
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, k_block, 1)); // due 2000
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1400, k_block, 2)); // due 2400
+    TEST_ASSERT_TRUE(decide_schedule(POS2, 250, k_block, 3));  // due 2450
+    actuate_fire_for_Expect(POS1, 250);
+    decide_tick(2000);
+    decide_tick(2400);
+    actuate_fire_for_Expect(POS2, 250);
+    decide_tick(2450);
+    decide_tick(2499);
+    actuate_fire_for_Expect(POS1, 150);
+    decide_tick(2500);
+    TEST_ASSERT_EQUAL_UINT8(0, decide_queue_depth());
+    TEST_ASSERT_EQUAL_UINT16(0, decide_get_position_min_spacing_ms(POS2));
+}
+
+// ########## tests for late actuations ##########
+
+void test_Late_FiresUntilWindowEnds_ThenMissed(void) {
+    log_schedule_Ignore();
+
+    // Due at 2000 with a 150 ms window: firing at 2150 leaves no slack, and
+    // the gate only has to stay open for the last 50 ms of the block
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, k_block, 1));
+    actuate_fire_for_Expect(POS1, 100);
+    log_actuate_Expect(2150, POS1, 1, 0);
+    decide_tick(2150);
+
+    // One millisecond later the block has gone by: dropped, not fired
+    TEST_ASSERT_TRUE(decide_schedule(POS2, 1500, k_block, 2)); // due 3700
+    log_missed_Expect(3851, POS2, 2, 151);
+    decide_tick(3851);
+    TEST_ASSERT_EQUAL_UINT8(0, decide_queue_depth());
+    TEST_ASSERT_EQUAL_UINT32(1, decide_missed_count());
+}
+
+void test_Late_WindowShrinksWithBlockLength(void) {
+    // 40 mm: the gate opens 500 ms before the trailing edge; half the block
+    // (200 ms) comes off that
+    const LengthInfo block40 = { 400, 40, LEN_SMALL };
+    log_schedule_Ignore();
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, block40, 1)); // due 1700
+    log_missed_Expect(2001, POS1, 1, 301);
+    decide_tick(2001);
+}
+
+void test_Late_MissedItem_DoesNotBlockLaterItems(void) {
+    log_schedule_Ignore();
+    log_missed_Ignore();
+    TEST_ASSERT_TRUE(decide_schedule(POS1, 1000, k_block, 1)); // due 2000, window ends 2150
+    TEST_ASSERT_TRUE(decide_schedule(POS3, 0, k_block, 2));    // due 3400
+    actuate_fire_for_Expect(POS3, 250);
+    log_actuate_Expect(3400, POS3, 2, 150);
+    decide_tick(3400);
+    TEST_ASSERT_EQUAL_UINT32(1, decide_missed_count());
+}
+
+// ########## tests for per-block hold ##########
+
+void test_Hold_FollowsBlockLength(void) {
+    // 40 mm block: opens 500 ms before its trailing edge and holds 550 ms;
+    // the 10 mm block holds 250 ms
+    const LengthInfo block40 = { 400, 40, LEN_SMALL };
+    log_schedule_Expect(1000, POS2, 2900, 1);
+    TEST_ASSERT_TRUE(decide_schedule(POS2, 1000, block40, 1));
+    log_schedule_Expect(1000, POS3, 4400, 2);
+    TEST_ASSERT_TRUE(decide_schedule(POS3, 1000, k_block, 2));
+
+    log_actuate_Ignore();
+    actuate_fire_for_Expect(POS2, 550);
+    decide_tick(2900);
+    actuate_fire_for_Expect(POS3, 250);
+    decide_tick(4400);
+}
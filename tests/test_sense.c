@@ -4,6 +4,7 @@
 #include "sense.h"
 #include "config.h"
 #include "pins.h"
+#include "fmt.h"
 
 // Ceedling mocks
 #include "mock_timers.h"
@@ -13,20 +14,23 @@
 #include "mock_apds9960.h" 
 #include "mock_vl6180.h" 
 #include "mock_uart.h"
+#include "mock_log.h"
 
 // Setup/teardown before/after each test
-void setUp(void) {}
+void setUp(void) {
+    log_enabled_IgnoreAndReturn(true);  // all log categories on
+}
 void tearDown(void) {}
 
 void test_sense_init_Should_InitializeSensorsAndState(void) {
-    uart_write_IgnoreAndReturn(1);  // some logging
+    uart_write_P_IgnoreAndReturn(1);  // some logging
     // The sensors are expected to be initialized
     vl6180_init_ExpectAndReturn(true);  // ToF
-    uart_write_IgnoreAndReturn(1);  // logging
+    uart_write_P_IgnoreAndReturn(1);  // logging
     vl6180_config_threshold_mm_ExpectAndReturn(TOF_THRESHOLD_MM, TOF_HYST_MM, true);
-    uart_write_IgnoreAndReturn(1);  // logging
+    uart_write_P_IgnoreAndReturn(1);  // logging
     apds9960_init_ExpectAndReturn(true);  // Color
-    uart_write_IgnoreAndReturn(1);  // logging
+    uart_write_P_IgnoreAndReturn(1);  // logging
 
     // Current time should be called
     millis_ExpectAndReturn(100);
@@ -39,6 +43,7 @@ void test_sense_init_Should_InitializeSensorsAndState(void) {
     set_above_count(1);
     set_col_sums((uint32_t[]){1,1,1,1});
     set_color_sample_count(1);
+    set_color_read_pending(1);
 
     sense_init();
 
@@ -53,6 +58,7 @@ void test_sense_init_Should_InitializeSensorsAndState(void) {
     TEST_ASSERT_EQUAL_UINT32(0, get_col_b_sum());
     TEST_ASSERT_EQUAL_UINT32(0, get_col_c_sum());
     TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count());
+    TEST_ASSERT_EQUAL_UINT8(0, get_color_read_pending());
 }
 
 // For testing computing small block's length
@@ -187,7 +193,7 @@ void test_sense_session_should_end_Should_EndSession(void) {
     
     uint32_t dtimes[] = {1, 100, 1000};  // how much beyond timeout limit
     for (size_t i=0; i<3; i++) {
-        set_last_interrupt(now_ms - (VL6180_QUIET_TIMEOUT_MS + dtimes[i]));
+        set_last_interrupt(now_ms - (VL6180_SESSION_TIMEOUT_MS + dtimes[i]));
         TEST_ASSERT_TRUE(t_session_should_end(now_ms));
     }
 }
@@ -197,13 +203,13 @@ void test_sense_session_should_end_ShouldNot_EndSession(void) {
 
     // If session is not active, shouldn't end even with timeout
     set_session_active(0);
-    set_last_interrupt(now_ms - (VL6180_QUIET_TIMEOUT_MS + 1000));
+    set_last_interrupt(now_ms - (VL6180_SESSION_TIMEOUT_MS + 1000));
     TEST_ASSERT_FALSE(t_session_should_end(now_ms));
 
     set_session_active(1);
     uint32_t dtimes[] = {0, 1, 100};  // how much "within" timeout limit
     for (size_t i=0; i<3; i++) {
-        set_last_interrupt(now_ms - (VL6180_QUIET_TIMEOUT_MS - dtimes[i]));
+        set_last_interrupt(now_ms - (VL6180_SESSION_TIMEOUT_MS - dtimes[i]));
         TEST_ASSERT_FALSE(t_session_should_end(now_ms));
     }
 }
@@ -253,14 +259,17 @@ void test_sense_finalize_result_RedUnambiguousSmall(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(50, 10, 5, 60, COLOR_RED);
-    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing red, ambiguous, small
@@ -272,14 +281,17 @@ void test_sense_finalize_result_RedAmbiguousSmall(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(50, 10, 5, 49, COLOR_RED);
-    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=49 class=0 amb=1\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
     TEST_ASSERT_TRUE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=49 class=0 amb=1\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing red, unambiguous, large
@@ -291,14 +303,17 @@ void test_sense_finalize_result_RedUnambiguousLarge(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(50, 10, 5, 60, COLOR_RED);
-    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(1000, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_NOT_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing green
@@ -310,14 +325,17 @@ void test_sense_finalize_result_Green(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(10, 50, 5, 60, COLOR_GREEN);
-    uart_write_ExpectAndReturn("color: n=10 r=10 g=50 b=5 c=60 class=1 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_GREEN, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=10 g=50 b=5 c=60 class=1 amb=0\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing blue
@@ -329,14 +347,17 @@ void test_sense_finalize_result_Blue(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(10, 5, 50, 60, COLOR_BLUE);
-    uart_write_ExpectAndReturn("color: n=10 r=10 g=5 b=50 c=60 class=2 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_BLUE, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=10 g=5 b=50 c=60 class=2 amb=0\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing other
@@ -348,14 +369,17 @@ void test_sense_finalize_result_Other(void) {
 
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(10, 10, 10, 60, COLOR_OTHER);
-    uart_write_ExpectAndReturn("color: n=10 r=10 g=10 b=10 c=60 class=3 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_OTHER, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=10 r=10 g=10 b=10 c=60 class=3 amb=0\r\n", 1);
+    sense_debug_tick();
 }
 
 // Test finalizing when no samples
@@ -374,14 +398,61 @@ void test_sense_finalize_result_NoSamples(void) {
     apds9960_read_rgbc_ReturnThruPtr_b(&b);
     apds9960_read_rgbc_ReturnThruPtr_c(&c);
     apds9960_classify_ExpectAndReturn(50, 10, 5, 60, COLOR_RED);
-    uart_write_ExpectAndReturn("color: n=1 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
     TEST_ASSERT_FALSE(out.ambiguous);
+
+    // The color line goes out later, once the UART is idle
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=1 r=50 g=10 b=5 c=60 class=0 amb=0\r\n", 1);
+    sense_debug_tick();
+}
+
+// Test that color lines wait for an idle UART and report records overwritten meanwhile
+void test_sense_debug_tick_Should_WaitForRoomInUartAndCountLost(void) {
+    set_session_active(0);  // empty debug queue
+    set_current_event((DetectEvent){0, 10000, 10500});
+    SenseResult out = {0};
+    for (uint16_t i = 1; i <= SENSE_COLOR_DEBUG_LEN + 1; i++) {
+        set_col_sums((uint32_t[]){i, 0, 0, 60});
+        set_color_sample_count(1);
+        decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
+        apds9960_classify_ExpectAndReturn(i, 0, 0, 60, COLOR_RED);
+        t_finalize_result(&out);
+    }
+
+    // Other output still queued: nothing printed
+    uart_tx_free_ExpectAndReturn(10);
+    sense_debug_tick();
+
+    // The first record was overwritten; room for the longest line is enough
+    uart_tx_free_ExpectAndReturn(100);
+    uart_write_ExpectAndReturn("color: n=1 r=2 g=0 b=0 c=60 class=0 amb=0 lost=1\r\n", 1);
+    sense_debug_tick();
+    uart_tx_free_ExpectAndReturn(UART_TX_BUFFER_SIZE - 1);
+    uart_write_ExpectAndReturn("color: n=1 r=3 g=0 b=0 c=60 class=0 amb=0\r\n", 1);
+    sense_debug_tick();
+}
+
+// Test that no color record is kept while the debug log category is off
+void test_sense_finalize_result_DebugCategoryOff_QueuesNothing(void) {
+    set_session_active(0);  // empty debug queue
+    set_current_event((DetectEvent){0, 10000, 10500});
+    set_col_sums((uint32_t[]){500, 100, 50, 600});
+    set_color_sample_count(10);
+    SenseResult out = {0};
+
+    decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
+    apds9960_classify_ExpectAndReturn(50, 10, 5, 60, COLOR_RED);
+    log_enabled_ExpectAndReturn(LOG_CAT_DEBUG, false);
+
+    t_finalize_result(&out);
+    TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
+
+    sense_debug_tick();  // nothing queued: does not even look at the UART
 }
 
 // Simple integration test finalizing result (small, red, unambiguous)
@@ -408,9 +479,6 @@ void test_sense_finalize_result_Should_PopulateOutput(void) {
     // Mock for color classification
     apds9960_classify_ExpectAndReturn(r, g, b, c, COLOR_RED);
 
-    // Some logging is expected
-    uart_write_ExpectAnyArgsAndReturn(1);
-
     t_finalize_result(&out);
 
     TEST_ASSERT_EQUAL_UINT8(de.present, out.ev.present);       
@@ -446,15 +514,17 @@ void test_sense_poll_EventNoSession(void) {
     uint32_t now = 10000;
     set_session_active(0);
     set_last_color_sample(now);  // to avoid immediate sampling
+    set_color_read_pending(0);
 
     // Expectations
     millis_ExpectAndReturn(now);
     
     vl6180_event_ExpectAndReturn(true);  // if event...
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true); // arguments are never used
-        vl6180_clear_interrupt_Expect();
+        vl6180_event_time_us_ExpectAndReturn(5000); // edge stamped in the ISR...
+        micros_ExpectAndReturn(5000);               // ...just now (no lag)
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_HIGH, true); // wait for exit, queued on TWI engine
         gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_HIGH); // LED on
-        uart_write_ExpectAnyArgsAndReturn(1);
+        uart_write_P_ExpectAnyArgsAndReturn(1);
 
     // Execution and verification
     TEST_ASSERT_FALSE(sense_poll(NULL));  // should not finalize
@@ -462,58 +532,120 @@ void test_sense_poll_EventNoSession(void) {
     TEST_ASSERT_TRUE(get_session_active());
 }
 
-// Test polling when session active and evet occurs
-void test_sense_poll_EventSession(void) {
+// Test polling when session active and the exit (HIGH-threshold) event occurs
+void test_sense_poll_ExitEvent_EndsSession(void) {
     // Internals
     uint32_t now = 10000;
+    SenseResult out = {0};
     set_session_active(1);
     set_last_color_sample(now);  // to avoid immediate sampling
     set_last_interrupt(now - 500);  // to see the change
+    set_col_sums((uint32_t[]){50,0,0,50});
+    set_color_sample_count(1);
+    set_color_read_pending(0);
+    set_current_event((DetectEvent){1, now - 500, 0});  // dwell 500ms (small)
 
     // Expectations
     millis_ExpectAndReturn(now);
     vl6180_event_ExpectAndReturn(true);  // if event
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true);  // arguments are never used
-        vl6180_clear_interrupt_Expect();
+        vl6180_event_time_us_ExpectAndReturn(5000); // edge stamped in the ISR...
+        micros_ExpectAndReturn(5000);               // ...just now (no lag)
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_LOW, true); // wait for next block
+
+    gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_LOW); // end -> LED off
+    decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
+    apds9960_classify_ExpectAndReturn(50, 0, 0, 50, COLOR_RED);
+
+    // Execution and verification: ends right at the edge, no timeout wait
+    TEST_ASSERT_TRUE(sense_poll(&out));
+    TEST_ASSERT_FALSE(get_session_active());
+    TEST_ASSERT_EQUAL_UINT32(now, get_last_interrupt_ms());
+    TEST_ASSERT_EQUAL_UINT32(now, out.ev.t_exit_ms);
+    TEST_ASSERT_EQUAL_UINT32(500, out.length.dwell_ms);
+    TEST_ASSERT_FALSE(out.ambiguous);
+}
+
+// Test that the session uses the ISR edge time, not the (later) poll time
+void test_sense_poll_EventNoSession_UsesIsrEdgeTime(void) {
+    // Internals
+    uint32_t now = 10000;
+    set_session_active(0);
+    set_last_color_sample(now);  // to avoid immediate sampling
+    set_color_read_pending(0);
+
+    // Expectations
+    millis_ExpectAndReturn(now);
+    vl6180_event_ExpectAndReturn(true);
+        vl6180_event_time_us_ExpectAndReturn(1000000);  // edge...
+        micros_ExpectAndReturn(1003700);                // ...3.7 ms before this poll
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_HIGH, true);
+        gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_HIGH);
+        uart_write_P_ExpectAnyArgsAndReturn(1);
 
     // Execution and verification
-    TEST_ASSERT_FALSE(sense_poll(NULL));  // should not finalize
-    TEST_ASSERT_EQUAL_UINT32(now, get_last_interrupt_ms());  // should be updated
+    TEST_ASSERT_FALSE(sense_poll(NULL));
+    TEST_ASSERT_EQUAL_UINT32(now - 3, get_last_interrupt_ms());
+    TEST_ASSERT_EQUAL_UINT32(now - 3, get_current_event().t_enter_ms);
+}
+
+// Test polling when the TWI queue is full: the mode switch is written blocking instead
+void test_sense_poll_EventQueueFull_FallsBackToBlockingModeSwitch(void) {
+    // Internals
+    uint32_t now = 10000;
+    set_session_active(0);
+    set_last_color_sample(now);  // to avoid immediate sampling
+    set_last_interrupt(now - 500);
+    set_color_read_pending(0);
+
+    // Expectations
+    millis_ExpectAndReturn(now);
+    vl6180_event_ExpectAndReturn(true);
+        vl6180_event_time_us_ExpectAndReturn(5000); // edge stamped in the ISR...
+        micros_ExpectAndReturn(5000);               // ...just now (no lag)
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_HIGH, false);  // queue full
+        vl6180_set_interrupt_mode_Expect(VL6180_INT_HIGH);
+        gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_HIGH);
+        uart_write_P_ExpectAnyArgsAndReturn(1);
+
+    // Execution and verification
+    TEST_ASSERT_FALSE(sense_poll(NULL));
+    TEST_ASSERT_EQUAL_UINT32(now, get_last_interrupt_ms());
     TEST_ASSERT_TRUE(get_session_active());
 }
 
-// Test polling when session active and should end
-void test_sense_poll_EndSession(void) {
+// Test polling when the exit event was lost: fallback timeout ends the session
+void test_sense_poll_EndSession_OnTimeout_IsAmbiguous(void) {
     // Internals
     uint32_t now = 10000;
     SenseResult out = {0};
-    uint32_t last_int = now - VL6180_QUIET_TIMEOUT_MS - 1;
+    uint32_t last_int = now - VL6180_SESSION_TIMEOUT_MS - 1;
     set_session_active(1);
     set_last_color_sample(now);  // to avoid immediate sampling
     set_last_interrupt(last_int);  // to end
     set_col_sums((uint32_t[]){50,0,0,50}); // avg r=50, g=0, b=0, c=50
     set_color_sample_count(1);
-    set_current_event((DetectEvent){1, last_int-500, last_int});  // dwell 500ms (small)
+    set_color_read_pending(0);
+    set_current_event((DetectEvent){1, last_int, 0});
 
     // Expectations
     millis_ExpectAndReturn(now);
     vl6180_event_ExpectAndReturn(false);  // no new event
 
+    vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_LOW, true); // re-arm for the next block
     gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_LOW); // end -> LED off
     decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
     apds9960_classify_ExpectAndReturn(50, 0, 0, 50, COLOR_RED);
-    uart_write_ExpectAnyArgsAndReturn(1);
 
     // Execution and verification
     TEST_ASSERT_TRUE(sense_poll(&out));  // should end
     TEST_ASSERT_FALSE(get_session_active());
-    TEST_ASSERT_EQUAL_UINT32(last_int, out.ev.t_exit_ms);  // test output...
+    TEST_ASSERT_EQUAL_UINT32(now, out.ev.t_exit_ms);  // test output...
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
-    TEST_ASSERT_FALSE(out.ambiguous);
-    TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, out.length.cls);
+    TEST_ASSERT_TRUE(out.ambiguous);  // length unknown
 }
 
 // Test polling when session active and accumulate colors
+// The APDS read is started on one poll and collected on a later one
 void test_sense_poll_Accumulate(void) {
     // Internals
     uint32_t now = 10000;
@@ -522,17 +654,120 @@ void test_sense_poll_Accumulate(void) {
     set_last_interrupt(now);  // not to end
     set_col_sums((uint32_t[]){0,0,0,0});
     set_color_sample_count(0);
+    set_color_read_pending(0);
 
-    // Expectations
+    // Expectations: start the read
     millis_ExpectAndReturn(now);
     vl6180_event_ExpectAndReturn(false);  // no new event
 
-    apds9960_read_rgbc_ExpectAnyArgsAndReturn(true);
+    apds9960_read_rgbc_async_ExpectAndReturn(true);
 
     // Execution and verification
-    TEST_ASSERT_FALSE(sense_poll(NULL));  // should finalize
+    TEST_ASSERT_FALSE(sense_poll(NULL));  // should not finalize
     TEST_ASSERT_EQUAL_UINT32(now, get_last_color_sample_ms()); // should be updated
+    TEST_ASSERT_TRUE(get_color_read_pending());
+    TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count()); // nothing collected yet
+
+    // Next poll: read still on the bus
+    millis_ExpectAndReturn(now + 1);
+    vl6180_event_ExpectAndReturn(false);
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(0);
+
+    TEST_ASSERT_FALSE(sense_poll(NULL));
+    TEST_ASSERT_TRUE(get_color_read_pending());
+    TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count());
+
+    // Next poll: read done, sample collected
+    uint16_t r=5, g=15, b=25, c=35;
+    millis_ExpectAndReturn(now + 2);
+    vl6180_event_ExpectAndReturn(false);
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(1);
+    apds9960_read_rgbc_result_ReturnThruPtr_r(&r);
+    apds9960_read_rgbc_result_ReturnThruPtr_g(&g);
+    apds9960_read_rgbc_result_ReturnThruPtr_b(&b);
+    apds9960_read_rgbc_result_ReturnThruPtr_c(&c);
+
+    TEST_ASSERT_FALSE(sense_poll(NULL));
+    TEST_ASSERT_FALSE(get_color_read_pending());
     TEST_ASSERT_EQUAL_UINT16(1, get_color_sample_count()); // should be incremented
+    TEST_ASSERT_EQUAL_UINT32(5, get_col_r_sum());
+    TEST_ASSERT_EQUAL_UINT32(35, get_col_c_sum());
+}
+
+// Test polling when the async APDS read never completes: it is cancelled
+void test_sense_poll_StuckColorRead_IsCancelled(void) {
+    uint32_t now = 10000;
+    set_session_active(1);
+    set_last_color_sample(now - TWI_ASYNC_TIMEOUT_MS - 1);
+    set_last_interrupt(now);  // not to end
+    set_color_sample_count(0);
+    set_color_read_pending(1);
+
+    millis_ExpectAndReturn(now);
+    vl6180_event_ExpectAndReturn(false);
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(0);  // still pending
+    apds9960_read_rgbc_cancel_Expect();
+    apds9960_read_rgbc_async_ExpectAndReturn(true);  // cadence elapsed: retry
+
+    TEST_ASSERT_FALSE(sense_poll(NULL));
+    TEST_ASSERT_TRUE(get_color_read_pending());
+    TEST_ASSERT_EQUAL_UINT32(now, get_last_color_sample_ms());
+    TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count());
+}
+
+// Test that a block arriving while the previous one still waits for its last
+// color read gets a session of its own; the earlier result follows once the read lands
+void test_sense_poll_NextBlock_WhileFinalizing_GetsOwnSession(void) {
+    uint32_t now = 10000;
+    SenseResult out = {0};
+    set_session_active(1);
+    set_current_event((DetectEvent){1, now - 500, 0});  // dwell 500ms (small)
+    set_last_interrupt(now - 500);
+    set_last_color_sample(now);  // to avoid immediate sampling
+    set_col_sums((uint32_t[]){500, 0, 0, 500});
+    set_color_sample_count(10);
+    set_color_read_pending(1);
+
+    // Block A leaves with its last sample still on the bus: no result yet
+    millis_ExpectAndReturn(now);
+    vl6180_event_ExpectAndReturn(true);
+        vl6180_event_time_us_ExpectAndReturn(5000);
+        micros_ExpectAndReturn(5000);
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_LOW, true);
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(0);
+    gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_LOW);
+
+    TEST_ASSERT_FALSE(sense_poll(&out));
+    TEST_ASSERT_FALSE(get_session_active());
+    TEST_ASSERT_EQUAL_UINT8(0, get_result_count());
+
+    // Block B arrives 5 ms later, and A's sample lands in the same poll
+    uint16_t r=50, g=0, b=0, c=50;
+    millis_ExpectAndReturn(now + 5);
+    vl6180_event_ExpectAndReturn(true);
+        vl6180_event_time_us_ExpectAndReturn(10000);
+        micros_ExpectAndReturn(10000);
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_HIGH, true);
+        gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_HIGH);
+        uart_write_P_ExpectAnyArgsAndReturn(1);
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(1);
+    apds9960_read_rgbc_result_ReturnThruPtr_r(&r);
+    apds9960_read_rgbc_result_ReturnThruPtr_g(&g);
+    apds9960_read_rgbc_result_ReturnThruPtr_b(&b);
+    apds9960_read_rgbc_result_ReturnThruPtr_c(&c);
+    decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
+    apds9960_classify_ExpectAndReturn(50, 0, 0, 50, COLOR_RED);  // 11 samples, A's only
+
+    TEST_ASSERT_TRUE(sense_poll(&out));
+    TEST_ASSERT_EQUAL_UINT32(now - 500, out.ev.t_enter_ms);
+    TEST_ASSERT_EQUAL_UINT32(now, out.ev.t_exit_ms);
+    TEST_ASSERT_EQUAL_UINT8(COLOR_RED, out.color);
+    TEST_ASSERT_EQUAL_UINT8(0, get_result_count());
+
+    // B collects in its own session, starting from no samples
+    TEST_ASSERT_TRUE(get_session_active());
+    TEST_ASSERT_EQUAL_UINT32(now + 5, get_current_event().t_enter_ms);
+    TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count());
 }
 
 // Longer integration test for polling multiple steps
@@ -541,13 +776,13 @@ void test_sense_poll_FullCycle(void) {
     SenseResult sr = {0};
 
 // Initialize the sense
-    uart_write_ExpectAnyArgsAndReturn(1);
+    uart_write_P_ExpectAnyArgsAndReturn(1);
     vl6180_init_ExpectAndReturn(true);
-    uart_write_ExpectAnyArgsAndReturn(1);
+    uart_write_P_ExpectAnyArgsAndReturn(1);
     vl6180_config_threshold_mm_ExpectAndReturn(TOF_THRESHOLD_MM, TOF_HYST_MM, true);
-    uart_write_ExpectAnyArgsAndReturn(1);
+    uart_write_P_ExpectAnyArgsAndReturn(1);
     apds9960_init_ExpectAndReturn(true);
-    uart_write_ExpectAnyArgsAndReturn(1);
+    uart_write_P_ExpectAnyArgsAndReturn(1);
     millis_ExpectAndReturn(time);
     sense_init();
 
@@ -562,95 +797,88 @@ void test_sense_poll_FullCycle(void) {
     TEST_ASSERT_FALSE(get_session_active());
 
 
-// 2. poll, event occurs
+// 2. poll, LOW event: block arrived
     time += 10;
     millis_ExpectAndReturn(time);
 
     vl6180_event_ExpectAndReturn(true);  // event
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true);
-        vl6180_clear_interrupt_Expect();
+        vl6180_event_time_us_ExpectAndReturn(5000); // edge stamped in the ISR...
+        micros_ExpectAndReturn(5000);               // ...just now (no lag)
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_HIGH, true);
         uint32_t start = time;
         gpio_write_Expect(GPIO_PIN_PRESENCE_LED, GPIO_HIGH); // LED on
-        uart_write_ExpectAnyArgsAndReturn(1);
+        uart_write_P_ExpectAnyArgsAndReturn(1);
 
     TEST_ASSERT_FALSE(sense_poll(&sr));  // polling
     TEST_ASSERT_TRUE(get_session_active());
     TEST_ASSERT_EQUAL_UINT32(time, get_last_interrupt_ms());
 
 
-// 3. poll, another event occurs
+// 3. poll, no event: block still present (sensor silent in HIGH mode)
     time += 10;
     millis_ExpectAndReturn(time);
 
-    vl6180_event_ExpectAndReturn(true);  // event
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true);
-        vl6180_clear_interrupt_Expect();
+    vl6180_event_ExpectAndReturn(false);
 
     TEST_ASSERT_FALSE(sense_poll(&sr));  // polling
     TEST_ASSERT_TRUE(get_session_active());
-    TEST_ASSERT_EQUAL_UINT32(time, get_last_interrupt_ms());
+    TEST_ASSERT_EQUAL_UINT32(start, get_last_interrupt_ms());
 
 
-// 4. poll, no event, time to accumulate color
+// 4. poll, no event, time to start a color read
     time += VL6180_MEAS_PERIOD_MS;
     millis_ExpectAndReturn(time);
 
     vl6180_event_ExpectAndReturn(false);  // no event
 
-    // Accumulation
-        uint16_t r=50, g=15, b=5, c=60;
-        apds9960_read_rgbc_ExpectAnyArgsAndReturn(true);
-         apds9960_read_rgbc_ReturnThruPtr_r(&r);
-         apds9960_read_rgbc_ReturnThruPtr_g(&g);
-         apds9960_read_rgbc_ReturnThruPtr_b(&b);
-         apds9960_read_rgbc_ReturnThruPtr_c(&c);
+    // Read is only started here; sample arrives on a later poll
+        apds9960_read_rgbc_async_ExpectAndReturn(true);
 
     TEST_ASSERT_FALSE(sense_poll(&sr));  // polling
     TEST_ASSERT_NOT_EQUAL_UINT32(time, get_last_interrupt_ms());
     TEST_ASSERT_EQUAL_UINT32(time, get_last_color_sample_ms());
+    TEST_ASSERT_TRUE(get_color_read_pending());
+    TEST_ASSERT_EQUAL_UINT16(0, get_color_sample_count());
 
 
-// 5. poll, new event, another accumulation
+// 5. poll, collect first sample and start another read
     time += VL6180_MEAS_PERIOD_MS;
     millis_ExpectAndReturn(time);
 
-    vl6180_event_ExpectAndReturn(true);  // event
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true);
-        vl6180_clear_interrupt_Expect();    
+    vl6180_event_ExpectAndReturn(false);  // no event
 
     // Accumulation
-        r=150, g=50, b=15, c=200;
-        apds9960_read_rgbc_ExpectAnyArgsAndReturn(true);
-         apds9960_read_rgbc_ReturnThruPtr_r(&r);
-         apds9960_read_rgbc_ReturnThruPtr_g(&g);
-         apds9960_read_rgbc_ReturnThruPtr_b(&b);
-         apds9960_read_rgbc_ReturnThruPtr_c(&c);
+        uint16_t r=50, g=15, b=5, c=60;
+        apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(1);
+         apds9960_read_rgbc_result_ReturnThruPtr_r(&r);
+         apds9960_read_rgbc_result_ReturnThruPtr_g(&g);
+         apds9960_read_rgbc_result_ReturnThruPtr_b(&b);
+         apds9960_read_rgbc_result_ReturnThruPtr_c(&c);
+        apds9960_read_rgbc_async_ExpectAndReturn(true);
 
     TEST_ASSERT_FALSE(sense_poll(&sr));
 
 
 // Couple artificial accumulations to speed things up
     // Verify accumulation so far
-    r=200, g=65, b=20, c=260; // totals
     TEST_ASSERT_EQUAL_UINT16(r, get_col_r_sum());
     TEST_ASSERT_EQUAL_UINT16(g, get_col_g_sum());
     TEST_ASSERT_EQUAL_UINT16(b, get_col_b_sum());
     TEST_ASSERT_EQUAL_UINT16(c, get_col_c_sum());
-    TEST_ASSERT_EQUAL_UINT16(2, get_color_sample_count());
+    TEST_ASSERT_EQUAL_UINT16(1, get_color_sample_count());
+    TEST_ASSERT_TRUE(get_color_read_pending());
 
     r=2500, g=605, b=270, c=5260; // new totals
     set_col_sums((uint32_t[]){r, g, b, c});
     set_color_sample_count(11);
 
 
-// 6. poll, last event, no accumulation
+// 6. poll, read still in flight
     time += 10;
     millis_ExpectAndReturn(time);
 
-    vl6180_event_ExpectAndReturn(true);  // event
-        vl6180_read_status_range_ExpectAnyArgsAndReturn(true);
-        vl6180_clear_interrupt_Expect();
-        uint32_t last_int = time;
+    vl6180_event_ExpectAndReturn(false);  // no event
+    apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(0);  // still on the bus
 
     TEST_ASSERT_FALSE(sense_poll(&sr));  // polling
 
@@ -661,8 +889,7 @@ void test_sense_poll_FullCycle(void) {
     TEST_ASSERT_EQUAL_UINT16(11, get_color_sample_count());
 
 
-// 7. poll, another accumulation
-    // No events from this point forward, block exited
+// 7. poll, collect sample, start another read
     time += VL6180_MEAS_PERIOD_MS;
     millis_ExpectAndReturn(time);
 
@@ -670,11 +897,12 @@ void test_sense_poll_FullCycle(void) {
 
     // Accumulation
         r=30, g=45, b=75, c=40;
-        apds9960_read_rgbc_ExpectAnyArgsAndReturn(true);
-         apds9960_read_rgbc_ReturnThruPtr_r(&r);
-         apds9960_read_rgbc_ReturnThruPtr_g(&g);
-         apds9960_read_rgbc_ReturnThruPtr_b(&b);
-         apds9960_read_rgbc_ReturnThruPtr_c(&c);
+        apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(1);
+         apds9960_read_rgbc_result_ReturnThruPtr_r(&r);
+         apds9960_read_rgbc_result_ReturnThruPtr_g(&g);
+         apds9960_read_rgbc_result_ReturnThruPtr_b(&b);
+         apds9960_read_rgbc_result_ReturnThruPtr_c(&c);
+        apds9960_read_rgbc_async_ExpectAndReturn(true);
 
     TEST_ASSERT_FALSE(sense_poll(&sr));
 
@@ -686,35 +914,23 @@ void test_sense_poll_FullCycle(void) {
     TEST_ASSERT_EQUAL_UINT16(12, get_color_sample_count());
     
 
-// 8. poll, no accumulation, don't end yet
-    time += VL6180_MEAS_PERIOD_MS-10;
-    millis_ExpectAndReturn(time);
-
-    vl6180_event_ExpectAndReturn(false);  // no event
-
-    TEST_ASSERT_FALSE(sense_poll(&sr));
-
-    TEST_ASSERT_EQUAL_UINT16(r, get_col_r_sum());
-    TEST_ASSERT_EQUAL_UINT16(g, get_col_g_sum());
-    TEST_ASSERT_EQUAL_UINT16(b, get_col_b_sum());
-    TEST_ASSERT_EQUAL_UINT16(c, get_col_c_sum());
-    TEST_ASSERT_EQUAL_UINT16(12, get_color_sample_count());
-    // For some reason these double before next accumulation (bug in test or implementation?)
-    
-
-// 9. poll, last accumulation, end session now
-    time += VL6180_QUIET_TIMEOUT_MS;
+// 8. poll, HIGH event: block left; collect the last sample and end now
+    time += 10;
     millis_ExpectAndReturn(time);
 
-    vl6180_event_ExpectAndReturn(false);  // no event
+    vl6180_event_ExpectAndReturn(true);  // event
+        vl6180_event_time_us_ExpectAndReturn(5000); // edge stamped in the ISR...
+        micros_ExpectAndReturn(5000);               // ...just now (no lag)
+        vl6180_set_interrupt_mode_async_ExpectAndReturn(VL6180_INT_LOW, true);
+        uint32_t last_int = time;
 
     // Accumulation
         r=10, g=40, b=85, c=20;
-        apds9960_read_rgbc_ExpectAnyArgsAndReturn(true);
-         apds9960_read_rgbc_ReturnThruPtr_r(&r);
-         apds9960_read_rgbc_ReturnThruPtr_g(&g);
-         apds9960_read_rgbc_ReturnThruPtr_b(&b);
-         apds9960_read_rgbc_ReturnThruPtr_c(&c);
+        apds9960_read_rgbc_result_ExpectAnyArgsAndReturn(1);
+         apds9960_read_rgbc_result_ReturnThruPtr_r(&r);
+         apds9960_read_rgbc_result_ReturnThruPtr_g(&g);
+         apds9960_read_rgbc_result_ReturnThruPtr_b(&b);
+         apds9960_read_rgbc_result_ReturnThruPtr_c(&c);
 
     // Should end now
         // Ending
@@ -724,7 +940,6 @@ void test_sense_poll_FullCycle(void) {
             decide_get_belt_mm_per_s_ExpectAndReturn(BELT_MM_PER_S);
             r=(2500+30+10), g=(605+45+40), b=(270+75+85), c=(5260+40+20);
             apds9960_classify_ExpectAndReturn(r, g, b, c, COLOR_RED);
-            uart_write_ExpectAnyArgsAndReturn(1);
 
 
     TEST_ASSERT_TRUE(sense_poll(&sr));
@@ -734,14 +949,15 @@ void test_sense_poll_FullCycle(void) {
     TEST_ASSERT_EQUAL_UINT16(b, get_col_b_sum());
     TEST_ASSERT_EQUAL_UINT16(c, get_col_c_sum());
     TEST_ASSERT_EQUAL_UINT16(13, get_color_sample_count());
+    TEST_ASSERT_FALSE(get_color_read_pending());
 
 
 // Validate output
     TEST_ASSERT_FALSE(get_session_active());
     TEST_ASSERT_FALSE(sr.ev.present);
     TEST_ASSERT_EQUAL_UINT32(last_int, sr.ev.t_exit_ms);
-    TEST_ASSERT_EQUAL_UINT32(last_int-start, sr.length.dwell_ms);  // 120ms
-    TEST_ASSERT_EQUAL_UINT16(66, sr.length.length_mm);  // 120ms * 55 mm/s = 66mm
+    TEST_ASSERT_EQUAL_UINT32(last_int-start, sr.length.dwell_ms);  // 180ms
+    TEST_ASSERT_EQUAL_UINT16(9, sr.length.length_mm);  // 180ms * 55 mm/s = 9.9mm
     TEST_ASSERT_EQUAL_UINT8(LEN_SMALL, sr.length.cls);
     TEST_ASSERT_EQUAL_UINT8(COLOR_RED, sr.color);
     TEST_ASSERT_FALSE(sr.ambiguous);
@@ -0,0 +1,60 @@
+#include "unity.h"
+#include "tb6600.h"
+#include "config.h"
+#include <avr/io.h>
+
+// Ceedling mocks
+#include "mock_gpio.h"
+#include "mock_timers.h"
+
+void TIMER0_COMPB_vect(void); // ramp tick ISR in tb6600.c
+
+static uint32_t s_now_ms;
+static uint32_t s_rate_ms_sum; // integral of the output rate (Hz*ms)
+
+static uint32_t fake_millis(int calls) {
+    (void)calls;
+    return s_now_ms;
+}
+
+// Advance n ms: the ramp tick (while enabled) runs right after each millis()
+// tick, as Timer0 COMPB does, and the resulting rate holds for that ms.
+static void run_ms(uint32_t n) {
+    while (n--) {
+        if (TIMSK0 & (1 << OCIE0B)) {
+            TIMER0_COMPB_vect();
+        }
+        s_rate_ms_sum += tb6600_get_step_rate_hz();
+        s_now_ms++;
+        TEST_ASSERT_EQUAL_UINT32(s_rate_ms_sum / 1000UL, tb6600_get_step_count());
+    }
+}
+
+void setUp(void) {
+    gpio_pin_mode_Ignore();
+    gpio_write_Ignore();
+    millis_StubWithCallback(fake_millis);
+}
+void tearDown(void) {}
+
+void test_tb6600_step_count_Should_MatchRateIntegral_ThroughRamps(void) {
+    s_now_ms = 0;
+    s_rate_ms_sum = 0;
+    TIMSK0 = 0;
+    tb6600_init();
+    TEST_ASSERT_EQUAL_UINT32(0, tb6600_get_step_count());
+
+    // Start ramp to cruise; stay long enough to fold whole seconds
+    tb6600_set_speed(BELT_MM_PER_S);
+    tb6600_start();
+    run_ms(1500);
+    TEST_ASSERT_TRUE(tb6600_at_target_speed());
+    run_ms(2500);
+
+    // Runtime change, slow down, then ramp to a stop
+    tb6600_set_speed(30);
+    run_ms(1000);
+    tb6600_set_speed(0);
+    run_ms(1500);
+    TEST_ASSERT_EQUAL_UINT16(0, tb6600_get_step_rate_hz());
+}